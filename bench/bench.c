@@ -0,0 +1,392 @@
+/**
+ * Microbenchmarks for the generated containers.
+ *
+ * Every benchmark case runs in a forked child process so that the peak RSS it reports
+ * belongs to that case alone. Results are written to stdout as CSV with one row per
+ * operation, and progress or skipped cases are reported on stderr.
+ *
+ * Usage: bench [-s SIZES] [-h HIT_RATIOS] [-f FILTER]
+ *   -s  comma separated element counts (default 1000,10000,100000,1000000)
+ *   -h  comma separated fraction of lookups that find a key (default 1,0.5,0)
+ *   -f  only run cases whose container name contains FILTER
+ *
+ * Keys are 64 bit integers. Lookups are drawn from the inserted keys in one of three
+ * distributions: sequential (insertion order), uniform random, or zipfian (s = 0.99).
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+/**
+ * Count allocations made by the containers. The headers call malloc, realloc, calloc and
+ * free directly, so redirecting them here before the headers are included sees every call.
+ */
+static size_t bench_allocs = 0;
+
+static inline void* bench_malloc(size_t n) {
+  bench_allocs += 1;
+  return malloc(n);
+}
+
+static inline void* bench_calloc(size_t n, size_t size) {
+  bench_allocs += 1;
+  return calloc(n, size);
+}
+
+static inline void* bench_realloc(void* p, size_t n) {
+  bench_allocs += 1;
+  return realloc(p, n);
+}
+
+#define malloc(n) bench_malloc(n)
+#define calloc(n, size) bench_calloc(n, size)
+#define realloc(p, n) bench_realloc(p, n)
+
+#include "bllist.h"
+#include "blhm.h"
+#include "blghm.h"
+#include "blfhm.h"
+#include "blrhm.h"
+#include "bltree.h"
+
+static inline size_t bench_hash(uint64_t k) {
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdull;
+  k ^= k >> 33;
+  return (size_t) k;
+}
+
+static inline int bench_cmp(uint64_t a, uint64_t b) {
+  return (a > b) - (a < b);
+}
+
+DYNAMIC_ARRAY(u64_list, uint64_t, 32);
+
+HASH_MAP(hm_16_1024, uint64_t, uint64_t, bench_hash, bench_cmp, 16, 1024);
+HASH_MAP(hm_1024_64, uint64_t, uint64_t, bench_hash, bench_cmp, 1024, 64);
+HASH_MAP(hm_65536_16, uint64_t, uint64_t, bench_hash, bench_cmp, 65536, 16);
+HASH_MAP_CACHED(hm_cached_65536_16, uint64_t, uint64_t, bench_hash, bench_cmp, 65536, 16);
+HASH_MAP_SORTED(hm_sorted_65536_16, uint64_t, uint64_t, bench_hash, bench_cmp, 65536, 16);
+GROWABLE_HASH_MAP(growable_hm, uint64_t, uint64_t, bench_hash, bench_cmp, 16, 8);
+FLAT_HASH_MAP(flat_hm, uint64_t, uint64_t, bench_hash, bench_cmp);
+ROBIN_HOOD_MAP(robin_hm, uint64_t, uint64_t, bench_hash, bench_cmp);
+BTREE_MAP(btree, uint64_t, uint64_t, bench_cmp, BTREE_NODE_ORDER(uint64_t));
+
+enum distribution {
+  DIST_SEQUENTIAL,
+  DIST_UNIFORM,
+  DIST_ZIPFIAN
+};
+
+static char const* distribution_names[] = { "sequential", "uniform", "zipfian" };
+
+struct bench_case {
+  char const* container;
+  size_t n;
+  enum distribution dist;
+  double hit_ratio;
+  /* Number of buckets for fixed bucket maps, or 0 if the container grows */
+  size_t buckets;
+};
+
+static inline uint64_t splitmix64(uint64_t* state) {
+  uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+static inline double uniform01(uint64_t* state) {
+  return (splitmix64(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * Zipfian index generator from Gray et al, "Quickly generating billion-record synthetic
+ * databases". Setup is O(n), each sample is O(1).
+ */
+struct zipf {
+  size_t n;
+  double theta, alpha, zetan, eta;
+};
+
+static void zipf_init(struct zipf* z, size_t n, double theta) {
+  double zeta2 = 1.0 + pow(0.5, theta);
+  z->n = n;
+  z->theta = theta;
+  z->zetan = 0;
+  for (size_t i = 1; i <= n; i++) {
+    z->zetan += 1.0 / pow((double) i, theta);
+  }
+  z->alpha = 1.0 / (1.0 - theta);
+  z->eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / z->zetan);
+}
+
+static size_t zipf_next(struct zipf* z, uint64_t* state) {
+  double u = uniform01(state);
+  double uz = u * z->zetan;
+  if (uz < 1.0) {
+    return 0;
+  }
+  if (uz < 1.0 + pow(0.5, z->theta)) {
+    return 1 < z->n ? 1 : 0;
+  }
+  size_t r = (size_t) (z->n * pow(z->eta * u - z->eta + 1.0, z->alpha));
+  return r < z->n ? r : z->n - 1;
+}
+
+/**
+ * Builds the inserted keys and the lookup sequence for a case.
+ * Inserted keys are distinct. Keys that should miss have the top bit set, which
+ * no inserted key has.
+ */
+static void make_keys(struct bench_case* c, uint64_t** keys_out, uint64_t** lookups_out) {
+  uint64_t* keys = malloc(sizeof(uint64_t) * c->n);
+  uint64_t* lookups = malloc(sizeof(uint64_t) * c->n);
+  uint64_t state = 42;
+
+  for (size_t i = 0; i < c->n; i++) {
+    keys[i] = c->dist == DIST_SEQUENTIAL ? i : (splitmix64(&state) >> 1);
+  }
+
+  struct zipf z = { 0 };
+  if (c->dist == DIST_ZIPFIAN) {
+    zipf_init(&z, c->n, 0.99);
+  }
+
+  for (size_t i = 0; i < c->n; i++) {
+    if (uniform01(&state) >= c->hit_ratio) {
+      lookups[i] = (splitmix64(&state) >> 1) | (1ull << 63);
+      continue;
+    }
+    size_t idx;
+    switch (c->dist) {
+      case DIST_SEQUENTIAL: idx = i; break;
+      case DIST_UNIFORM: idx = splitmix64(&state) % c->n; break;
+      default: idx = zipf_next(&z, &state); break;
+    }
+    lookups[i] = keys[idx];
+  }
+
+  *keys_out = keys;
+  *lookups_out = lookups;
+}
+
+static inline double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static long peak_rss_kb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+static void report(struct bench_case* c, char const* op, double elapsed_ns, size_t ops, size_t allocs) {
+  printf("%s,%s,%s,%zu,%.2f,%.2f,%zu,%ld\n",
+    c->container, op, distribution_names[c->dist], c->n, c->hit_ratio,
+    ops ? elapsed_ns / ops : 0.0, allocs, peak_rss_kb());
+  fflush(stdout);
+}
+
+/// Prevents the compiler from discarding lookup results
+static volatile uint64_t bench_sink;
+
+/**
+ * Declares a benchmark of _set, _find_ptr and _remove for any map with the HASH_MAP API.
+ */
+#define BENCH_MAP(NAME) \
+  static void bench_##NAME(struct bench_case* c) { \
+    uint64_t *keys, *lookups; \
+    make_keys(c, &keys, &lookups); \
+    struct NAME* map = malloc(sizeof(struct NAME)); \
+    bench_allocs = 0; \
+    double start = now_ns(); \
+    NAME##_init(map); \
+    for (size_t i = 0; i < c->n; i++) { \
+      NAME##_set(map, keys[i], i); \
+    } \
+    report(c, "set", now_ns() - start, c->n, bench_allocs); \
+    bench_allocs = 0; \
+    uint64_t sum = 0; \
+    start = now_ns(); \
+    for (size_t i = 0; i < c->n; i++) { \
+      uint64_t* v = NAME##_find_ptr(map, lookups[i]); \
+      sum += v ? *v : 1; \
+    } \
+    report(c, "find_ptr", now_ns() - start, c->n, bench_allocs); \
+    bench_sink = sum; \
+    bench_allocs = 0; \
+    start = now_ns(); \
+    for (size_t i = 0; i < c->n; i++) { \
+      NAME##_remove(map, lookups[i]); \
+    } \
+    report(c, "remove", now_ns() - start, c->n, bench_allocs); \
+    NAME##_free(map); \
+    free(map); \
+    free(keys); \
+    free(lookups); \
+  }
+
+BENCH_MAP(hm_16_1024)
+BENCH_MAP(hm_1024_64)
+BENCH_MAP(hm_65536_16)
+BENCH_MAP(hm_cached_65536_16)
+BENCH_MAP(hm_sorted_65536_16)
+BENCH_MAP(growable_hm)
+BENCH_MAP(flat_hm)
+BENCH_MAP(robin_hm)
+BENCH_MAP(btree)
+
+/**
+ * Benchmarks _push, indexed reads, _pop and removal from the front of a dynamic array.
+ * Removal from the front is O(n) per call, so it is only run for n <= 100000.
+ */
+static void bench_dynamic_array(struct bench_case* c) {
+  uint64_t *keys, *lookups;
+  make_keys(c, &keys, &lookups);
+  struct u64_list l;
+
+  bench_allocs = 0;
+  double start = now_ns();
+  u64_list_init(&l);
+  for (size_t i = 0; i < c->n; i++) {
+    u64_list_push(&l, keys[i]);
+  }
+  report(c, "push", now_ns() - start, c->n, bench_allocs);
+
+  uint64_t state = 7;
+  size_t* indices = malloc(sizeof(size_t) * c->n);
+  for (size_t i = 0; i < c->n; i++) {
+    indices[i] = c->dist == DIST_SEQUENTIAL ? i : splitmix64(&state) % c->n;
+  }
+
+  uint64_t sum = 0;
+  bench_allocs = 0;
+  start = now_ns();
+  for (size_t i = 0; i < c->n; i++) {
+    sum += l.data[indices[i]];
+  }
+  report(c, "index", now_ns() - start, c->n, bench_allocs);
+  bench_sink = sum;
+
+  if (c->n <= 100000) {
+    bench_allocs = 0;
+    start = now_ns();
+    for (size_t i = 0; i < c->n / 2; i++) {
+      sum += u64_list_remove(&l, 0);
+    }
+    report(c, "remove_front", now_ns() - start, c->n / 2, bench_allocs);
+  }
+
+  bench_allocs = 0;
+  size_t remaining = u64_list_size(&l);
+  start = now_ns();
+  while (u64_list_size(&l)) {
+    sum += u64_list_pop(&l);
+  }
+  report(c, "pop", now_ns() - start, remaining, bench_allocs);
+  bench_sink = sum;
+
+  u64_list_free(&l);
+  free(indices);
+  free(keys);
+  free(lookups);
+}
+
+struct bench_entry {
+  char const* container;
+  void (*fn)(struct bench_case*);
+  /* Number of buckets for fixed bucket maps, or 0 if the container grows */
+  size_t buckets;
+  /* Whether the case depends on the hit ratio */
+  bool uses_lookups;
+};
+
+static struct bench_entry benches[] = {
+  { "dynamic_array", bench_dynamic_array, 0, false },
+  { "hash_map_16_1024", bench_hm_16_1024, 16, true },
+  { "hash_map_1024_64", bench_hm_1024_64, 1024, true },
+  { "hash_map_65536_16", bench_hm_65536_16, 65536, true },
+  { "hash_map_cached_65536_16", bench_hm_cached_65536_16, 65536, true },
+  { "hash_map_sorted_65536_16", bench_hm_sorted_65536_16, 65536, true },
+  { "growable_hash_map", bench_growable_hm, 0, true },
+  { "flat_hash_map", bench_flat_hm, 0, true },
+  { "robin_hood_map", bench_robin_hm, 0, true },
+  { "btree_map", bench_btree, 0, true },
+};
+
+/// Fixed bucket maps with more than this many elements per bucket take too long to be useful
+#define BENCH_MAX_BUCKET_LOAD 4096
+
+static size_t parse_list(char const* arg, double* out, size_t max) {
+  size_t n = 0;
+  char* copy = strdup(arg);
+  for (char* tok = strtok(copy, ","); tok && n < max; tok = strtok(NULL, ",")) {
+    out[n++] = atof(tok);
+  }
+  free(copy);
+  return n;
+}
+
+int main(int argc, char** argv) {
+  double sizes[32] = { 1000, 10000, 100000, 1000000 };
+  size_t num_sizes = 4;
+  double hit_ratios[16] = { 1.0, 0.5, 0.0 };
+  size_t num_hit_ratios = 3;
+  char const* filter = NULL;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "s:h:f:")) != -1) {
+    switch (opt) {
+      case 's': num_sizes = parse_list(optarg, sizes, 32); break;
+      case 'h': num_hit_ratios = parse_list(optarg, hit_ratios, 16); break;
+      case 'f': filter = optarg; break;
+      default:
+        fprintf(stderr, "Usage: %s [-s SIZES] [-h HIT_RATIOS] [-f FILTER]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+
+  printf("container,op,distribution,n,hit_ratio,ns_per_op,allocs,peak_rss_kb\n");
+  fflush(stdout);
+
+  for (size_t b = 0; b < sizeof(benches) / sizeof(benches[0]); b++) {
+    if (filter && !strstr(benches[b].container, filter)) {
+      continue;
+    }
+    for (size_t s = 0; s < num_sizes; s++) {
+      size_t n = (size_t) sizes[s];
+      if (benches[b].buckets && n / benches[b].buckets > BENCH_MAX_BUCKET_LOAD) {
+        fprintf(stderr, "skip %s n=%zu: over %d elements per bucket\n", benches[b].container, n, BENCH_MAX_BUCKET_LOAD);
+        continue;
+      }
+      for (size_t d = DIST_SEQUENTIAL; d <= DIST_ZIPFIAN; d++) {
+        size_t ratios = benches[b].uses_lookups ? num_hit_ratios : 1;
+        for (size_t h = 0; h < ratios; h++) {
+          struct bench_case c = { benches[b].container, n, d, benches[b].uses_lookups ? hit_ratios[h] : 1.0, benches[b].buckets };
+          pid_t pid = fork();
+          if (pid == 0) {
+            benches[b].fn(&c);
+            exit(EXIT_SUCCESS);
+          }
+          int status;
+          waitpid(pid, &status, 0);
+          if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "case %s n=%zu %s failed\n", c.container, n, distribution_names[d]);
+          }
+        }
+      }
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
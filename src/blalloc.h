@@ -0,0 +1,74 @@
+#ifndef _BLAKE_ALLOC_H_
+#define _BLAKE_ALLOC_H_
+#include <stdlib.h>
+#include <stddef.h>
+
+/**
+ * An allocator is a context pointer and a set of functions that the allocator aware
+ * variants of the data structures (DYNAMIC_ARRAY_ALLOCATOR, HASH_MAP_ALLOCATOR and
+ * CREATE_LINKED_LIST_ALLOCATOR) use in place of malloc, realloc and free. This allows
+ * containers to be placed on arenas or per-thread pools.
+ *
+ * Every call is passed the context pointer and the size of the allocation being resized
+ * or released, so that simple allocators (e.g, a bump allocator that is reset at the end of
+ * a request) do not need to track allocation sizes themselves. free_fn may be a no-op for
+ * allocators that release all of their memory at once.
+ *
+ * The allocator is referenced, not copied, by the structures that use it, so it must
+ * outlive them.
+ */
+struct bl_allocator {
+  void* ctx;
+  void* (*alloc_fn)(void* ctx, size_t size);
+  void* (*realloc_fn)(void* ctx, void* ptr, size_t old_size, size_t new_size);
+  void (*free_fn)(void* ctx, void* ptr, size_t size);
+};
+
+static inline void* bl_malloc_alloc(void* ctx, size_t size) {
+  (void) ctx;
+  return malloc(size);
+}
+
+static inline void* bl_malloc_realloc(void* ctx, void* ptr, size_t old_size, size_t new_size) {
+  (void) ctx;
+  (void) old_size;
+  return realloc(ptr, new_size);
+}
+
+static inline void bl_malloc_free(void* ctx, void* ptr, size_t size) {
+  (void) ctx;
+  (void) size;
+  free(ptr);
+}
+
+/**
+ * The allocator used by the _init method of allocator aware structures, which
+ * forwards to the standard library.
+ */
+static struct bl_allocator const bl_malloc_allocator = {
+  NULL,
+  bl_malloc_alloc,
+  bl_malloc_realloc,
+  bl_malloc_free
+};
+
+/**
+ * Resizes an allocation, or creates a new one if ptr is NULL.
+ */
+static inline void* bl_allocator_realloc(struct bl_allocator const* a, void* ptr, size_t old_size, size_t new_size) {
+  if (!ptr) {
+    return a->alloc_fn(a->ctx, new_size);
+  }
+  return a->realloc_fn(a->ctx, ptr, old_size, new_size);
+}
+
+/**
+ * Releases an allocation. NULL pointers are ignored.
+ */
+static inline void bl_allocator_free(struct bl_allocator const* a, void* ptr, size_t size) {
+  if (ptr) {
+    a->free_fn(a->ctx, ptr, size);
+  }
+}
+
+#endif
@@ -0,0 +1,194 @@
+#ifndef _BLAKE_CHM_H_
+#define _BLAKE_CHM_H_
+#include "blhm.h"
+#include <pthread.h>
+#include <stdbool.h>
+
+/**
+ * CONCURRENT_HASH_MAP is a thread-safe HASH_MAP. Rather than protecting the whole map with a
+ * single mutex, the buckets are divided into STRIPES contiguous ranges of BUCKETS / STRIPES
+ * buckets and each range has its own reader-writer lock. Since HASH_MAP buckets are
+ * independent arrays, threads working on keys in different stripes do not share locks or
+ * bucket arrays, and threads reading keys in the same stripe proceed in parallel. Giving each
+ * stripe a contiguous range (rather than every STRIPES-th bucket) means neighbouring bucket
+ * headers, which share cache lines, belong to the same stripe, so writers in different
+ * stripes only touch a common cache line at the edges of their ranges.
+ *
+ * Every operation takes exactly one stripe lock and completes atomically with respect to
+ * every other operation on the same key. Pointers into the map are never returned, since
+ * another thread could move or free the entry as soon as the lock is released, so results
+ * are copied out (_find_copy) and read-modify-write updates are made under the lock by a
+ * callback (_compute).
+ *
+ * STRIPES should be a few times the number of threads using the map so that two threads
+ * rarely need the same stripe, and must divide BUCKETS. Each stripe keeps the count of its
+ * own elements next to its lock, and is padded so that different stripes do not share a
+ * cache line, so inserts and removals in different stripes never write the same memory.
+ *
+ * Requires linking with pthreads.
+ */
+#define CONCURRENT_HASH_MAP_TYPE(NAME, BUCKETS, STRIPES) \
+  _Static_assert((BUCKETS) % (STRIPES) == 0, "CONCURRENT_HASH_MAP requires STRIPES to divide BUCKETS"); \
+  struct NAME##_stripe { \
+    pthread_rwlock_t lock; \
+    /* The number of elements in this stripe's buckets, only written under the write lock */ \
+    size_t count; \
+    char pad[64]; \
+  }; \
+  typedef struct NAME { \
+    struct NAME##_unlocked map; \
+    struct NAME##_stripe stripes[STRIPES]; \
+  } NAME##_t;
+
+#define CONCURRENT_HASH_MAP_INIT(NAME, STRIPES) \
+  static inline void NAME##_init(struct NAME* map) { \
+    NAME##_unlocked_init(&map->map); \
+    for (size_t i = 0; i < STRIPES; i++) { \
+      pthread_rwlock_init(&map->stripes[i].lock, NULL); \
+      map->stripes[i].count = 0; \
+    } \
+  }
+
+/**
+ * _free free's any memory associated with the map. It must not be called while any other
+ * thread is using the map.
+ */
+#define CONCURRENT_HASH_MAP_FREE(NAME, STRIPES) \
+  static inline void NAME##_free(struct NAME* map) { \
+    NAME##_unlocked_free(&map->map); \
+    for (size_t i = 0; i < STRIPES; i++) { \
+      pthread_rwlock_destroy(&map->stripes[i].lock); \
+    } \
+  }
+
+/**
+ * INTERNAL CALL: The stripe holding the bucket of a key.
+ */
+#define CONCURRENT_HASH_MAP_GET_STRIPE(NAME, KEY_TYPE, BUCKETS, STRIPES) \
+  static inline struct NAME##_stripe* NAME##_get_stripe(struct NAME* map, KEY_TYPE key) { \
+    return &map->stripes[NAME##_unlocked_get_bucket(key) / ((BUCKETS) / (STRIPES))]; \
+  } \
+  /* INTERNAL CALL: Adjusts the count of a stripe, which must be locked for writing */ \
+  static inline void NAME##_stripe_add(struct NAME##_stripe* stripe, size_t n) { \
+    __atomic_store_n(&stripe->count, stripe->count + n, __ATOMIC_RELAXED); \
+  }
+
+/**
+ * _upsert sets the data of a key, inserting the key if it is not present.
+ * Returns true if the key was inserted, or false if existing data was replaced.
+ */
+#define CONCURRENT_HASH_MAP_UPSERT(NAME, KEY_TYPE, DATA_TYPE) \
+  static inline bool NAME##_upsert(struct NAME* map, KEY_TYPE key, DATA_TYPE val) { \
+    struct NAME##_stripe* stripe = NAME##_get_stripe(map, key); \
+    pthread_rwlock_wrlock(&stripe->lock); \
+    DATA_TYPE* data = NAME##_unlocked_find_ptr(&map->map, key); \
+    if (data) { \
+      *data = val; \
+    } else { \
+      struct NAME##_unlocked_entry e = { key, val }; \
+      NAME##_unlocked_bucket_push(&map->map.buckets[NAME##_unlocked_get_bucket(key)], e); \
+      NAME##_stripe_add(stripe, 1); \
+    } \
+    pthread_rwlock_unlock(&stripe->lock); \
+    return data == NULL; \
+  }
+
+/**
+ * _find_copy returns true if a key is present in the map, and copies its data into *data
+ * if data is not NULL. Lookups of keys in the same stripe run concurrently.
+ */
+#define CONCURRENT_HASH_MAP_FIND_COPY(NAME, KEY_TYPE, DATA_TYPE) \
+  static inline bool NAME##_find_copy(struct NAME* map, KEY_TYPE key, DATA_TYPE* data) { \
+    struct NAME##_stripe* stripe = NAME##_get_stripe(map, key); \
+    pthread_rwlock_rdlock(&stripe->lock); \
+    bool found = NAME##_unlocked_find(&map->map, key, data); \
+    pthread_rwlock_unlock(&stripe->lock); \
+    return found; \
+  }
+
+/**
+ * _remove removes a key from the map. Returns true if the key was present.
+ */
+#define CONCURRENT_HASH_MAP_REMOVE(NAME, KEY_TYPE) \
+  static inline bool NAME##_remove(struct NAME* map, KEY_TYPE key) { \
+    struct NAME##_stripe* stripe = NAME##_get_stripe(map, key); \
+    pthread_rwlock_wrlock(&stripe->lock); \
+    bool found = NAME##_unlocked_take(&map->map, key, NULL); \
+    if (found) { \
+      NAME##_stripe_add(stripe, (size_t) -1); \
+    } \
+    pthread_rwlock_unlock(&stripe->lock); \
+    return found; \
+  }
+
+/**
+ * _compute performs an atomic read-modify-write of the data of a key.
+ *
+ * fn(key, data, present, ctx) is called while the key's stripe is locked for writing.
+ * If the key is present, data points to its data. Otherwise present is false and data
+ * points to a zero initialized value. If fn returns true the (possibly modified) data is
+ * stored under the key, inserting it if it was not present. If fn returns false the key
+ * is removed, or not inserted.
+ *
+ * fn must not call back into the map. Returns true if the key is present afterwards.
+ *
+ * Example, incrementing a counter: bool inc(KEY k, int* v, bool present, void* c) { *v += 1; return true; }
+ */
+#define CONCURRENT_HASH_MAP_COMPUTE(NAME, KEY_TYPE, DATA_TYPE) \
+  typedef bool (*NAME##_compute_fn_t)(KEY_TYPE key, DATA_TYPE* data, bool present, void* ctx); \
+  static inline bool NAME##_compute(struct NAME* map, KEY_TYPE key, NAME##_compute_fn_t fn, void* ctx) { \
+    struct NAME##_stripe* stripe = NAME##_get_stripe(map, key); \
+    pthread_rwlock_wrlock(&stripe->lock); \
+    DATA_TYPE* data = NAME##_unlocked_find_ptr(&map->map, key); \
+    bool keep; \
+    if (data) { \
+      keep = fn(key, data, true, ctx); \
+      if (!keep) { \
+        NAME##_unlocked_remove_ptr(&map->map, data); \
+        NAME##_stripe_add(stripe, (size_t) -1); \
+      } \
+    } else { \
+      struct NAME##_unlocked_entry e; \
+      memset(&e, 0, sizeof(e)); \
+      e.key = key; \
+      keep = fn(key, &e.data, false, ctx); \
+      if (keep) { \
+        NAME##_unlocked_bucket_push(&map->map.buckets[NAME##_unlocked_get_bucket(key)], e); \
+        NAME##_stripe_add(stripe, 1); \
+      } \
+    } \
+    pthread_rwlock_unlock(&stripe->lock); \
+    return keep; \
+  }
+
+/**
+ * _count returns the number of elements in the map, summing the count of every stripe
+ * without taking any locks. While other threads are modifying the map this is an estimate
+ * that may be out of date by the time it is returned.
+ */
+#define CONCURRENT_HASH_MAP_COUNT(NAME, STRIPES) \
+  static inline size_t NAME##_count(struct NAME* map) { \
+    size_t count = 0; \
+    for (size_t i = 0; i < STRIPES; i++) { \
+      count += __atomic_load_n(&map->stripes[i].count, __ATOMIC_RELAXED); \
+    } \
+    return count; \
+  }
+
+/**
+ * Declares the map NAME, and the unsynchronized HASH_MAP NAME_unlocked which stores its
+ * elements. The backing map should not be modified directly.
+ */
+#define CONCURRENT_HASH_MAP(NAME, KEY_TYPE, DATA_TYPE, HASH_FN, CMP_FN, BUCKETS, BLOCK_SIZE, STRIPES) \
+  HASH_MAP(NAME##_unlocked, KEY_TYPE, DATA_TYPE, HASH_FN, CMP_FN, BUCKETS, BLOCK_SIZE); \
+  CONCURRENT_HASH_MAP_TYPE(NAME, BUCKETS, STRIPES) \
+  CONCURRENT_HASH_MAP_INIT(NAME, STRIPES) \
+  CONCURRENT_HASH_MAP_FREE(NAME, STRIPES) \
+  CONCURRENT_HASH_MAP_GET_STRIPE(NAME, KEY_TYPE, BUCKETS, STRIPES) \
+  CONCURRENT_HASH_MAP_UPSERT(NAME, KEY_TYPE, DATA_TYPE) \
+  CONCURRENT_HASH_MAP_FIND_COPY(NAME, KEY_TYPE, DATA_TYPE) \
+  CONCURRENT_HASH_MAP_REMOVE(NAME, KEY_TYPE) \
+  CONCURRENT_HASH_MAP_COMPUTE(NAME, KEY_TYPE, DATA_TYPE) \
+  CONCURRENT_HASH_MAP_COUNT(NAME, STRIPES)
+
+#endif
@@ -0,0 +1,406 @@
+#ifndef _BLAKE_FHM_H_
+#define _BLAKE_FHM_H_
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdbool.h>
+#include "blhash.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * This flat hash map is an open-addressing alternative to the chained HASH_MAP in blhm.h.
+ * Rather than selecting a bucket and scanning a separately allocated dynamic array, entries
+ * are stored inline in a single table alongside an array of control bytes, one per slot.
+ *
+ * Each control byte is either EMPTY, DELETED (a tombstone) or FULL, in which case it holds
+ * 7 bits of the key hash. A lookup uses the remaining bits of the hash to select a group of
+ * FLAT_HASH_MAP_GROUP_WIDTH slots and compares all of that group's control bytes against the
+ * 7 hash bits at once (using SSE2 where available). CMP_FN is only called on slots whose
+ * control byte matches, and the probe stops at the first group containing an EMPTY slot.
+ *
+ * The generated API mirrors HASH_MAP (_set, _find, _find_ptr, _remove, _change_key,
+ * _count and _delete_matching) so that switching between the two is a one line change.
+ * Since there is no fixed number of buckets the table grows on demand, keeping at least
+ * 1/8th of the slots empty so that probe sequences remain short.
+ *
+ * The user supplied HASH_FN is mixed before use, so identity hashes on integer keys
+ * still spread across groups.
+ */
+
+/// Number of control bytes inspected per probe step. This is the width of an SSE2 register.
+#define FLAT_HASH_MAP_GROUP_WIDTH 16
+
+/// Control byte values. Any control byte with the top bit clear is a FULL slot.
+#define FLAT_HASH_MAP_EMPTY ((int8_t) -128)
+#define FLAT_HASH_MAP_DELETED ((int8_t) -2)
+
+/// Number of slots allocated by the first insert into an empty map.
+#define FLAT_HASH_MAP_INITIAL_CAPACITY FLAT_HASH_MAP_GROUP_WIDTH
+
+/**
+ * INTERNAL CALL: Returns a bitmask with bit i set if the control byte i of the group
+ * starting at ctrl is equal to v.
+ */
+static inline uint32_t flat_hash_map_group_match(int8_t const* ctrl, int8_t v) {
+#ifdef __SSE2__
+  __m128i group = _mm_loadu_si128((__m128i const*) ctrl);
+  return (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(v)));
+#else
+  uint32_t mask = 0;
+  for (size_t i = 0; i < FLAT_HASH_MAP_GROUP_WIDTH; i++) {
+    mask |= (uint32_t) (ctrl[i] == v) << i;
+  }
+  return mask;
+#endif
+}
+
+/**
+ * INTERNAL CALL: Returns a bitmask of the EMPTY or DELETED slots in a group.
+ * Both have the top bit set, which is exactly what movemask extracts.
+ */
+static inline uint32_t flat_hash_map_group_match_free(int8_t const* ctrl) {
+#ifdef __SSE2__
+  return (uint32_t) _mm_movemask_epi8(_mm_loadu_si128((__m128i const*) ctrl));
+#else
+  uint32_t mask = 0;
+  for (size_t i = 0; i < FLAT_HASH_MAP_GROUP_WIDTH; i++) {
+    mask |= (uint32_t) (ctrl[i] < 0) << i;
+  }
+  return mask;
+#endif
+}
+
+/**
+ * The map structure holds the control bytes and the slot array. Both are NULL until
+ * the first insert, so an initialized but unused map does not allocate.
+ */
+#define FLAT_HASH_MAP_TYPE(NAME, KEY_TYPE, DATA_TYPE) \
+  typedef struct NAME##_entry { \
+    KEY_TYPE key; \
+    DATA_TYPE data; \
+  } NAME##_entry_t; \
+  typedef struct NAME { \
+    /* One control byte per slot */ \
+    int8_t* ctrl; \
+    /* The slot array, only slots with a FULL control byte are initialized */ \
+    struct NAME##_entry* slots; \
+    /* Number of slots, always zero or a power of two multiple of the group width */ \
+    size_t capacity; \
+    /* Number of FULL slots */ \
+    size_t count; \
+    /* Number of EMPTY slots that may be filled before the table must be rehashed */ \
+    size_t growth_left; \
+  } NAME##_t;
+
+/**
+ * _init puts a map structure into a state where it is ready to include elements.
+ * This function must be called before the hashmap is used.
+ */
+#define FLAT_HASH_MAP_INIT(NAME) \
+  static inline void NAME##_init(struct NAME* map) { \
+    memset(map, 0, sizeof(struct NAME)); \
+  }
+
+/**
+ * _free free's any memory associated with the hash map.
+ * NOTE: This does not free underlying memory in cases
+ * where DATA_TYPE is a pointer. That is left to the user
+ */
+#define FLAT_HASH_MAP_FREE(NAME) \
+  static inline void NAME##_free(struct NAME* map) { \
+    free(map->ctrl); \
+    free(map->slots); \
+    memset(map, 0, sizeof(struct NAME)); \
+  }
+
+/**
+ * INTERNAL CALL: Returns the mixed hash of a key.
+ */
+#define FLAT_HASH_MAP_HASH(NAME, KEY_TYPE, HASH_FN) \
+  static inline uint64_t NAME##_mixed_hash(KEY_TYPE key) { \
+    return bl_hash_fold((uint64_t) HASH_FN(key)); \
+  }
+
+/**
+ * INTERNAL CALL: Finds the first EMPTY or DELETED slot on the probe sequence of a hash.
+ * The table must have at least one free slot.
+ * Probing visits groups in triangular order, which visits every group once
+ * when the number of groups is a power of two.
+ */
+#define FLAT_HASH_MAP_FIND_FREE(NAME) \
+  static inline size_t NAME##_find_free(struct NAME* map, uint64_t hash) { \
+    size_t group_mask = (map->capacity / FLAT_HASH_MAP_GROUP_WIDTH) - 1; \
+    size_t group = (hash >> 7) & group_mask; \
+    for (size_t step = 1;; step++) { \
+      size_t base = group * FLAT_HASH_MAP_GROUP_WIDTH; \
+      uint32_t free_mask = flat_hash_map_group_match_free(map->ctrl + base); \
+      if (free_mask) { \
+        return base + __builtin_ctz(free_mask); \
+      } \
+      group = (group + step) & group_mask; \
+    } \
+  }
+
+/**
+ * INTERNAL CALL: Re-allocates the table with new_capacity slots and re-inserts every
+ * element. This also clears any DELETED markers.
+ */
+#define FLAT_HASH_MAP_RESIZE(NAME) \
+  static inline void NAME##_resize(struct NAME* map, size_t new_capacity) { \
+    int8_t* old_ctrl = map->ctrl; \
+    struct NAME##_entry* old_slots = map->slots; \
+    size_t old_capacity = map->capacity; \
+    map->ctrl = malloc(new_capacity); \
+    map->slots = malloc(sizeof(struct NAME##_entry) * new_capacity); \
+    memset(map->ctrl, FLAT_HASH_MAP_EMPTY, new_capacity); \
+    map->capacity = new_capacity; \
+    map->growth_left = (new_capacity - (new_capacity / 8)) - map->count; \
+    for (size_t i = 0; i < old_capacity; i++) { \
+      if (old_ctrl[i] >= 0) { \
+        uint64_t hash = NAME##_mixed_hash(old_slots[i].key); \
+        size_t idx = NAME##_find_free(map, hash); \
+        map->ctrl[idx] = (int8_t) (hash & 0x7F); \
+        map->slots[idx] = old_slots[i]; \
+      } \
+    } \
+    free(old_ctrl); \
+    free(old_slots); \
+  }
+
+/**
+ * _find_ptr returns a pointer to any matching element inside the map or NULL otherwise.
+ * If find_ptr finds an element, then updating the element by dereferencing will change
+ * the underlying value in the map.
+ *
+ * WARNING: find_ptr is not stable between inserts or deletions since an insert may
+ * rehash the table.
+ */
+#define FLAT_HASH_MAP_FIND_PTR(NAME, KEY_TYPE, DATA_TYPE, CMP_FN) \
+  static inline DATA_TYPE* NAME##_find_ptr(struct NAME* map, KEY_TYPE key) { \
+    if (!map->capacity) { \
+      return NULL; \
+    } \
+    uint64_t hash = NAME##_mixed_hash(key); \
+    int8_t h2 = (int8_t) (hash & 0x7F); \
+    size_t group_mask = (map->capacity / FLAT_HASH_MAP_GROUP_WIDTH) - 1; \
+    size_t group = (hash >> 7) & group_mask; \
+    for (size_t step = 1; step <= group_mask + 1; step++) { \
+      size_t base = group * FLAT_HASH_MAP_GROUP_WIDTH; \
+      uint32_t match = flat_hash_map_group_match(map->ctrl + base, h2); \
+      while (match) { \
+        size_t idx = base + __builtin_ctz(match); \
+        if (!CMP_FN(key, map->slots[idx].key)) { \
+          return &map->slots[idx].data; \
+        } \
+        match &= match - 1; \
+      } \
+      if (flat_hash_map_group_match(map->ctrl + base, FLAT_HASH_MAP_EMPTY)) { \
+        return NULL; \
+      } \
+      group = (group + step) & group_mask; \
+    } \
+    return NULL; \
+  }
+
+/**
+ * INTERNAL CALL: Probes for a key with a given mixed hash in a single pass. If the key is
+ * present its slot is returned and *found is set. Otherwise *found is cleared and the first
+ * EMPTY or DELETED slot on the probe sequence is returned, which is where _set places a new
+ * key. The table must have at least one free slot.
+ */
+#define FLAT_HASH_MAP_PROBE(NAME, KEY_TYPE, CMP_FN) \
+  static inline size_t NAME##_probe(struct NAME* map, KEY_TYPE key, uint64_t hash, bool* found) { \
+    int8_t h2 = (int8_t) (hash & 0x7F); \
+    size_t group_mask = (map->capacity / FLAT_HASH_MAP_GROUP_WIDTH) - 1; \
+    size_t group = (hash >> 7) & group_mask; \
+    size_t first_free = SIZE_MAX; \
+    for (size_t step = 1; step <= group_mask + 1; step++) { \
+      size_t base = group * FLAT_HASH_MAP_GROUP_WIDTH; \
+      uint32_t match = flat_hash_map_group_match(map->ctrl + base, h2); \
+      while (match) { \
+        size_t idx = base + __builtin_ctz(match); \
+        if (!CMP_FN(key, map->slots[idx].key)) { \
+          *found = true; \
+          return idx; \
+        } \
+        match &= match - 1; \
+      } \
+      uint32_t free_mask = flat_hash_map_group_match_free(map->ctrl + base); \
+      if (free_mask && first_free == SIZE_MAX) { \
+        first_free = base + __builtin_ctz(free_mask); \
+      } \
+      if (flat_hash_map_group_match(map->ctrl + base, FLAT_HASH_MAP_EMPTY)) { \
+        break; \
+      } \
+      group = (group + step) & group_mask; \
+    } \
+    *found = false; \
+    return first_free; \
+  }
+
+/**
+ * _find returns true or false if an element with a given key exists inside the map.
+ * The data argument will be ignored if set to NULL or the element does not exist
+ * within the map, otherwise the pointed value will be set to the value with
+ * the corresponding key (*data = *NAME_find_ptr(map, key)).
+ */
+#define FLAT_HASH_MAP_FIND(NAME, KEY_TYPE, DATA_TYPE) \
+  static inline bool NAME##_find(struct NAME* map, KEY_TYPE key, DATA_TYPE* data) { \
+    DATA_TYPE* ptr = NAME##_find_ptr(map, key); \
+    if (ptr) { \
+      if (data) { \
+        *data = *ptr; \
+      } \
+      return true; \
+    } else { \
+      return false; \
+    } \
+  }
+
+/**
+ * INTERNAL CALL: Marks slot idx as no longer in use.
+ * If the group that holds the slot already contains an EMPTY slot then no probe
+ * sequence can have continued past this group, so the slot can be made EMPTY
+ * rather than DELETED.
+ */
+#define FLAT_HASH_MAP_ERASE_SLOT(NAME) \
+  static inline void NAME##_erase_slot(struct NAME* map, size_t idx) { \
+    size_t base = idx - (idx % FLAT_HASH_MAP_GROUP_WIDTH); \
+    if (flat_hash_map_group_match(map->ctrl + base, FLAT_HASH_MAP_EMPTY)) { \
+      map->ctrl[idx] = FLAT_HASH_MAP_EMPTY; \
+      map->growth_left += 1; \
+    } else { \
+      map->ctrl[idx] = FLAT_HASH_MAP_DELETED; \
+    } \
+    map->count -= 1; \
+  }
+
+/**
+ * _remove removes the key-value pair with a given key from the map, if present.
+ */
+#define FLAT_HASH_MAP_REMOVE(NAME, KEY_TYPE, DATA_TYPE) \
+  static inline void NAME##_remove(struct NAME* map, KEY_TYPE key) { \
+    DATA_TYPE* ptr = NAME##_find_ptr(map, key); \
+    if (ptr) { \
+      struct NAME##_entry* entry = (struct NAME##_entry*) ((char*) ptr - offsetof(struct NAME##_entry, data)); \
+      NAME##_erase_slot(map, (size_t) (entry - map->slots)); \
+    } \
+  }
+
+/**
+ * _set places the supplied key-value pair into the hash map.
+ *
+ * If this key is in the map then _set replaces the value associated with
+ * that key with the supplied value.
+ *
+ * If the key does not already exist then _set places it into the first free slot
+ * of its probe sequence, rehashing first if there are no EMPTY slots left to use.
+ * The table doubles in size unless at least half of the used slots are DELETED,
+ * in which case it is rehashed in place to clear them.
+ */
+#define FLAT_HASH_MAP_SET(NAME, KEY_TYPE, DATA_TYPE) \
+  static inline void NAME##_set(struct NAME* map, KEY_TYPE key, DATA_TYPE val) { \
+    if (!map->capacity) { \
+      NAME##_resize(map, FLAT_HASH_MAP_INITIAL_CAPACITY); \
+    } \
+    uint64_t hash = NAME##_mixed_hash(key); \
+    bool found; \
+    size_t idx = NAME##_probe(map, key, hash, &found); \
+    if (found) { \
+      map->slots[idx].data = val; \
+      return; \
+    } \
+    if (map->growth_left == 0 && map->ctrl[idx] == FLAT_HASH_MAP_EMPTY) { \
+      if (map->count * 2 <= map->capacity - (map->capacity / 8)) { \
+        NAME##_resize(map, map->capacity); \
+      } else { \
+        NAME##_resize(map, map->capacity * 2); \
+      } \
+      idx = NAME##_find_free(map, hash); \
+    } \
+    if (map->ctrl[idx] == FLAT_HASH_MAP_EMPTY) { \
+      map->growth_left -= 1; \
+    } \
+    map->ctrl[idx] = (int8_t) (hash & 0x7F); \
+    map->slots[idx].key = key; \
+    map->slots[idx].data = val; \
+    map->count += 1; \
+  }
+
+/**
+ * _change_key replaces the key of a key-value pair with a new one.
+ *
+ * If there is no value with a given key in the map then this call will do nothing.
+ */
+#define FLAT_HASH_MAP_CHANGE_KEY(NAME, KEY_TYPE, DATA_TYPE) \
+  static inline void NAME##_change_key(struct NAME* map, KEY_TYPE current_key, KEY_TYPE new_key) { \
+    DATA_TYPE val; \
+    if (NAME##_find(map, current_key, &val)) { \
+      NAME##_remove(map, current_key); \
+      NAME##_set(map, new_key, val); \
+    } \
+  }
+
+/**
+ * This macro creates a method which will delete any elements in the map which match a predicate.
+ *
+ * The delete callback is called once for every single element in the hashmap. If the callback
+ * returns true for a given element then that element will be removed from the map.
+ *
+ * The post callback will be called after a method has been removed from the map, so that a cleanup
+ * function may safely be called. If the post callback is NULL we ignore it.
+ */
+#define FLAT_HASH_MAP_DELETE_MATCHING(NAME) \
+  typedef bool (* NAME##_delete_callback_ptr_t)(struct NAME##_entry* v); \
+  typedef void (* NAME##_post_delete_callback_ptr_t)(struct NAME##_entry* v); \
+  static inline void NAME##_delete_matching(struct NAME* l, NAME##_delete_callback_ptr_t matches, NAME##_post_delete_callback_ptr_t post) { \
+    for (size_t i = 0; i < l->capacity; i++) { \
+      if (l->ctrl[i] >= 0 && matches(&l->slots[i])) { \
+        struct NAME##_entry nval = l->slots[i]; \
+        NAME##_erase_slot(l, i); \
+        if (post) { \
+          post(&nval); \
+        } \
+      } \
+    } \
+  }
+
+/**
+ * _count returns the total number of elements in the map.
+ */
+#define FLAT_HASH_MAP_COUNT(NAME) \
+  static inline size_t NAME##_count(struct NAME* l) { \
+    return l->count; \
+  }
+
+/**
+ * _capacity returns the number of slots currently allocated by the map.
+ */
+#define FLAT_HASH_MAP_CAPACITY(NAME) \
+  static inline size_t NAME##_capacity(struct NAME* l) { \
+    return l->capacity; \
+  }
+
+#define FLAT_HASH_MAP(NAME, KEY_TYPE, DATA_TYPE, HASH_FN, CMP_FN) \
+  FLAT_HASH_MAP_TYPE(NAME, KEY_TYPE, DATA_TYPE); \
+  FLAT_HASH_MAP_INIT(NAME) \
+  FLAT_HASH_MAP_FREE(NAME) \
+  FLAT_HASH_MAP_HASH(NAME, KEY_TYPE, HASH_FN) \
+  FLAT_HASH_MAP_FIND_FREE(NAME) \
+  FLAT_HASH_MAP_RESIZE(NAME) \
+  FLAT_HASH_MAP_FIND_PTR(NAME, KEY_TYPE, DATA_TYPE, CMP_FN) \
+  FLAT_HASH_MAP_PROBE(NAME, KEY_TYPE, CMP_FN) \
+  FLAT_HASH_MAP_FIND(NAME, KEY_TYPE, DATA_TYPE) \
+  FLAT_HASH_MAP_ERASE_SLOT(NAME) \
+  FLAT_HASH_MAP_REMOVE(NAME, KEY_TYPE, DATA_TYPE) \
+  FLAT_HASH_MAP_SET(NAME, KEY_TYPE, DATA_TYPE) \
+  FLAT_HASH_MAP_CHANGE_KEY(NAME, KEY_TYPE, DATA_TYPE) \
+  FLAT_HASH_MAP_DELETE_MATCHING(NAME) \
+  FLAT_HASH_MAP_COUNT(NAME) \
+  FLAT_HASH_MAP_CAPACITY(NAME)
+
+#endif
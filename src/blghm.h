@@ -0,0 +1,360 @@
+#ifndef _BLAKE_GHM_H_
+#define _BLAKE_GHM_H_
+#include "bllist.h"
+#include <stdbool.h>
+
+/**
+ * This hash map is a growable variant of the fixed bucket HASH_MAP in blhm.h. Buckets
+ * are still dynamic arrays scanned linearly, but the number of buckets is no longer fixed
+ * at compile time. Once the map holds more than GROWABLE_HASH_MAP_LOAD_FACTOR elements
+ * per bucket a bucket array twice the size is allocated and the map starts to rehash.
+ *
+ * Rehashing is incremental. Rather than moving every element in a single call, each _set,
+ * _find, _find_ptr and _remove moves the contents of GROWABLE_HASH_MAP_REHASH_STEP buckets
+ * from the old array to the new one. While a rehash is in progress lookups check both
+ * arrays and new elements are always placed in the new array, so no individual operation
+ * pays for a full rehash and insert latency stays flat as the map grows.
+ *
+ * Bucket arrays are allocated zeroed, which is the lazily initialized state of a dynamic
+ * array, so a bucket only allocates its backing array on the first push and doubling the
+ * bucket count does not allocate BLOCK_SIZE entries for every new bucket up front.
+ *
+ * The number of buckets is always a power of two, so a bucket is selected by masking the
+ * hash rather than through a modulo.
+ *
+ * Each entry caches the result of HASH_FN for its key. Lookups compare the cached hash
+ * before calling CMP_FN, so expensive key comparisons (e.g, long strings) are only made
+ * on a probable match, and migrating an entry during a rehash never calls HASH_FN again.
+ */
+
+/// Maximum average number of elements per bucket before the bucket count is doubled.
+#ifndef GROWABLE_HASH_MAP_LOAD_FACTOR
+#define GROWABLE_HASH_MAP_LOAD_FACTOR 2
+#endif
+
+/// Number of old buckets migrated by each operation while a rehash is in progress.
+#ifndef GROWABLE_HASH_MAP_REHASH_STEP
+#define GROWABLE_HASH_MAP_REHASH_STEP 4
+#endif
+
+/**
+ * The map holds up to two bucket arrays. tables[0] is the current array, and tables[1]
+ * is only non-NULL while a rehash is in progress. Buckets in tables[0] below rehash_idx
+ * have already been migrated and are empty.
+ */
+#define GROWABLE_HASH_MAP_TYPE(NAME, KEY_TYPE, DATA_TYPE, BLOCK_SIZE) \
+  typedef struct NAME##_entry { \
+    KEY_TYPE key; \
+    DATA_TYPE data; \
+    /* The cached result of HASH_FN(key) */ \
+    size_t hash; \
+  } NAME##_entry_t; \
+  DYNAMIC_ARRAY(NAME##_bucket, struct NAME##_entry, BLOCK_SIZE); \
+  typedef struct NAME { \
+    struct NAME##_bucket* tables[2]; \
+    size_t sizes[2]; \
+    /* The next bucket of tables[0] to migrate into tables[1] */ \
+    size_t rehash_idx; \
+    /* The total number of elements across both tables */ \
+    size_t count; \
+  } NAME##_t;
+
+/**
+ * _init puts a map structure into a state where it is ready to include elements.
+ * The initial bucket count is rounded up to a power of two.
+ * This function must be called before the hashmap is used.
+ */
+#define GROWABLE_HASH_MAP_INIT(NAME, INITIAL_BUCKETS) \
+  static inline void NAME##_init(struct NAME* map) { \
+    memset(map, 0, sizeof(struct NAME)); \
+    size_t size = 1; \
+    while (size < (INITIAL_BUCKETS)) { \
+      size *= 2; \
+    } \
+    map->sizes[0] = size; \
+    map->tables[0] = calloc(size, sizeof(struct NAME##_bucket)); \
+  }
+
+/**
+ * _free free's any memory associated with the hash map.
+ * NOTE: This does not free underlying memory in cases
+ * where DATA_TYPE is a pointer. That is left to the user
+ */
+#define GROWABLE_HASH_MAP_FREE(NAME) \
+  static inline void NAME##_free(struct NAME* map) { \
+    for (size_t t = 0; t < 2; t++) { \
+      for (size_t i = 0; i < map->sizes[t]; i++) { \
+        NAME##_bucket_free(&map->tables[t][i]); \
+      } \
+      free(map->tables[t]); \
+    } \
+    memset(map, 0, sizeof(struct NAME)); \
+  }
+
+/**
+ * INTERNAL CALL: Returns the hash of a key. This is the only place HASH_FN is called.
+ */
+#define GROWABLE_HASH_MAP_KEY_HASH(NAME, KEY_TYPE, HASH_FN) \
+  static inline size_t NAME##_key_hash(KEY_TYPE key) { \
+    return HASH_FN(key); \
+  }
+
+/**
+ * INTERNAL CALL: Returns the bucket in a given table that a hash belongs to.
+ */
+#define GROWABLE_HASH_MAP_GET_BUCKET(NAME) \
+  static inline struct NAME##_bucket* NAME##_get_bucket(struct NAME* map, size_t table, size_t hash) { \
+    return &map->tables[table][hash & (map->sizes[table] - 1)]; \
+  }
+
+/**
+ * INTERNAL CALL: Migrates up to GROWABLE_HASH_MAP_REHASH_STEP non-empty buckets from the
+ * old table into the new one. Empty buckets are skipped, but at most ten times the step
+ * are visited in one call so that sparse tables do not cause a long pause.
+ * When the final bucket has been migrated the old table is released.
+ */
+#define GROWABLE_HASH_MAP_REHASH_STEP_FN(NAME) \
+  static inline void NAME##_rehash_step(struct NAME* map) { \
+    if (!map->tables[1]) { \
+      return; \
+    } \
+    size_t moved = 0; \
+    size_t visited = 0; \
+    while (map->rehash_idx < map->sizes[0] && moved < GROWABLE_HASH_MAP_REHASH_STEP && visited < GROWABLE_HASH_MAP_REHASH_STEP * 10) { \
+      struct NAME##_bucket* bucket = &map->tables[0][map->rehash_idx]; \
+      if (bucket->data) { \
+        for (size_t i = 0; i < bucket->current; i++) { \
+          NAME##_bucket_push(NAME##_get_bucket(map, 1, bucket->data[i].hash), bucket->data[i]); \
+        } \
+        NAME##_bucket_free(bucket); \
+        moved++; \
+      } \
+      visited++; \
+      map->rehash_idx++; \
+    } \
+    if (map->rehash_idx == map->sizes[0]) { \
+      free(map->tables[0]); \
+      map->tables[0] = map->tables[1]; \
+      map->sizes[0] = map->sizes[1]; \
+      map->tables[1] = NULL; \
+      map->sizes[1] = 0; \
+      map->rehash_idx = 0; \
+    } \
+  }
+
+/**
+ * INTERNAL CALL: Starts a rehash into a table twice the size if the map has passed
+ * its load factor and no rehash is already in progress.
+ */
+#define GROWABLE_HASH_MAP_MAYBE_GROW(NAME) \
+  static inline void NAME##_maybe_grow(struct NAME* map) { \
+    if (map->tables[1] || map->count <= map->sizes[0] * GROWABLE_HASH_MAP_LOAD_FACTOR) { \
+      return; \
+    } \
+    map->sizes[1] = map->sizes[0] * 2; \
+    map->tables[1] = calloc(map->sizes[1], sizeof(struct NAME##_bucket)); \
+    map->rehash_idx = 0; \
+  }
+
+/**
+ * INTERNAL CALL: Returns the entry with a given key and hash, or NULL if there is none.
+ * CMP_FN is only called on entries whose cached hash matches.
+ * This does not advance a rehash, so it can be used by the other methods after they
+ * have taken their step.
+ */
+#define GROWABLE_HASH_MAP_FIND_ENTRY(NAME, KEY_TYPE, CMP_FN) \
+  static inline struct NAME##_entry* NAME##_find_entry(struct NAME* map, KEY_TYPE key, size_t hash, struct NAME##_bucket** bucket_out) { \
+    for (size_t t = 0; t < 2 && map->tables[t]; t++) { \
+      struct NAME##_bucket* bucket = NAME##_get_bucket(map, t, hash); \
+      for (size_t i = 0; i < bucket->current; i++) { \
+        if (bucket->data[i].hash == hash && !CMP_FN(key, bucket->data[i].key)) { \
+          if (bucket_out) { \
+            *bucket_out = bucket; \
+          } \
+          return &bucket->data[i]; \
+        } \
+      } \
+    } \
+    return NULL; \
+  }
+
+/**
+ * _find_ptr returns a pointer to any matching element inside the map or NULL otherwise.
+ * If find_ptr finds an element, then updating the element by dereferencing will change
+ * the underlying value in the map.
+ *
+ * WARNING: find_ptr is not stable between any calls on the map, including other finds,
+ * since each call may migrate buckets as part of an incremental rehash.
+ */
+#define GROWABLE_HASH_MAP_FIND_PTR(NAME, KEY_TYPE, DATA_TYPE) \
+  static inline DATA_TYPE* NAME##_find_ptr(struct NAME* map, KEY_TYPE key) { \
+    NAME##_rehash_step(map); \
+    struct NAME##_entry* entry = NAME##_find_entry(map, key, NAME##_key_hash(key), NULL); \
+    return entry ? &entry->data : NULL; \
+  }
+
+/**
+ * _find returns true or false if an element with a given key exists inside the map.
+ * The data argument will be ignored if set to NULL or the element does not exist
+ * within the map, otherwise the pointed value will be set to the value with
+ * the corresponding key (*data = *NAME_find_ptr(map, key)).
+ */
+#define GROWABLE_HASH_MAP_FIND(NAME, KEY_TYPE, DATA_TYPE) \
+  static inline bool NAME##_find(struct NAME* map, KEY_TYPE key, DATA_TYPE* data) { \
+    DATA_TYPE* ptr = NAME##_find_ptr(map, key); \
+    if (ptr) { \
+      if (data) { \
+        *data = *ptr; \
+      } \
+      return true; \
+    } else { \
+      return false; \
+    } \
+  }
+
+/**
+ * _remove function scans the buckets that the key may be in for an element with
+ * that key and removes the key-value pair from the bucket array.
+ */
+#define GROWABLE_HASH_MAP_REMOVE(NAME, KEY_TYPE) \
+  static inline void NAME##_remove(struct NAME* map, KEY_TYPE key) { \
+    NAME##_rehash_step(map); \
+    struct NAME##_bucket* bucket; \
+    struct NAME##_entry* entry = NAME##_find_entry(map, key, NAME##_key_hash(key), &bucket); \
+    if (entry) { \
+      NAME##_bucket_swap_remove(bucket, (size_t) (entry - bucket->data)); \
+      map->count -= 1; \
+    } \
+  }
+
+/**
+ * _set places the supplied key-value pair into the hash map.
+ *
+ * If this key is in the map then _set replaces the value associated with
+ * that key with the supplied value.
+ *
+ * If the key does not already exist in the map then _set will insert this key-value
+ * pair into the appropriate bucket of the newest table, and begin a rehash if the
+ * map has passed its load factor.
+ */
+#define GROWABLE_HASH_MAP_SET(NAME, KEY_TYPE, DATA_TYPE) \
+  static inline void NAME##_set(struct NAME* map, KEY_TYPE key, DATA_TYPE val) { \
+    NAME##_rehash_step(map); \
+    size_t hash = NAME##_key_hash(key); \
+    struct NAME##_entry* entry = NAME##_find_entry(map, key, hash, NULL); \
+    if (entry) { \
+      entry->data = val; \
+      return; \
+    } \
+    struct NAME##_entry k = { key, val, hash }; \
+    NAME##_bucket_push(NAME##_get_bucket(map, map->tables[1] ? 1 : 0, hash), k); \
+    map->count += 1; \
+    NAME##_maybe_grow(map); \
+  }
+
+/**
+ * _change_key replaces the key of a key-value pair with a new one, placing
+ * it into the appropriate bucket.
+ *
+ * If there is no value with a given key in the map then this call will do nothing.
+ */
+#define GROWABLE_HASH_MAP_CHANGE_KEY(NAME, KEY_TYPE, DATA_TYPE) \
+  static inline void NAME##_change_key(struct NAME* map, KEY_TYPE current_key, KEY_TYPE new_key) { \
+    NAME##_rehash_step(map); \
+    struct NAME##_bucket* bucket; \
+    struct NAME##_entry* entry = NAME##_find_entry(map, current_key, NAME##_key_hash(current_key), &bucket); \
+    if (entry) { \
+      DATA_TYPE val = entry->data; \
+      NAME##_bucket_swap_remove(bucket, (size_t) (entry - bucket->data)); \
+      map->count -= 1; \
+      NAME##_set(map, new_key, val); \
+    } \
+  }
+
+/**
+ * This macro creates a method which will delete any elements in the map which match a predicate.
+ *
+ * The delete callback is called once for every single element in the hashmap. If the callback
+ * returns true for a given element then that element will be removed from the map.
+ *
+ * The post callback will be called after a method has been removed from the map, so that a cleanup
+ * function may safely be called.
+ */
+#define GROWABLE_HASH_MAP_DELETE_MATCHING(NAME) \
+  typedef bool (* NAME##_delete_callback_ptr_t)(struct NAME##_entry* v); \
+  typedef void (* NAME##_post_delete_callback_ptr_t)(struct NAME##_entry* v); \
+  static inline void NAME##_delete_matching(struct NAME* l, NAME##_delete_callback_ptr_t matches, NAME##_post_delete_callback_ptr_t post) { \
+    for (size_t t = 0; t < 2; t++) { \
+      for (size_t i = 0; i < l->sizes[t]; i++) { \
+        struct NAME##_bucket* bucket = &l->tables[t][i]; \
+        size_t before = bucket->current; \
+        if (before) { \
+          NAME##_bucket_delete_matching(bucket, matches, post); \
+          l->count -= before - bucket->current; \
+        } \
+      } \
+    } \
+  }
+
+/**
+ * _count returns the total number of elements in the map.
+ */
+#define GROWABLE_HASH_MAP_COUNT(NAME) \
+  static inline size_t NAME##_count(struct NAME* l) { \
+    return l->count; \
+  }
+
+/**
+ * _num_buckets returns the number of buckets in the newest table. While a rehash is
+ * in progress this is the size the map is growing into.
+ */
+#define GROWABLE_HASH_MAP_NUM_BUCKETS(NAME) \
+  static inline size_t NAME##_num_buckets(struct NAME* l) { \
+    return l->tables[1] ? l->sizes[1] : l->sizes[0]; \
+  }
+
+/**
+ * _memory_usage returns the number of bytes held by the map: the map structure, both
+ * bucket arrays and the heap allocated storage of every bucket.
+ */
+#define GROWABLE_HASH_MAP_MEMORY_USAGE(NAME) \
+  static inline size_t NAME##_memory_usage(struct NAME* l) { \
+    size_t bytes = sizeof(struct NAME); \
+    for (size_t t = 0; t < 2; t++) { \
+      bytes += l->sizes[t] * sizeof(struct NAME##_bucket); \
+      for (size_t i = 0; i < l->sizes[t]; i++) { \
+        bytes += NAME##_bucket_memory_usage(&l->tables[t][i]); \
+      } \
+    } \
+    return bytes; \
+  }
+
+/**
+ * _is_rehashing returns true while elements are being migrated into a larger table.
+ */
+#define GROWABLE_HASH_MAP_IS_REHASHING(NAME) \
+  static inline bool NAME##_is_rehashing(struct NAME* l) { \
+    return l->tables[1] != NULL; \
+  }
+
+#define GROWABLE_HASH_MAP(NAME, KEY_TYPE, DATA_TYPE, HASH_FN, CMP_FN, INITIAL_BUCKETS, BLOCK_SIZE) \
+  GROWABLE_HASH_MAP_TYPE(NAME, KEY_TYPE, DATA_TYPE, BLOCK_SIZE); \
+  GROWABLE_HASH_MAP_INIT(NAME, INITIAL_BUCKETS) \
+  GROWABLE_HASH_MAP_FREE(NAME) \
+  GROWABLE_HASH_MAP_KEY_HASH(NAME, KEY_TYPE, HASH_FN) \
+  GROWABLE_HASH_MAP_GET_BUCKET(NAME) \
+  GROWABLE_HASH_MAP_REHASH_STEP_FN(NAME) \
+  GROWABLE_HASH_MAP_MAYBE_GROW(NAME) \
+  GROWABLE_HASH_MAP_FIND_ENTRY(NAME, KEY_TYPE, CMP_FN) \
+  GROWABLE_HASH_MAP_FIND_PTR(NAME, KEY_TYPE, DATA_TYPE) \
+  GROWABLE_HASH_MAP_FIND(NAME, KEY_TYPE, DATA_TYPE) \
+  GROWABLE_HASH_MAP_REMOVE(NAME, KEY_TYPE) \
+  GROWABLE_HASH_MAP_SET(NAME, KEY_TYPE, DATA_TYPE) \
+  GROWABLE_HASH_MAP_CHANGE_KEY(NAME, KEY_TYPE, DATA_TYPE) \
+  GROWABLE_HASH_MAP_DELETE_MATCHING(NAME) \
+  GROWABLE_HASH_MAP_COUNT(NAME) \
+  GROWABLE_HASH_MAP_NUM_BUCKETS(NAME) \
+  GROWABLE_HASH_MAP_MEMORY_USAGE(NAME) \
+  GROWABLE_HASH_MAP_IS_REHASHING(NAME)
+
+#endif
@@ -0,0 +1,317 @@
+#ifndef _BLAKE_HASH_H_
+#define _BLAKE_HASH_H_
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * Hash functions for use as the HASH_FN of the maps in this collection. Every map asks the
+ * user for a hash, and the simplest choice (the key itself for integers) clusters badly when
+ * keys follow a pattern, such as multiples of the bucket count. These are fast and well
+ * distributed, so they can be passed as HASH_FN directly.
+ *
+ * bl_hash_u64 and bl_hash_u32 mix integer keys, bl_hash_ptr mixes the address of a pointer
+ * key, and bl_hash_string hashes a NUL terminated string by its contents.
+ *
+ * bl_hash_bytes(data, len, seed) hashes an arbitrary byte range. Keys of up to
+ * BL_HASH_LONG_THRESHOLD bytes are hashed in the style of wyhash, folding 16 bytes at a time
+ * into the state with a 64x64 -> 128-bit multiply. Longer keys are hashed in the style of
+ * XXH3, accumulating 64-byte stripes into eight independent lanes, which uses AVX2 or SSE2
+ * where available. The vector and scalar paths compute exactly the same value, so a hash
+ * does not depend on the instruction set a program was compiled for (it does depend on byte
+ * order, since input is read in native order).
+ *
+ * None of these are cryptographic hashes, and should not be used where an attacker chooses
+ * the keys and could benefit from forcing collisions.
+ */
+
+/// Keys longer than this many bytes are hashed by the striped long key path.
+#define BL_HASH_LONG_THRESHOLD 256
+
+/// Bytes consumed from the input by each step of the long key path.
+#define BL_HASH_STRIPE 64
+
+/// Stripes accumulated between each scramble of the long key lanes.
+#define BL_HASH_STRIPES_PER_BLOCK 16
+
+/// Odd constants with well mixed bits, shared by every function in this header.
+static uint64_t const bl_hash_secret[8] = {
+  0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull,
+  0xa0761d6478bd642full, 0xe7037ed1a0b428dbull, 0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull
+};
+
+/// The 32-bit multiplier used to scramble the long key lanes.
+#define BL_HASH_SCRAMBLE_PRIME 0x9E3779B1u
+
+/**
+ * INTERNAL CALL: Replaces a and b with the low and high halves of their 128-bit product.
+ */
+static inline void bl_hash_mul(uint64_t* a, uint64_t* b) {
+#ifdef __SIZEOF_INT128__
+  unsigned __int128 r = (unsigned __int128) *a * *b;
+  *a = (uint64_t) r;
+  *b = (uint64_t) (r >> 64);
+#else
+  uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t) *a, lb = (uint32_t) *b;
+  uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  uint64_t t = rl + (rm0 << 32);
+  uint64_t carry = t < rl;
+  uint64_t lo = t + (rm1 << 32);
+  carry += lo < t;
+  *a = lo;
+  *b = rh + (rm0 >> 32) + (rm1 >> 32) + carry;
+#endif
+}
+
+/**
+ * INTERNAL CALL: The 128-bit product of a and b, folded to 64 bits by xoring its halves.
+ */
+static inline uint64_t bl_hash_mum(uint64_t a, uint64_t b) {
+  bl_hash_mul(&a, &b);
+  return a ^ b;
+}
+
+/**
+ * INTERNAL CALL: Unaligned native order reads.
+ */
+static inline uint64_t bl_hash_read64(uint8_t const* p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint64_t bl_hash_read32(uint8_t const* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+/**
+ * INTERNAL CALL: Hashes a key of any length by consuming it 16 bytes at a time, using three
+ * independent states while more than 48 bytes remain. Keys of 16 bytes or less are read with
+ * (possibly overlapping) loads of the first and last bytes, so there is no per byte loop.
+ */
+static inline uint64_t bl_hash_short(uint8_t const* p, size_t len, uint64_t seed) {
+  uint64_t a, b;
+  seed ^= bl_hash_mum(seed ^ bl_hash_secret[0], bl_hash_secret[1]);
+  if (len <= 16) {
+    if (len >= 4) {
+      size_t mid = (len >> 3) << 2;
+      a = (bl_hash_read32(p) << 32) | bl_hash_read32(p + mid);
+      b = (bl_hash_read32(p + len - 4) << 32) | bl_hash_read32(p + len - 4 - mid);
+    } else if (len > 0) {
+      a = ((uint64_t) p[0] << 16) | ((uint64_t) p[len >> 1] << 8) | p[len - 1];
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    size_t i = len;
+    if (i > 48) {
+      uint64_t s1 = seed, s2 = seed;
+      do {
+        seed = bl_hash_mum(bl_hash_read64(p) ^ bl_hash_secret[1], bl_hash_read64(p + 8) ^ seed);
+        s1 = bl_hash_mum(bl_hash_read64(p + 16) ^ bl_hash_secret[2], bl_hash_read64(p + 24) ^ s1);
+        s2 = bl_hash_mum(bl_hash_read64(p + 32) ^ bl_hash_secret[3], bl_hash_read64(p + 40) ^ s2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= s1 ^ s2;
+    }
+    while (i > 16) {
+      seed = bl_hash_mum(bl_hash_read64(p) ^ bl_hash_secret[1], bl_hash_read64(p + 8) ^ seed);
+      p += 16;
+      i -= 16;
+    }
+    a = bl_hash_read64(p + i - 16);
+    b = bl_hash_read64(p + i - 8);
+  }
+  a ^= bl_hash_secret[1];
+  b ^= seed;
+  bl_hash_mul(&a, &b);
+  return bl_hash_mum(a ^ bl_hash_secret[0] ^ len, b ^ bl_hash_secret[1]);
+}
+
+/**
+ * INTERNAL CALL: Accumulates one 64-byte stripe into the eight lanes. Each lane adds the
+ * product of the low and high halves of its input word xored with the secret, and its
+ * neighbouring lane adds the input word itself, so no input bits are lost to the multiply.
+ */
+static inline void bl_hash_accumulate_scalar(uint64_t* acc, uint8_t const* p) {
+  for (size_t i = 0; i < 8; i++) {
+    uint64_t data = bl_hash_read64(p + 8 * i);
+    uint64_t key = data ^ bl_hash_secret[i];
+    acc[i ^ 1] += data;
+    acc[i] += (uint64_t) (uint32_t) key * (key >> 32);
+  }
+}
+
+/**
+ * INTERNAL CALL: Mixes the high bits of each lane back into its low bits. This runs once
+ * every BL_HASH_STRIPES_PER_BLOCK stripes so that bits carried out of the top of a lane are
+ * not simply lost.
+ */
+static inline void bl_hash_scramble_scalar(uint64_t* acc) {
+  for (size_t i = 0; i < 8; i++) {
+    uint64_t a = acc[i];
+    a ^= a >> 47;
+    a ^= bl_hash_secret[i];
+    acc[i] = a * BL_HASH_SCRAMBLE_PRIME;
+  }
+}
+
+#if defined(__AVX2__)
+static inline void bl_hash_accumulate(uint64_t* acc, uint8_t const* p) {
+  for (size_t i = 0; i < 8; i += 4) {
+    __m256i a = _mm256_loadu_si256((__m256i const*) (acc + i));
+    __m256i data = _mm256_loadu_si256((__m256i const*) (p + 8 * i));
+    __m256i key = _mm256_xor_si256(data, _mm256_loadu_si256((__m256i const*) (bl_hash_secret + i)));
+    __m256i product = _mm256_mul_epu32(key, _mm256_srli_epi64(key, 32));
+    __m256i swapped = _mm256_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+    a = _mm256_add_epi64(a, _mm256_add_epi64(product, swapped));
+    _mm256_storeu_si256((__m256i*) (acc + i), a);
+  }
+}
+
+static inline void bl_hash_scramble(uint64_t* acc) {
+  __m256i prime = _mm256_set1_epi32((int) BL_HASH_SCRAMBLE_PRIME);
+  for (size_t i = 0; i < 8; i += 4) {
+    __m256i a = _mm256_loadu_si256((__m256i const*) (acc + i));
+    a = _mm256_xor_si256(a, _mm256_srli_epi64(a, 47));
+    a = _mm256_xor_si256(a, _mm256_loadu_si256((__m256i const*) (bl_hash_secret + i)));
+    __m256i lo = _mm256_mul_epu32(a, prime);
+    __m256i hi = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), prime);
+    _mm256_storeu_si256((__m256i*) (acc + i), _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32)));
+  }
+}
+#elif defined(__SSE2__)
+static inline void bl_hash_accumulate(uint64_t* acc, uint8_t const* p) {
+  for (size_t i = 0; i < 8; i += 2) {
+    __m128i a = _mm_loadu_si128((__m128i const*) (acc + i));
+    __m128i data = _mm_loadu_si128((__m128i const*) (p + 8 * i));
+    __m128i key = _mm_xor_si128(data, _mm_loadu_si128((__m128i const*) (bl_hash_secret + i)));
+    __m128i product = _mm_mul_epu32(key, _mm_srli_epi64(key, 32));
+    __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+    a = _mm_add_epi64(a, _mm_add_epi64(product, swapped));
+    _mm_storeu_si128((__m128i*) (acc + i), a);
+  }
+}
+
+static inline void bl_hash_scramble(uint64_t* acc) {
+  __m128i prime = _mm_set1_epi32((int) BL_HASH_SCRAMBLE_PRIME);
+  for (size_t i = 0; i < 8; i += 2) {
+    __m128i a = _mm_loadu_si128((__m128i const*) (acc + i));
+    a = _mm_xor_si128(a, _mm_srli_epi64(a, 47));
+    a = _mm_xor_si128(a, _mm_loadu_si128((__m128i const*) (bl_hash_secret + i)));
+    __m128i lo = _mm_mul_epu32(a, prime);
+    __m128i hi = _mm_mul_epu32(_mm_srli_epi64(a, 32), prime);
+    _mm_storeu_si128((__m128i*) (acc + i), _mm_add_epi64(lo, _mm_slli_epi64(hi, 32)));
+  }
+}
+#else
+static inline void bl_hash_accumulate(uint64_t* acc, uint8_t const* p) {
+  bl_hash_accumulate_scalar(acc, p);
+}
+
+static inline void bl_hash_scramble(uint64_t* acc) {
+  bl_hash_scramble_scalar(acc);
+}
+#endif
+
+/**
+ * INTERNAL CALL: Hashes a key longer than BL_HASH_LONG_THRESHOLD bytes. Whole stripes are
+ * accumulated into the lanes, the lanes are folded together pairwise, and the remaining
+ * len % BL_HASH_STRIPE bytes are hashed by bl_hash_short seeded with the result.
+ */
+#define BL_HASH_LONG(NAME, ACCUMULATE, SCRAMBLE) \
+  static inline uint64_t NAME(uint8_t const* p, size_t len, uint64_t seed) { \
+    uint64_t acc[8]; \
+    for (size_t i = 0; i < 8; i++) { \
+      acc[i] = bl_hash_secret[i] + seed; \
+    } \
+    size_t stripes = len / BL_HASH_STRIPE; \
+    for (size_t s = 0; s < stripes; s++) { \
+      ACCUMULATE(acc, p + s * BL_HASH_STRIPE); \
+      if (s % BL_HASH_STRIPES_PER_BLOCK == BL_HASH_STRIPES_PER_BLOCK - 1) { \
+        SCRAMBLE(acc); \
+      } \
+    } \
+    uint64_t h = seed ^ ((uint64_t) len * bl_hash_secret[4]); \
+    for (size_t i = 0; i < 8; i += 2) { \
+      h = bl_hash_mum(acc[i] ^ h, acc[i + 1] ^ bl_hash_secret[i + 1]); \
+    } \
+    return bl_hash_short(p + stripes * BL_HASH_STRIPE, len % BL_HASH_STRIPE, h); \
+  }
+
+BL_HASH_LONG(bl_hash_long, bl_hash_accumulate, bl_hash_scramble)
+BL_HASH_LONG(bl_hash_long_scalar, bl_hash_accumulate_scalar, bl_hash_scramble_scalar)
+
+/**
+ * Hashes len bytes starting at data. Different seeds give unrelated hashes of the same bytes.
+ */
+static inline uint64_t bl_hash_bytes(void const* data, size_t len, uint64_t seed) {
+  uint8_t const* p = (uint8_t const*) data;
+  if (len > BL_HASH_LONG_THRESHOLD) {
+    return bl_hash_long(p, len, seed);
+  }
+  return bl_hash_short(p, len, seed);
+}
+
+/**
+ * Hashes a NUL terminated string by its contents, for maps keyed by char const*.
+ */
+static inline size_t bl_hash_string(char const* s) {
+  return (size_t) bl_hash_bytes(s, strlen(s), 0);
+}
+
+/**
+ * A 64-bit finalizer (from MurmurHash3), so that every bit of the result depends on every
+ * bit of the input. This is a bijection, so distinct inputs never collide.
+ */
+static inline uint64_t bl_hash_mix64(uint64_t k) {
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdull;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ull;
+  k ^= k >> 33;
+  return k;
+}
+
+/**
+ * Mixes an integer key with bl_hash_mix64.
+ */
+static inline size_t bl_hash_u64(uint64_t k) {
+  return (size_t) bl_hash_mix64(k);
+}
+
+static inline size_t bl_hash_u32(uint32_t k) {
+  return bl_hash_u64(k);
+}
+
+/**
+ * Mixes the address of a pointer key. Two pointers are equal keys only if they point to the
+ * same object, so this must not be used where keys are compared by their contents.
+ */
+static inline size_t bl_hash_ptr(void const* p) {
+  return bl_hash_u64((uint64_t) (uintptr_t) p);
+}
+
+/**
+ * A single multiply and shift which spreads the high bits of a hash into its low bits, for
+ * callers that select a bucket by masking off the low bits. This is much cheaper than
+ * bl_hash_u64 but is not a full mix; it only needs to undo hashes that leave their low bits
+ * constant, such as the identity on keys that are all multiples of a power of two. The
+ * flat and robin hood maps apply it to every HASH_FN, as does HASH_MAP_MASK_BUCKETS.
+ */
+static inline uint64_t bl_hash_fold(uint64_t h) {
+  h *= 0x9E3779B97F4A7C15ull;
+  return h ^ (h >> 32);
+}
+
+#endif
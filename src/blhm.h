@@ -3,6 +3,10 @@
 #include "bllist.h"
 #include <stdbool.h>
 
+#ifdef HASH_MAP_MASK_BUCKETS
+#include "blhash.h"
+#endif
+
 /**
  * This hash map implementation is backed by dynamically allocated arrays, and uses a
  * fixed number of buckets. This is driven by the observation in many of our use cases
@@ -13,8 +17,8 @@
  * a 'bucket' from a fixed number of available buckets, and then does a linear scan through that
  * bucket to find elements, or appends to the end of that list with new elements.
  *
- * POTENTIAL TODO: It would not be a stretch to include a version of insert that sorts lists and
- * enables binary search. We may add this later.
+ * HASH_MAP_SORTED (below) is a version of this map which keeps each bucket sorted by key so
+ * that lookups can binary search the bucket rather than scanning it.
  *
  * This implementation uses macros to construct a typed hash-map implementation for a
  * given key-value pair. It uses a user-supplied hashing function, key type and value type to create
@@ -41,11 +45,14 @@
 /**
  * _init puts a map structure into a state where it is ready to include elements.
  * This function must be called before the hashmap is used.
+ *
+ * Buckets are initialized lazily, so _init does not allocate. Each bucket allocates
+ * BLOCK_SIZE entries the first time an element is placed into it.
  */
 #define HASH_MAP_INIT(NAME, BUCKETS) \
   static inline void NAME##_init(struct NAME* map) { \
     for (size_t i = 0; i < BUCKETS; i++) { \
-      NAME##_bucket_init(&map->buckets[i]); \
+      NAME##_bucket_init_lazy(&map->buckets[i]); \
     } \
   }
 
@@ -64,10 +71,31 @@
 /**
  * The method this macro generates returns the bucket that a given key-value
  * pair will be placed into when inserted into the hash map.
+ *
+ * By default the bucket is the hash modulo BUCKETS, which distributes keys only as well as
+ * HASH_FN does: with an identity hash, keys that are all multiples of BUCKETS share a single
+ * bucket. If HASH_MAP_MASK_BUCKETS is defined before this header is included, the hash is
+ * first mixed with bl_hash_fold (see blhash.h) and the bucket is selected by masking off its
+ * low bits, so patterned keys still spread across buckets at the cost of one multiply.
+ * BUCKETS must then be a power of two, which is checked at compile time. Since BUCKETS is a
+ * constant, neither form compiles to a division.
+ *
+ * HASH_MAP_BUCKET_INDEX is the selection itself, for variants that cache the hash.
  */
+#ifdef HASH_MAP_MASK_BUCKETS
+#define HASH_MAP_BUCKET_INDEX(HASH, BUCKETS) ((size_t) (bl_hash_fold(HASH) & ((BUCKETS) - 1)))
+#define HASH_MAP_CHECK_BUCKETS(BUCKETS) \
+  _Static_assert((BUCKETS) > 0 && ((BUCKETS) & ((BUCKETS) - 1)) == 0, \
+    "HASH_MAP_MASK_BUCKETS requires BUCKETS to be a power of two");
+#else
+#define HASH_MAP_BUCKET_INDEX(HASH, BUCKETS) ((HASH) % (BUCKETS))
+#define HASH_MAP_CHECK_BUCKETS(BUCKETS)
+#endif
+
 #define HASH_MAP_GET_BUCKET(NAME, KEY_TYPE, BUCKETS, HASH_FN) \
   static inline size_t NAME##_get_bucket(KEY_TYPE key) { \
-    return HASH_FN(key) % BUCKETS; \
+    HASH_MAP_CHECK_BUCKETS(BUCKETS) \
+    return HASH_MAP_BUCKET_INDEX(HASH_FN(key), BUCKETS); \
   }
 
 /**
@@ -115,6 +143,9 @@
  * _remove function scans the bucket that the key will be
  * in for an element with that key and removes the key-value pair
  * from the bucket array.
+ *
+ * Buckets are unordered, so the last entry of the bucket is moved into the
+ * removed entry's place rather than shifting every later entry.
  */
 #define HASH_MAP_REMOVE(NAME, KEY_TYPE, CMP_FN) \
   static inline void NAME##_remove(struct NAME* map, KEY_TYPE key) { \
@@ -123,12 +154,46 @@
     size_t bucket_size = NAME##_bucket_size(bucket); \
     for (size_t i = 0; i < bucket_size; i++) { \
       if (!CMP_FN(key, bucket->data[i].key)) { \
-        NAME##_bucket_remove(bucket, i); \
+        NAME##_bucket_swap_remove(bucket, i); \
         return; \
       } \
     } \
   }
 
+/**
+ * _take removes the element with a given key in a single scan of its bucket. It returns
+ * true if the element existed, and if data is not NULL the removed value is copied to it.
+ */
+#define HASH_MAP_TAKE(NAME, KEY_TYPE, DATA_TYPE, CMP_FN) \
+  static inline bool NAME##_take(struct NAME* map, KEY_TYPE key, DATA_TYPE* data) { \
+    struct NAME##_bucket* bucket = &map->buckets[NAME##_get_bucket(key)]; \
+    size_t bucket_size = NAME##_bucket_size(bucket); \
+    for (size_t i = 0; i < bucket_size; i++) { \
+      if (!CMP_FN(key, bucket->data[i].key)) { \
+        struct NAME##_entry removed = NAME##_bucket_swap_remove(bucket, i); \
+        if (data) { \
+          *data = removed.data; \
+        } \
+        return true; \
+      } \
+    } \
+    return false; \
+  }
+
+/**
+ * _remove_ptr removes the element whose value is pointed to by a pointer returned from
+ * _find_ptr, without scanning or comparing keys again. The bucket is found from the key
+ * stored beside the value, and the entry's index from its address in the bucket.
+ * The pointer must have been returned by _find_ptr since the map was last modified.
+ * REMOVE_FN is the bucket removal used: swap_remove, or remove to preserve bucket order.
+ */
+#define HASH_MAP_REMOVE_PTR(NAME, DATA_TYPE, REMOVE_FN) \
+  static inline void NAME##_remove_ptr(struct NAME* map, DATA_TYPE* ptr) { \
+    struct NAME##_entry* entry = (struct NAME##_entry*) ((char*) ptr - offsetof(struct NAME##_entry, data)); \
+    struct NAME##_bucket* bucket = &map->buckets[NAME##_get_bucket(entry->key)]; \
+    NAME##_bucket_##REMOVE_FN(bucket, (size_t) (entry - bucket->data)); \
+  }
+
 /**
  * _set places the supplied key-value pair into the hash map.
  * First, _set does a find_ptr for existing keys.
@@ -152,16 +217,47 @@
 
 /**
  * _change_key replaces the key of a key-value pair with a new one, placing
- * it into the appropriate bucket.
+ * it into the appropriate bucket. If the new key is already in the map its value is
+ * replaced by the value of the current key.
  *
  * If there is no value with a given key in the map then this call will do nothing.
+ *
+ * The current key's bucket is scanned once. When both keys fall into the same bucket
+ * that scan also looks for the new key and the key is rewritten in place, otherwise the
+ * entry is swap removed and _set scans the new key's bucket.
  */
-#define HASH_MAP_CHANGE_KEY(NAME, KEY_TYPE, DATA_TYPE) \
+#define HASH_MAP_CHANGE_KEY(NAME, KEY_TYPE, DATA_TYPE, CMP_FN) \
   static inline void NAME##_change_key(struct NAME* map, KEY_TYPE current_key, KEY_TYPE new_key) { \
-    DATA_TYPE val; \
-    if (NAME##_find(map, current_key, &val)) { \
-      NAME##_remove(map, current_key); \
+    size_t bucket_idx = NAME##_get_bucket(current_key); \
+    bool same_bucket = NAME##_get_bucket(new_key) == bucket_idx; \
+    struct NAME##_bucket* bucket = &map->buckets[bucket_idx]; \
+    size_t bucket_size = NAME##_bucket_size(bucket); \
+    size_t current_idx = bucket_size; \
+    size_t new_idx = bucket_size; \
+    for (size_t i = 0; i < bucket_size; i++) { \
+      if (current_idx == bucket_size && !CMP_FN(current_key, bucket->data[i].key)) { \
+        current_idx = i; \
+        if (!same_bucket || new_idx != bucket_size) { \
+          break; \
+        } \
+      } else if (same_bucket && new_idx == bucket_size && !CMP_FN(new_key, bucket->data[i].key)) { \
+        new_idx = i; \
+        if (current_idx != bucket_size) { \
+          break; \
+        } \
+      } \
+    } \
+    if (current_idx == bucket_size) { \
+      return; \
+    } \
+    if (!same_bucket) { \
+      DATA_TYPE val = NAME##_bucket_swap_remove(bucket, current_idx).data; \
       NAME##_set(map, new_key, val); \
+    } else if (new_idx == bucket_size) { \
+      bucket->data[current_idx].key = new_key; \
+    } else { \
+      bucket->data[new_idx].data = bucket->data[current_idx].data; \
+      NAME##_bucket_swap_remove(bucket, current_idx); \
     } \
   }
 
@@ -202,6 +298,171 @@
     return BUCKETS; \
   }
 
+/**
+ * _memory_usage returns the number of bytes held by the map: the map structure
+ * itself plus the heap allocated storage of every bucket. Allocator bookkeeping
+ * overhead is not included.
+ */
+#define HASH_MAP_MEMORY_USAGE(NAME, BUCKETS) \
+  static inline size_t NAME##_memory_usage(struct NAME* l) { \
+    size_t bytes = sizeof(struct NAME); \
+    for (size_t i = 0; i < BUCKETS; i++) { \
+      bytes += NAME##_bucket_memory_usage(&l->buckets[i]); \
+    } \
+    return bytes; \
+  }
+
+/**
+ * _iter_begin returns an iterator over every entry in the map, and each call to _iter_next
+ * returns a pointer to the next entry, or NULL once every entry has been visited. Entries
+ * are visited bucket by bucket, walking each bucket's array contiguously, so a full scan
+ * inlines into the caller with no per-entry call. _for_each calls fn(entry, ctx) on every
+ * entry in the same order.
+ *
+ * The map must not be modified while an iterator is in use, other than by writing to the
+ * data of the entries returned. The key of an entry must not be changed in place.
+ *
+ * Example: HASH_MAP_FOREACH(NAME, &map, e) { total += e->data; }
+ */
+#define HASH_MAP_ITER(NAME, BUCKETS) \
+  typedef struct NAME##_iter { \
+    struct NAME* map; \
+    /* The next bucket to move on to once the current one is exhausted */ \
+    size_t bucket; \
+    struct NAME##_entry* next; \
+    struct NAME##_entry* end; \
+  } NAME##_iter_t; \
+  static inline NAME##_iter_t NAME##_iter_begin(struct NAME* map) { \
+    NAME##_iter_t it = { map, 0, NULL, NULL }; \
+    return it; \
+  } \
+  static inline struct NAME##_entry* NAME##_iter_next(NAME##_iter_t* it) { \
+    while (it->next == it->end) { \
+      if (it->bucket == BUCKETS) { \
+        return NULL; \
+      } \
+      struct NAME##_bucket* bucket = &it->map->buckets[it->bucket++]; \
+      it->next = bucket->data; \
+      it->end = bucket->data + bucket->current; \
+    } \
+    return it->next++; \
+  } \
+  typedef void (* NAME##_for_each_fn_t)(struct NAME##_entry* v, void* ctx); \
+  static inline void NAME##_for_each(struct NAME* map, NAME##_for_each_fn_t fn, void* ctx) { \
+    for (size_t i = 0; i < BUCKETS; i++) { \
+      struct NAME##_bucket* bucket = &map->buckets[i]; \
+      for (size_t j = 0; j < bucket->current; j++) { \
+        fn(&bucket->data[j], ctx); \
+      } \
+    } \
+  }
+
+/**
+ * HASH_MAP_FOREACH runs the statement that follows it once for every entry of the map MAP
+ * (a struct NAME*), with VAR declared as a struct NAME_entry* pointing at the entry.
+ * break and continue behave as in a plain for loop.
+ */
+#define HASH_MAP_FOREACH(NAME, MAP, VAR) \
+  for (NAME##_iter_t VAR##_iter = NAME##_iter_begin(MAP), *VAR##_once = &VAR##_iter; VAR##_once; VAR##_once = NULL) \
+    for (struct NAME##_entry* VAR; (VAR = NAME##_iter_next(&VAR##_iter)) != NULL;)
+
+/// Number of keys hashed and prefetched ahead of being resolved by _set_many and _find_many.
+#ifndef HASH_MAP_BATCH_SIZE
+#define HASH_MAP_BATCH_SIZE 16
+#endif
+
+/// Hint that an address will be read soon. Does nothing on compilers without __builtin_prefetch.
+#ifndef HASH_MAP_PREFETCH
+#if defined(__GNUC__) || defined(__clang__)
+#define HASH_MAP_PREFETCH(ADDR) __builtin_prefetch(ADDR)
+#else
+#define HASH_MAP_PREFETCH(ADDR)
+#endif
+#endif
+
+/**
+ * INTERNAL CALL: Computes the bucket of up to HASH_MAP_BATCH_SIZE keys and prefetches
+ * each bucket's header and then the start of its backing array, so that the cache misses
+ * of every key in the batch are in flight at the same time rather than one after another.
+ */
+#define HASH_MAP_PREFETCH_BATCH(NAME, KEY_TYPE) \
+  static inline void NAME##_prefetch_batch(struct NAME* map, KEY_TYPE const* keys, size_t n, struct NAME##_bucket** buckets) { \
+    for (size_t i = 0; i < n; i++) { \
+      buckets[i] = &map->buckets[NAME##_get_bucket(keys[i])]; \
+      HASH_MAP_PREFETCH(buckets[i]); \
+    } \
+    for (size_t i = 0; i < n; i++) { \
+      HASH_MAP_PREFETCH(buckets[i]->data); \
+    } \
+  }
+
+/**
+ * _set_many places n key-value pairs into the map, equivalent to calling
+ * _set(map, keys[i], vals[i]) for each i in order.
+ *
+ * Keys are processed in batches of HASH_MAP_BATCH_SIZE. Every key in a batch is hashed and
+ * its bucket prefetched before any of them are resolved, which overlaps the memory latency
+ * of the lookups. If a key appears more than once the last value wins, as with _set.
+ */
+#define HASH_MAP_SET_MANY(NAME, KEY_TYPE, DATA_TYPE, CMP_FN) \
+  static inline void NAME##_set_many(struct NAME* map, KEY_TYPE const* keys, DATA_TYPE const* vals, size_t n) { \
+    struct NAME##_bucket* buckets[HASH_MAP_BATCH_SIZE]; \
+    for (size_t start = 0; start < n; start += HASH_MAP_BATCH_SIZE) { \
+      size_t batch = n - start < HASH_MAP_BATCH_SIZE ? n - start : HASH_MAP_BATCH_SIZE; \
+      NAME##_prefetch_batch(map, keys + start, batch, buckets); \
+      for (size_t i = 0; i < batch; i++) { \
+        struct NAME##_bucket* bucket = buckets[i]; \
+        KEY_TYPE key = keys[start + i]; \
+        size_t bucket_size = NAME##_bucket_size(bucket); \
+        size_t j = 0; \
+        while (j < bucket_size && CMP_FN(key, bucket->data[j].key)) { \
+          j++; \
+        } \
+        if (j < bucket_size) { \
+          bucket->data[j].data = vals[start + i]; \
+        } else { \
+          struct NAME##_entry k = { key, vals[start + i] }; \
+          NAME##_bucket_push(bucket, k); \
+        } \
+      } \
+    } \
+  }
+
+/**
+ * _find_many looks up n keys, returning the number that were found.
+ * For each i, found[i] is set to whether keys[i] is in the map and, if it is, out[i]
+ * is set to its value. Either out or found may be NULL if the caller does not need them.
+ *
+ * Keys are hashed and prefetched in batches in the same way as _set_many.
+ */
+#define HASH_MAP_FIND_MANY(NAME, KEY_TYPE, DATA_TYPE, CMP_FN) \
+  static inline size_t NAME##_find_many(struct NAME* map, KEY_TYPE const* keys, DATA_TYPE* out, bool* found, size_t n) { \
+    struct NAME##_bucket* buckets[HASH_MAP_BATCH_SIZE]; \
+    size_t num_found = 0; \
+    for (size_t start = 0; start < n; start += HASH_MAP_BATCH_SIZE) { \
+      size_t batch = n - start < HASH_MAP_BATCH_SIZE ? n - start : HASH_MAP_BATCH_SIZE; \
+      NAME##_prefetch_batch(map, keys + start, batch, buckets); \
+      for (size_t i = 0; i < batch; i++) { \
+        struct NAME##_bucket* bucket = buckets[i]; \
+        KEY_TYPE key = keys[start + i]; \
+        size_t bucket_size = NAME##_bucket_size(bucket); \
+        size_t j = 0; \
+        while (j < bucket_size && CMP_FN(key, bucket->data[j].key)) { \
+          j++; \
+        } \
+        bool hit = j < bucket_size; \
+        if (hit && out) { \
+          out[start + i] = bucket->data[j].data; \
+        } \
+        if (found) { \
+          found[start + i] = hit; \
+        } \
+        num_found += hit; \
+      } \
+    } \
+    return num_found; \
+  }
+
 #define HASH_MAP(NAME, KEY_TYPE, DATA_TYPE, HASH_FN, CMP_FN, BUCKETS, BLOCK_SIZE) \
   HASH_MAP_TYPE(NAME, KEY_TYPE, DATA_TYPE, BUCKETS, BLOCK_SIZE); \
   HASH_MAP_INIT(NAME, BUCKETS) \
@@ -210,10 +471,421 @@
   HASH_MAP_FIND_PTR(NAME, KEY_TYPE, DATA_TYPE, CMP_FN) \
   HASH_MAP_FIND(NAME, KEY_TYPE, DATA_TYPE, CMP_FN) \
   HASH_MAP_REMOVE(NAME, KEY_TYPE, CMP_FN) \
+  HASH_MAP_TAKE(NAME, KEY_TYPE, DATA_TYPE, CMP_FN) \
+  HASH_MAP_REMOVE_PTR(NAME, DATA_TYPE, swap_remove) \
+  HASH_MAP_DELETE_MATCHING(NAME, DATA_TYPE, BUCKETS) \
+  HASH_MAP_SET(NAME, KEY_TYPE, DATA_TYPE) \
+  HASH_MAP_CHANGE_KEY(NAME, KEY_TYPE, DATA_TYPE, CMP_FN) \
+  HASH_MAP_NUM_BUCKETS(NAME, BUCKETS) \
+  HASH_MAP_MEMORY_USAGE(NAME, BUCKETS) \
+  HASH_MAP_COUNT(NAME, BUCKETS) \
+  HASH_MAP_ITER(NAME, BUCKETS) \
+  HASH_MAP_PREFETCH_BATCH(NAME, KEY_TYPE) \
+  HASH_MAP_SET_MANY(NAME, KEY_TYPE, DATA_TYPE, CMP_FN) \
+  HASH_MAP_FIND_MANY(NAME, KEY_TYPE, DATA_TYPE, CMP_FN)
+
+/**
+ * HASH_MAP_ALLOCATOR is a variant of HASH_MAP whose buckets allocate from a struct
+ * bl_allocator (see blalloc.h) rather than malloc, for example so that a request scoped
+ * map can be placed on an arena and released with a single arena reset.
+ * The map is initialized with _init_with(map, allocator), or with _init to use malloc.
+ * Every other method is shared with HASH_MAP.
+ */
+#define HASH_MAP_ALLOCATOR_TYPE(NAME, KEY_TYPE, DATA_TYPE, BUCKETS, BLOCK_SIZE) \
+  typedef struct NAME##_entry { \
+    KEY_TYPE key; \
+    DATA_TYPE data; \
+  } NAME##_entry_t; \
+  DYNAMIC_ARRAY_ALLOCATOR(NAME##_bucket, struct NAME##_entry, BLOCK_SIZE); \
+  typedef struct NAME { \
+    struct NAME##_bucket buckets[BUCKETS]; \
+  } NAME##_t;
+
+/**
+ * _init_with puts a map structure into a state where it is ready to include elements,
+ * allocating bucket storage from the supplied allocator. _init uses bl_malloc_allocator.
+ * As with HASH_MAP buckets are initialized lazily.
+ */
+#define HASH_MAP_ALLOCATOR_INIT(NAME, BUCKETS) \
+  static inline void NAME##_init_with(struct NAME* map, struct bl_allocator const* allocator) { \
+    for (size_t i = 0; i < BUCKETS; i++) { \
+      NAME##_bucket_init_lazy_with(&map->buckets[i], allocator); \
+    } \
+  } \
+  static inline void NAME##_init(struct NAME* map) { \
+    NAME##_init_with(map, &bl_malloc_allocator); \
+  }
+
+#define HASH_MAP_ALLOCATOR(NAME, KEY_TYPE, DATA_TYPE, HASH_FN, CMP_FN, BUCKETS, BLOCK_SIZE) \
+  HASH_MAP_ALLOCATOR_TYPE(NAME, KEY_TYPE, DATA_TYPE, BUCKETS, BLOCK_SIZE); \
+  HASH_MAP_ALLOCATOR_INIT(NAME, BUCKETS) \
+  HASH_MAP_FREE(NAME, BUCKETS) \
+  HASH_MAP_GET_BUCKET(NAME, KEY_TYPE, BUCKETS, HASH_FN) \
+  HASH_MAP_FIND_PTR(NAME, KEY_TYPE, DATA_TYPE, CMP_FN) \
+  HASH_MAP_FIND(NAME, KEY_TYPE, DATA_TYPE, CMP_FN) \
+  HASH_MAP_REMOVE(NAME, KEY_TYPE, CMP_FN) \
+  HASH_MAP_TAKE(NAME, KEY_TYPE, DATA_TYPE, CMP_FN) \
+  HASH_MAP_REMOVE_PTR(NAME, DATA_TYPE, swap_remove) \
+  HASH_MAP_DELETE_MATCHING(NAME, DATA_TYPE, BUCKETS) \
+  HASH_MAP_SET(NAME, KEY_TYPE, DATA_TYPE) \
+  HASH_MAP_CHANGE_KEY(NAME, KEY_TYPE, DATA_TYPE, CMP_FN) \
+  HASH_MAP_NUM_BUCKETS(NAME, BUCKETS) \
+  HASH_MAP_MEMORY_USAGE(NAME, BUCKETS) \
+  HASH_MAP_COUNT(NAME, BUCKETS) \
+  HASH_MAP_ITER(NAME, BUCKETS) \
+  HASH_MAP_PREFETCH_BATCH(NAME, KEY_TYPE) \
+  HASH_MAP_SET_MANY(NAME, KEY_TYPE, DATA_TYPE, CMP_FN) \
+  HASH_MAP_FIND_MANY(NAME, KEY_TYPE, DATA_TYPE, CMP_FN)
+
+/**
+ * HASH_MAP_SMALL is a variant of HASH_MAP whose buckets are SMALL_DYNAMIC_ARRAYs holding up
+ * to INLINE_N entries inside the map structure. _init does not allocate, and a bucket only
+ * allocates (at least BLOCK_SIZE entries) once it grows past INLINE_N, so maps whose buckets
+ * mostly stay small never touch the heap.
+ *
+ * The inline entries make the map structure BUCKETS * INLINE_N entries larger.
+ * WARNING: An initialized map must not be copied or moved by value, since buckets using
+ * inline storage point inside the structure.
+ *
+ * Every method other than the type is shared with HASH_MAP.
+ */
+#define HASH_MAP_SMALL_TYPE(NAME, KEY_TYPE, DATA_TYPE, BUCKETS, INLINE_N, BLOCK_SIZE) \
+  typedef struct NAME##_entry { \
+    KEY_TYPE key; \
+    DATA_TYPE data; \
+  } NAME##_entry_t; \
+  SMALL_DYNAMIC_ARRAY(NAME##_bucket, struct NAME##_entry, INLINE_N, BLOCK_SIZE); \
+  typedef struct NAME { \
+    struct NAME##_bucket buckets[BUCKETS]; \
+  } NAME##_t;
+
+#define HASH_MAP_SMALL(NAME, KEY_TYPE, DATA_TYPE, HASH_FN, CMP_FN, BUCKETS, INLINE_N, BLOCK_SIZE) \
+  HASH_MAP_SMALL_TYPE(NAME, KEY_TYPE, DATA_TYPE, BUCKETS, INLINE_N, BLOCK_SIZE); \
+  HASH_MAP_INIT(NAME, BUCKETS) \
+  HASH_MAP_FREE(NAME, BUCKETS) \
+  HASH_MAP_GET_BUCKET(NAME, KEY_TYPE, BUCKETS, HASH_FN) \
+  HASH_MAP_FIND_PTR(NAME, KEY_TYPE, DATA_TYPE, CMP_FN) \
+  HASH_MAP_FIND(NAME, KEY_TYPE, DATA_TYPE, CMP_FN) \
+  HASH_MAP_REMOVE(NAME, KEY_TYPE, CMP_FN) \
+  HASH_MAP_TAKE(NAME, KEY_TYPE, DATA_TYPE, CMP_FN) \
+  HASH_MAP_REMOVE_PTR(NAME, DATA_TYPE, swap_remove) \
   HASH_MAP_DELETE_MATCHING(NAME, DATA_TYPE, BUCKETS) \
   HASH_MAP_SET(NAME, KEY_TYPE, DATA_TYPE) \
-  HASH_MAP_CHANGE_KEY(NAME, KEY_TYPE, DATA_TYPE) \
+  HASH_MAP_CHANGE_KEY(NAME, KEY_TYPE, DATA_TYPE, CMP_FN) \
+  HASH_MAP_NUM_BUCKETS(NAME, BUCKETS) \
+  HASH_MAP_MEMORY_USAGE(NAME, BUCKETS) \
+  HASH_MAP_COUNT(NAME, BUCKETS) \
+  HASH_MAP_ITER(NAME, BUCKETS) \
+  HASH_MAP_PREFETCH_BATCH(NAME, KEY_TYPE) \
+  HASH_MAP_SET_MANY(NAME, KEY_TYPE, DATA_TYPE, CMP_FN) \
+  HASH_MAP_FIND_MANY(NAME, KEY_TYPE, DATA_TYPE, CMP_FN)
+
+/**
+ * HASH_MAP_CACHED is a variant of HASH_MAP whose entries also store the result of HASH_FN
+ * for their key. Lookups compare the cached hash before calling CMP_FN, so for keys that
+ * are expensive to compare (long strings, large structures) the full comparison is only
+ * made on a probable match. Each operation calls HASH_FN exactly once per key, and
+ * _change_key moves the entry without hashing the current key a second time.
+ *
+ * The map shares _init, _free, _find, _delete_matching, _count, _num_buckets and the
+ * iterators with HASH_MAP, and can be swapped in with a one line change.
+ */
+#define HASH_MAP_CACHED_TYPE(NAME, KEY_TYPE, DATA_TYPE, BUCKETS, BLOCK_SIZE) \
+  typedef struct NAME##_entry { \
+    KEY_TYPE key; \
+    DATA_TYPE data; \
+    /* The cached result of HASH_FN(key) */ \
+    size_t hash; \
+  } NAME##_entry_t; \
+  DYNAMIC_ARRAY(NAME##_bucket, struct NAME##_entry, BLOCK_SIZE); \
+  typedef struct NAME { \
+    struct NAME##_bucket buckets[BUCKETS]; \
+  } NAME##_t;
+
+/**
+ * INTERNAL CALL: Returns the hash of a key. This is the only place HASH_FN is called.
+ */
+#define HASH_MAP_CACHED_KEY_HASH(NAME, KEY_TYPE, HASH_FN) \
+  static inline size_t NAME##_key_hash(KEY_TYPE key) { \
+    return HASH_FN(key); \
+  }
+
+/**
+ * INTERNAL CALL: Returns the index of the entry with a given key and hash in
+ * its bucket, or the bucket size if there is no such entry.
+ */
+#define HASH_MAP_CACHED_FIND_INDEX(NAME, KEY_TYPE, CMP_FN) \
+  static inline size_t NAME##_find_index(struct NAME##_bucket* bucket, KEY_TYPE key, size_t hash) { \
+    size_t bucket_size = NAME##_bucket_size(bucket); \
+    for (size_t i = 0; i < bucket_size; i++) { \
+      if (bucket->data[i].hash == hash && !CMP_FN(key, bucket->data[i].key)) { \
+        return i; \
+      } \
+    } \
+    return bucket_size; \
+  }
+
+/**
+ * _find_ptr returns a pointer to any matching element inside the map or NULL otherwise.
+ *
+ * WARNING: find_ptr is not stable between inserts, updates, or deletions since value locations
+ * may change in the buckets or buckets may be re-allocated.
+ */
+#define HASH_MAP_CACHED_FIND_PTR(NAME, KEY_TYPE, DATA_TYPE, BUCKETS) \
+  static inline DATA_TYPE* NAME##_find_ptr(struct NAME* map, KEY_TYPE key) { \
+    size_t hash = NAME##_key_hash(key); \
+    struct NAME##_bucket* bucket = &map->buckets[HASH_MAP_BUCKET_INDEX(hash, BUCKETS)]; \
+    size_t idx = NAME##_find_index(bucket, key, hash); \
+    return idx < NAME##_bucket_size(bucket) ? &bucket->data[idx].data : NULL; \
+  }
+
+/**
+ * _remove scans the bucket that the key will be in for an element with that key
+ * and removes the key-value pair from the bucket array.
+ */
+#define HASH_MAP_CACHED_REMOVE(NAME, KEY_TYPE, BUCKETS) \
+  static inline void NAME##_remove(struct NAME* map, KEY_TYPE key) { \
+    size_t hash = NAME##_key_hash(key); \
+    struct NAME##_bucket* bucket = &map->buckets[HASH_MAP_BUCKET_INDEX(hash, BUCKETS)]; \
+    size_t idx = NAME##_find_index(bucket, key, hash); \
+    if (idx < NAME##_bucket_size(bucket)) { \
+      NAME##_bucket_swap_remove(bucket, idx); \
+    } \
+  }
+
+/**
+ * _take removes the element with a given key, returning true if it existed and copying
+ * its value to data if data is not NULL.
+ */
+#define HASH_MAP_CACHED_TAKE(NAME, KEY_TYPE, DATA_TYPE, BUCKETS) \
+  static inline bool NAME##_take(struct NAME* map, KEY_TYPE key, DATA_TYPE* data) { \
+    size_t hash = NAME##_key_hash(key); \
+    struct NAME##_bucket* bucket = &map->buckets[HASH_MAP_BUCKET_INDEX(hash, BUCKETS)]; \
+    size_t idx = NAME##_find_index(bucket, key, hash); \
+    if (idx == NAME##_bucket_size(bucket)) { \
+      return false; \
+    } \
+    struct NAME##_entry removed = NAME##_bucket_swap_remove(bucket, idx); \
+    if (data) { \
+      *data = removed.data; \
+    } \
+    return true; \
+  }
+
+/**
+ * _remove_ptr removes the element whose value is pointed to by a pointer returned from
+ * _find_ptr. The bucket is found from the entry's cached hash, so neither HASH_FN nor
+ * CMP_FN is called.
+ */
+#define HASH_MAP_CACHED_REMOVE_PTR(NAME, DATA_TYPE, BUCKETS) \
+  static inline void NAME##_remove_ptr(struct NAME* map, DATA_TYPE* ptr) { \
+    struct NAME##_entry* entry = (struct NAME##_entry*) ((char*) ptr - offsetof(struct NAME##_entry, data)); \
+    struct NAME##_bucket* bucket = &map->buckets[HASH_MAP_BUCKET_INDEX(entry->hash, BUCKETS)]; \
+    NAME##_bucket_swap_remove(bucket, (size_t) (entry - bucket->data)); \
+  }
+
+/**
+ * _set places the supplied key-value pair into the hash map, replacing the value
+ * of any existing element with the same key.
+ */
+#define HASH_MAP_CACHED_SET(NAME, KEY_TYPE, DATA_TYPE, BUCKETS) \
+  static inline void NAME##_set(struct NAME* map, KEY_TYPE key, DATA_TYPE val) { \
+    size_t hash = NAME##_key_hash(key); \
+    struct NAME##_bucket* bucket = &map->buckets[HASH_MAP_BUCKET_INDEX(hash, BUCKETS)]; \
+    size_t idx = NAME##_find_index(bucket, key, hash); \
+    if (idx < NAME##_bucket_size(bucket)) { \
+      bucket->data[idx].data = val; \
+      return; \
+    } \
+    struct NAME##_entry k = { key, val, hash }; \
+    NAME##_bucket_push(bucket, k); \
+  }
+
+/**
+ * _change_key replaces the key of a key-value pair with a new one, placing
+ * it into the appropriate bucket.
+ *
+ * If there is no value with a given key in the map then this call will do nothing.
+ */
+#define HASH_MAP_CACHED_CHANGE_KEY(NAME, KEY_TYPE, DATA_TYPE, BUCKETS) \
+  static inline void NAME##_change_key(struct NAME* map, KEY_TYPE current_key, KEY_TYPE new_key) { \
+    size_t hash = NAME##_key_hash(current_key); \
+    struct NAME##_bucket* bucket = &map->buckets[HASH_MAP_BUCKET_INDEX(hash, BUCKETS)]; \
+    size_t idx = NAME##_find_index(bucket, current_key, hash); \
+    if (idx < NAME##_bucket_size(bucket)) { \
+      DATA_TYPE val = NAME##_bucket_swap_remove(bucket, idx).data; \
+      NAME##_set(map, new_key, val); \
+    } \
+  }
+
+#define HASH_MAP_CACHED(NAME, KEY_TYPE, DATA_TYPE, HASH_FN, CMP_FN, BUCKETS, BLOCK_SIZE) \
+  HASH_MAP_CACHED_TYPE(NAME, KEY_TYPE, DATA_TYPE, BUCKETS, BLOCK_SIZE); \
+  HASH_MAP_INIT(NAME, BUCKETS) \
+  HASH_MAP_FREE(NAME, BUCKETS) \
+  HASH_MAP_GET_BUCKET(NAME, KEY_TYPE, BUCKETS, HASH_FN) \
+  HASH_MAP_CACHED_KEY_HASH(NAME, KEY_TYPE, HASH_FN) \
+  HASH_MAP_CACHED_FIND_INDEX(NAME, KEY_TYPE, CMP_FN) \
+  HASH_MAP_CACHED_FIND_PTR(NAME, KEY_TYPE, DATA_TYPE, BUCKETS) \
+  HASH_MAP_FIND(NAME, KEY_TYPE, DATA_TYPE, CMP_FN) \
+  HASH_MAP_CACHED_REMOVE(NAME, KEY_TYPE, BUCKETS) \
+  HASH_MAP_CACHED_TAKE(NAME, KEY_TYPE, DATA_TYPE, BUCKETS) \
+  HASH_MAP_CACHED_REMOVE_PTR(NAME, DATA_TYPE, BUCKETS) \
+  HASH_MAP_DELETE_MATCHING(NAME, DATA_TYPE, BUCKETS) \
+  HASH_MAP_CACHED_SET(NAME, KEY_TYPE, DATA_TYPE, BUCKETS) \
+  HASH_MAP_CACHED_CHANGE_KEY(NAME, KEY_TYPE, DATA_TYPE, BUCKETS) \
+  HASH_MAP_NUM_BUCKETS(NAME, BUCKETS) \
+  HASH_MAP_MEMORY_USAGE(NAME, BUCKETS) \
+  HASH_MAP_COUNT(NAME, BUCKETS) \
+  HASH_MAP_ITER(NAME, BUCKETS)
+
+/**
+ * HASH_MAP_SORTED is a variant of HASH_MAP which keeps every bucket sorted by key.
+ * CMP_FN must be a three-way comparison, returning a negative value, zero or a positive
+ * value when the first key is less than, equal to or greater than the second.
+ *
+ * Lookups binary search the bucket, so their cost is O(log bucket size) rather than
+ * linear. Inserts find their position with the same search and shift later entries
+ * right by one place, which makes them more expensive than the append in HASH_MAP.
+ * This suits read-mostly maps with large buckets.
+ *
+ * Since buckets are sorted, iterating map->buckets[i].data from 0 to
+ * NAME_bucket_size(&map->buckets[i]) visits the entries of that bucket in key order.
+ *
+ * The map shares its type and _init, _free, _find, _delete_matching, _count,
+ * _num_buckets and the iterators with HASH_MAP. The iterators also visit the entries of
+ * each bucket in key order.
+ */
+
+/**
+ * INTERNAL CALL: Binary searches a bucket for a key, returning the index of the first
+ * entry whose key is not less than it. found is set if that entry has an equal key.
+ */
+#define HASH_MAP_SORTED_SEARCH(NAME, KEY_TYPE, CMP_FN) \
+  static inline size_t NAME##_search(struct NAME##_bucket* bucket, KEY_TYPE key, bool* found) { \
+    size_t low = 0; \
+    size_t high = NAME##_bucket_size(bucket); \
+    while (low < high) { \
+      size_t mid = low + ((high - low) / 2); \
+      if (CMP_FN(bucket->data[mid].key, key) < 0) { \
+        low = mid + 1; \
+      } else { \
+        high = mid; \
+      } \
+    } \
+    *found = low < NAME##_bucket_size(bucket) && !CMP_FN(bucket->data[low].key, key); \
+    return low; \
+  }
+
+/**
+ * INTERNAL CALL: Inserts an entry at a given index of a bucket, shifting every later
+ * entry right one place and growing the bucket if necessary.
+ */
+#define HASH_MAP_SORTED_INSERT_AT(NAME) \
+  static inline void NAME##_insert_at(struct NAME##_bucket* bucket, size_t index, struct NAME##_entry entry) { \
+    if (bucket->current >= bucket->capacity) { \
+      NAME##_bucket_increase(bucket); \
+    } \
+    memmove(&bucket->data[index + 1], &bucket->data[index], sizeof(struct NAME##_entry) * (bucket->current - index)); \
+    bucket->data[index] = entry; \
+    bucket->current += 1; \
+  }
+
+/**
+ * _find_ptr returns a pointer to any matching element inside the map or NULL otherwise.
+ *
+ * WARNING: find_ptr is not stable between inserts, updates, or deletions since value locations
+ * may change in the buckets or buckets may be re-allocated.
+ */
+#define HASH_MAP_SORTED_FIND_PTR(NAME, KEY_TYPE, DATA_TYPE) \
+  static inline DATA_TYPE* NAME##_find_ptr(struct NAME* map, KEY_TYPE key) { \
+    struct NAME##_bucket* bucket = &map->buckets[NAME##_get_bucket(key)]; \
+    bool found; \
+    size_t idx = NAME##_search(bucket, key, &found); \
+    return found ? &bucket->data[idx].data : NULL; \
+  }
+
+/**
+ * _remove removes the key-value pair with a given key from its bucket, keeping
+ * the remaining entries in order.
+ */
+#define HASH_MAP_SORTED_REMOVE(NAME, KEY_TYPE) \
+  static inline void NAME##_remove(struct NAME* map, KEY_TYPE key) { \
+    struct NAME##_bucket* bucket = &map->buckets[NAME##_get_bucket(key)]; \
+    bool found; \
+    size_t idx = NAME##_search(bucket, key, &found); \
+    if (found) { \
+      NAME##_bucket_remove(bucket, idx); \
+    } \
+  }
+
+/**
+ * _take removes the element with a given key, keeping the remaining entries in order. It
+ * returns true if the element existed and copies its value to data if data is not NULL.
+ */
+#define HASH_MAP_SORTED_TAKE(NAME, KEY_TYPE, DATA_TYPE) \
+  static inline bool NAME##_take(struct NAME* map, KEY_TYPE key, DATA_TYPE* data) { \
+    struct NAME##_bucket* bucket = &map->buckets[NAME##_get_bucket(key)]; \
+    bool found; \
+    size_t idx = NAME##_search(bucket, key, &found); \
+    if (!found) { \
+      return false; \
+    } \
+    struct NAME##_entry removed = NAME##_bucket_remove(bucket, idx); \
+    if (data) { \
+      *data = removed.data; \
+    } \
+    return true; \
+  }
+
+/**
+ * _change_key replaces the key of a key-value pair with a new one, placing it at its
+ * sorted position in the appropriate bucket.
+ *
+ * If there is no value with a given key in the map then this call will do nothing.
+ */
+#define HASH_MAP_SORTED_CHANGE_KEY(NAME, KEY_TYPE, DATA_TYPE) \
+  static inline void NAME##_change_key(struct NAME* map, KEY_TYPE current_key, KEY_TYPE new_key) { \
+    DATA_TYPE val; \
+    if (NAME##_take(map, current_key, &val)) { \
+      NAME##_set(map, new_key, val); \
+    } \
+  }
+
+/**
+ * _set places the supplied key-value pair into the hash map at its sorted position in
+ * the bucket, replacing the value of any existing element with the same key.
+ */
+#define HASH_MAP_SORTED_SET(NAME, KEY_TYPE, DATA_TYPE) \
+  static inline void NAME##_set(struct NAME* map, KEY_TYPE key, DATA_TYPE val) { \
+    struct NAME##_bucket* bucket = &map->buckets[NAME##_get_bucket(key)]; \
+    bool found; \
+    size_t idx = NAME##_search(bucket, key, &found); \
+    if (found) { \
+      bucket->data[idx].data = val; \
+      return; \
+    } \
+    struct NAME##_entry k = { key, val }; \
+    NAME##_insert_at(bucket, idx, k); \
+  }
+
+#define HASH_MAP_SORTED(NAME, KEY_TYPE, DATA_TYPE, HASH_FN, CMP_FN, BUCKETS, BLOCK_SIZE) \
+  HASH_MAP_TYPE(NAME, KEY_TYPE, DATA_TYPE, BUCKETS, BLOCK_SIZE); \
+  HASH_MAP_INIT(NAME, BUCKETS) \
+  HASH_MAP_FREE(NAME, BUCKETS) \
+  HASH_MAP_GET_BUCKET(NAME, KEY_TYPE, BUCKETS, HASH_FN) \
+  HASH_MAP_SORTED_SEARCH(NAME, KEY_TYPE, CMP_FN) \
+  HASH_MAP_SORTED_INSERT_AT(NAME) \
+  HASH_MAP_SORTED_FIND_PTR(NAME, KEY_TYPE, DATA_TYPE) \
+  HASH_MAP_FIND(NAME, KEY_TYPE, DATA_TYPE, CMP_FN) \
+  HASH_MAP_SORTED_REMOVE(NAME, KEY_TYPE) \
+  HASH_MAP_SORTED_TAKE(NAME, KEY_TYPE, DATA_TYPE) \
+  HASH_MAP_REMOVE_PTR(NAME, DATA_TYPE, remove) \
+  HASH_MAP_DELETE_MATCHING(NAME, DATA_TYPE, BUCKETS) \
+  HASH_MAP_SORTED_SET(NAME, KEY_TYPE, DATA_TYPE) \
+  HASH_MAP_SORTED_CHANGE_KEY(NAME, KEY_TYPE, DATA_TYPE) \
   HASH_MAP_NUM_BUCKETS(NAME, BUCKETS) \
-  HASH_MAP_COUNT(NAME, BUCKETS)
+  HASH_MAP_MEMORY_USAGE(NAME, BUCKETS) \
+  HASH_MAP_COUNT(NAME, BUCKETS) \
+  HASH_MAP_ITER(NAME, BUCKETS)
 
 #endif
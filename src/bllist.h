@@ -5,6 +5,7 @@
 #include <stddef.h>
 #include <string.h>
 #include <stdbool.h>
+#include "blalloc.h"
 
 /**
  * This can be overwritten to set custom behaviour when an illegal array index is used.
@@ -61,17 +62,99 @@
   size_t shrink_at; \
 } NAME##_t;
 
+/**
+ * DYNAMIC_ARRAY_ALLOCATOR_TYPE declares an array which routes all of its memory management
+ * through a user supplied allocator (see blalloc.h) rather than malloc, realloc and free.
+ */
+#define DYNAMIC_ARRAY_ALLOCATOR_TYPE(NAME, TYPE) typedef struct NAME { \
+  TYPE* data; \
+  size_t current; \
+  size_t capacity; \
+  size_t shrink_at; \
+  /* The allocator the backing array is allocated from */ \
+  struct bl_allocator const* allocator; \
+} NAME##_t;
+
+/**
+ * INTERNAL USE MACRO: DO NOT USE
+ * Memory hooks that the array methods use to resize and release the backing array.
+ * _mem_resize allocates a new array when l->data is NULL.
+ * These forward to the standard library.
+ *
+ * The hooks also define _memory_usage, which returns the number of bytes the array
+ * currently holds on the heap (excluding the array structure itself).
+ */
+#define DYNAMIC_ARRAY_MALLOC_HOOKS(NAME, TYPE) \
+  static inline TYPE* NAME##_mem_resize(struct NAME* l, size_t old_capacity, size_t new_capacity) { \
+    (void) old_capacity; \
+    return realloc(l->data, sizeof(TYPE) * new_capacity); \
+  } \
+  static inline void NAME##_mem_release(struct NAME* l) { \
+    free(l->data); \
+  } \
+  static inline size_t NAME##_memory_usage(struct NAME* l) { \
+    return l->data ? sizeof(TYPE) * l->capacity : 0; \
+  }
+
+/**
+ * INTERNAL USE MACRO: DO NOT USE
+ * Memory hooks for arrays declared with DYNAMIC_ARRAY_ALLOCATOR_TYPE, forwarding to l->allocator.
+ */
+#define DYNAMIC_ARRAY_ALLOCATOR_HOOKS(NAME, TYPE) \
+  static inline TYPE* NAME##_mem_resize(struct NAME* l, size_t old_capacity, size_t new_capacity) { \
+    return bl_allocator_realloc(l->allocator, l->data, sizeof(TYPE) * old_capacity, sizeof(TYPE) * new_capacity); \
+  } \
+  static inline void NAME##_mem_release(struct NAME* l) { \
+    bl_allocator_free(l->allocator, l->data, sizeof(TYPE) * l->capacity); \
+  } \
+  static inline size_t NAME##_memory_usage(struct NAME* l) { \
+    return l->data ? sizeof(TYPE) * l->capacity : 0; \
+  }
+
 /**
  * _init places the dynamic array in a state where
  * elements can be added.
  * NOTE: _init must be called before the array can be used.
  */
 #define DYNAMIC_ARRAY_INIT(NAME, TYPE, SIZE) \
-  static void NAME##_init(struct NAME* l) { \
+  static inline void NAME##_init(struct NAME* l) { \
+    memset(l, 0, sizeof(struct NAME)); \
+    l->capacity = SIZE; \
+    l->shrink_at = 0; \
+    l->data = NAME##_mem_resize(l, 0, l->capacity); \
+  }
+
+/**
+ * _init_lazy places the dynamic array in a state where elements can be added, without
+ * allocating. The backing array is allocated with SIZE elements on the first push.
+ * This is useful when many arrays are created and most of them remain empty.
+ * NOTE: An array which has not yet allocated is treated as uninitialized by _concat.
+ */
+#define DYNAMIC_ARRAY_INIT_LAZY(NAME) \
+  static inline void NAME##_init_lazy(struct NAME* l) { \
+    memset(l, 0, sizeof(struct NAME)); \
+  }
+
+/**
+ * _init_with places an allocator aware array in a state where elements can be added,
+ * allocating from the supplied allocator. _init uses bl_malloc_allocator.
+ * _init_lazy_with does not allocate until the first push, like _init_lazy.
+ * NOTE: _init, _init_with or _init_lazy_with must be called before the array can be used.
+ */
+#define DYNAMIC_ARRAY_ALLOCATOR_INIT(NAME, TYPE, SIZE) \
+  static inline void NAME##_init_with(struct NAME* l, struct bl_allocator const* allocator) { \
     memset(l, 0, sizeof(struct NAME)); \
+    l->allocator = allocator; \
     l->capacity = SIZE; \
     l->shrink_at = 0; \
-    l->data = malloc(sizeof(TYPE) * l->capacity); \
+    l->data = NAME##_mem_resize(l, 0, l->capacity); \
+  } \
+  static inline void NAME##_init(struct NAME* l) { \
+    NAME##_init_with(l, &bl_malloc_allocator); \
+  } \
+  static inline void NAME##_init_lazy_with(struct NAME* l, struct bl_allocator const* allocator) { \
+    memset(l, 0, sizeof(struct NAME)); \
+    l->allocator = allocator; \
   }
 
 /**
@@ -80,8 +163,8 @@
  * the memory used to store the pointers in a list.
  */
 #define DYNAMIC_ARRAY_FREE(NAME) \
-  static void NAME##_free(struct NAME* l) { \
-    free(l->data); \
+  static inline void NAME##_free(struct NAME* l) { \
+    NAME##_mem_release(l); \
     memset(l, 0, sizeof(struct NAME)); \
   }
 
@@ -106,11 +189,12 @@
  */
 #define DYNAMIC_ARRAY_INCREASE(NAME, TYPE, SIZE) \
   static inline void NAME##_increase(struct NAME* l) { \
-    /* Increase doubles capacity */ \
-    l->capacity += l->capacity; \
+    /* Increase doubles capacity, a lazily initialized array starts at SIZE */ \
+    size_t old_capacity = l->capacity; \
+    l->capacity = l->capacity ? l->capacity * 2 : SIZE; \
     DYNAMIC_ARRAY_ADJUST_SHRINK(l, NAME, TYPE, SIZE) \
     /* After deciding on the new capacity we re-allocate the backing array */ \
-    TYPE* new_data = realloc(l->data, sizeof(TYPE) * l->capacity); \
+    TYPE* new_data = NAME##_mem_resize(l, old_capacity, l->capacity); \
     l->data = new_data; \
   }
 
@@ -120,17 +204,22 @@
  * We attempt to half the allocated memory for the array.
  * If the array would be smaller than SIZE, the minimum size of the array,
  * then we set the capacity to SIZE.
+ * If many elements were removed at once (e.g, by _delete_matching) the capacity is
+ * halved as many times as the policy allows before a single re-allocation.
  * Amortised cost: Half array size if array consumption drops below 30%
  */
 #define DYNAMIC_ARRAY_SHRINK(NAME, TYPE, SIZE) \
   static inline void NAME##_shrink(struct NAME* l) { \
     if (l->shrink_at && l->current <= l->shrink_at) { \
-      l->capacity /= 2; \
-      if (l->capacity < SIZE) { \
-        l->capacity = SIZE; \
-      } \
-      l->data = realloc(l->data, l->capacity * sizeof(TYPE)); \
-      DYNAMIC_ARRAY_ADJUST_SHRINK(l, NAME, TYPE, SIZE) \
+      size_t old_capacity = l->capacity; \
+      do { \
+        l->capacity /= 2; \
+        if (l->capacity < SIZE) { \
+          l->capacity = SIZE; \
+        } \
+        DYNAMIC_ARRAY_ADJUST_SHRINK(l, NAME, TYPE, SIZE) \
+      } while (l->shrink_at && l->current <= l->shrink_at); \
+      l->data = NAME##_mem_resize(l, old_capacity, l->capacity); \
     } \
   }
 
@@ -164,6 +253,24 @@
     return r; \
   }
 
+/**
+ * _swap_remove removes an array item at a given index and returns it, moving the last
+ * element of the array into its place, and shrinks the array if necessary.
+ * This is O(1), but does not preserve the order of the remaining elements, so it
+ * should be preferred over _remove wherever order does not matter.
+ */
+#define DYNAMIC_ARRAY_SWAP_REMOVE(NAME, TYPE) \
+  static inline TYPE NAME##_swap_remove(struct NAME* l, size_t index) { \
+    if (index >= l->current) { \
+      LIST_ILLEGAL_OP("remove index out of bounds"); \
+    } \
+    l->current -= 1; \
+    TYPE r = l->data[index]; \
+    l->data[index] = l->data[l->current]; \
+    NAME##_shrink(l); \
+    return r; \
+  }
+
 /**
  * _pop deletes the element at the end of the array, returns it, and 
  * shrinks the array if necessary.
@@ -184,11 +291,13 @@
  * _delete deletes any elements in the array which match a predicate, and calls
  * an optional post callback after it is removed.
  *
- * We loop once through every element.
- * If that element matches a callback, we remove it (shifting all elements left one place)
- * If that element does not match then we increment the loop index by one
- * If an element is deleted, we will call the post callback.
+ * We loop once through every element, compacting the array as we go.
+ * If that element matches a callback, we call the post callback on it and skip it.
+ * If that element does not match then we move it down to follow the last kept element.
  * If the post callback is NULL we ignore it.
+ * Kept elements stay in their original order, post is called on deleted elements in
+ * order, and the array is shrunk at most once at the end, so deleting any number of
+ * elements costs O(n) rather than a memmove per deleted element.
  *
  * The delete method deletes any value for which the supplied callback method returns true
  * The callback method takes TYPE* and returns true/false.
@@ -197,18 +306,21 @@
   typedef bool (*NAME##_delete_callback_ptr_t)(TYPE* v); \
   typedef void (*NAME##_post_delete_callback_ptr_t)(TYPE* v); \
   static inline void NAME##_delete_matching(struct NAME* l, NAME##_delete_callback_ptr_t matches, NAME##_post_delete_callback_ptr_t post) { \
-    size_t idx = 0; \
-    while (idx < l->current) { \
+    size_t kept = 0; \
+    for (size_t idx = 0; idx < l->current; idx++) { \
       if (matches(&l->data[idx])) { \
-        TYPE nval = l->data[idx]; \
-        NAME##_remove(l, idx); \
         if (post) { \
-          post(&nval); \
+          post(&l->data[idx]); \
         } \
       } else { \
-        idx++; \
+        if (kept != idx) { \
+          l->data[kept] = l->data[idx]; \
+        } \
+        kept++; \
       } \
     } \
+    l->current = kept; \
+    NAME##_shrink(l); \
   }
 
 /**
@@ -223,8 +335,9 @@
     if (!l1 || !l1->data || !l2 || !l2->data) { \
       LIST_ILLEGAL_CONCAT("invalid pointer to list or uninitialized list"); \
     } \
+    size_t old_capacity = l1->capacity; \
     l1->capacity = (l1->current + l2->current) + SIZE; \
-    l1->data = realloc(l1->data, sizeof(TYPE) * l1->capacity); \
+    l1->data = NAME##_mem_resize(l1, old_capacity, l1->capacity); \
     memcpy(l1->data + l1->current, l2->data, l2->current * sizeof(TYPE)); \
     l1->current += l2->current; \
     DYNAMIC_ARRAY_ADJUST_SHRINK(l1, NAME, TYPE, SIZE); \
@@ -239,9 +352,71 @@
     return l->current; \
   }
 
+/**
+ * _iter_begin returns an iterator over the elements of the array, and each call to
+ * _iter_next returns a pointer to the next element, or NULL once every element has been
+ * visited. _for_each calls fn(element, ctx) on every element in order.
+ *
+ * Iteration is a pointer walk over the backing array, so it inlines into the caller with
+ * no per-element call. The array must not be modified while an iterator is in use, other
+ * than by writing through the element pointers.
+ *
+ * Example: DYNAMIC_ARRAY_FOREACH(NAME, &list, v) { sum += *v; }
+ */
+#define DYNAMIC_ARRAY_ITER(NAME, TYPE) \
+  typedef TYPE NAME##_iter_value_t; \
+  typedef struct NAME##_iter { \
+    TYPE* next; \
+    TYPE* end; \
+  } NAME##_iter_t; \
+  static inline NAME##_iter_t NAME##_iter_begin(struct NAME* l) { \
+    NAME##_iter_t it = { l->data, l->data + l->current }; \
+    return it; \
+  } \
+  static inline TYPE* NAME##_iter_next(NAME##_iter_t* it) { \
+    return it->next < it->end ? it->next++ : NULL; \
+  } \
+  typedef void (* NAME##_for_each_fn_t)(TYPE* v, void* ctx); \
+  static inline void NAME##_for_each(struct NAME* l, NAME##_for_each_fn_t fn, void* ctx) { \
+    for (size_t i = 0; i < l->current; i++) { \
+      fn(&l->data[i], ctx); \
+    } \
+  }
+
+/**
+ * DYNAMIC_ARRAY_FOREACH runs the statement that follows it once for every element of the
+ * array LIST (a struct NAME*), with VAR declared as a TYPE* pointing at the element.
+ * break and continue behave as in a plain for loop.
+ */
+#define DYNAMIC_ARRAY_FOREACH(NAME, LIST, VAR) \
+  for (NAME##_iter_t VAR##_iter = NAME##_iter_begin(LIST), *VAR##_once = &VAR##_iter; VAR##_once; VAR##_once = NULL) \
+    for (NAME##_iter_value_t* VAR; (VAR = NAME##_iter_next(&VAR##_iter)) != NULL;)
+
 #define DYNAMIC_ARRAY(name, type, block_size) \
   DYNAMIC_ARRAY_TYPE(name, type); \
+  DYNAMIC_ARRAY_MALLOC_HOOKS(name, type) \
   DYNAMIC_ARRAY_INIT(name, type, block_size) \
+  DYNAMIC_ARRAY_INIT_LAZY(name) \
+  DYNAMIC_ARRAY_FREE(name) \
+  DYNAMIC_ARRAY_INCREASE(name, type, block_size) \
+  DYNAMIC_ARRAY_PUSH(name, type) \
+  DYNAMIC_ARRAY_SHRINK(name, type, block_size) \
+  DYNAMIC_ARRAY_POP(name, type) \
+  DYNAMIC_ARRAY_CONCAT(name, type, block_size) \
+  DYNAMIC_ARRAY_REMOVE(name, type) \
+  DYNAMIC_ARRAY_SWAP_REMOVE(name, type) \
+  DYNAMIC_ARRAY_SIZE(name) \
+  DYNAMIC_ARRAY_ITER(name, type) \
+  DYNAMIC_ARRAY_DELETE_MATCHING(name, type)
+
+/**
+ * DYNAMIC_ARRAY_ALLOCATOR declares a dynamic array with the same methods as DYNAMIC_ARRAY
+ * that allocates from a struct bl_allocator supplied to _init_with.
+ */
+#define DYNAMIC_ARRAY_ALLOCATOR(name, type, block_size) \
+  DYNAMIC_ARRAY_ALLOCATOR_TYPE(name, type); \
+  DYNAMIC_ARRAY_ALLOCATOR_HOOKS(name, type) \
+  DYNAMIC_ARRAY_ALLOCATOR_INIT(name, type, block_size) \
   DYNAMIC_ARRAY_FREE(name) \
   DYNAMIC_ARRAY_INCREASE(name, type, block_size) \
   DYNAMIC_ARRAY_PUSH(name, type) \
@@ -249,7 +424,477 @@
   DYNAMIC_ARRAY_POP(name, type) \
   DYNAMIC_ARRAY_CONCAT(name, type, block_size) \
   DYNAMIC_ARRAY_REMOVE(name, type) \
+  DYNAMIC_ARRAY_SWAP_REMOVE(name, type) \
+  DYNAMIC_ARRAY_SIZE(name) \
+  DYNAMIC_ARRAY_ITER(name, type) \
+  DYNAMIC_ARRAY_DELETE_MATCHING(name, type)
+
+/**
+ * Small dynamic array structure.
+ * SMALL_DYNAMIC_ARRAY declares a dynamic array which stores its first INLINE_N elements
+ * inside the structure itself and only allocates once it grows past them. On the first
+ * spill the array moves to a heap allocation of at least BLOCK elements, after which it
+ * grows and shrinks like DYNAMIC_ARRAY. Once it shrinks to INLINE_N / 2 elements or fewer
+ * the elements move back into the structure and the heap allocation is released, so a
+ * drained array holds no heap memory. The gap between spilling (past INLINE_N) and moving
+ * back (at INLINE_N / 2) stops an array that hovers around INLINE_N from allocating on
+ * every push.
+ *
+ * This makes _init allocation free, which is useful when many arrays are expected to
+ * remain small (e.g, hash map buckets).
+ *
+ * WARNING: While the array is using inline storage data points inside the structure, so
+ * an initialized array must not be copied or moved by value.
+ */
+#define SMALL_DYNAMIC_ARRAY_TYPE(NAME, TYPE, INLINE_N) typedef struct NAME { \
+  TYPE* data; \
+  size_t current; \
+  size_t capacity; \
+  size_t shrink_at; \
+  /* Storage used while the array holds INLINE_N or fewer elements */ \
+  TYPE inline_data[INLINE_N]; \
+} NAME##_t;
+
+/**
+ * INTERNAL USE MACRO: DO NOT USE
+ * Memory hooks for small arrays, which move the elements between the inline storage
+ * and the heap as the capacity crosses INLINE_N.
+ */
+#define SMALL_DYNAMIC_ARRAY_HOOKS(NAME, TYPE, INLINE_N) \
+  static inline TYPE* NAME##_mem_resize(struct NAME* l, size_t old_capacity, size_t new_capacity) { \
+    (void) old_capacity; \
+    bool is_inline = !l->data || l->data == l->inline_data; \
+    if (new_capacity <= INLINE_N) { \
+      if (!is_inline) { \
+        memcpy(l->inline_data, l->data, sizeof(TYPE) * l->current); \
+        free(l->data); \
+      } \
+      return l->inline_data; \
+    } \
+    if (is_inline) { \
+      TYPE* heap = malloc(sizeof(TYPE) * new_capacity); \
+      if (l->data) { \
+        memcpy(heap, l->inline_data, sizeof(TYPE) * l->current); \
+      } \
+      return heap; \
+    } \
+    return realloc(l->data, sizeof(TYPE) * new_capacity); \
+  } \
+  static inline void NAME##_mem_release(struct NAME* l) { \
+    if (l->data != l->inline_data) { \
+      free(l->data); \
+    } \
+  } \
+  static inline size_t NAME##_memory_usage(struct NAME* l) { \
+    return l->data != l->inline_data ? sizeof(TYPE) * l->capacity : 0; \
+  }
+
+/**
+ * _init places the small array in a state where elements can be added, using
+ * the inline storage. This does not allocate, so _init_lazy is the same call.
+ */
+#define SMALL_DYNAMIC_ARRAY_INIT(NAME, INLINE_N) \
+  static inline void NAME##_init(struct NAME* l) { \
+    memset(l, 0, sizeof(struct NAME)); \
+    l->capacity = INLINE_N; \
+    l->shrink_at = 0; \
+    l->data = l->inline_data; \
+  } \
+  static inline void NAME##_init_lazy(struct NAME* l) { \
+    NAME##_init(l); \
+  }
+
+/**
+ * INTERNAL CALL: Method to increase the size of a small array.
+ * The first spill from inline storage allocates at least BLOCK elements,
+ * after which capacity doubles as in DYNAMIC_ARRAY_INCREASE.
+ */
+#define SMALL_DYNAMIC_ARRAY_INCREASE(NAME, TYPE, BLOCK) \
+  static inline void NAME##_increase(struct NAME* l) { \
+    size_t old_capacity = l->capacity; \
+    l->capacity = l->capacity * 2 < BLOCK ? BLOCK : l->capacity * 2; \
+    DYNAMIC_ARRAY_ADJUST_SHRINK(l, NAME, TYPE, BLOCK) \
+    l->data = NAME##_mem_resize(l, old_capacity, l->capacity); \
+  }
+
+/**
+ * INTERNAL CALL: Method to shrink a small array.
+ * A heap allocated array holding INLINE_N / 2 elements or fewer moves back into its
+ * inline storage. Otherwise the array shrinks as in DYNAMIC_ARRAY_SHRINK, never below BLOCK.
+ */
+#define SMALL_DYNAMIC_ARRAY_SHRINK(NAME, TYPE, INLINE_N, BLOCK) \
+  static inline void NAME##_shrink(struct NAME* l) { \
+    if (l->data != l->inline_data && l->current <= (INLINE_N) / 2) { \
+      size_t old_capacity = l->capacity; \
+      l->capacity = INLINE_N; \
+      l->shrink_at = 0; \
+      l->data = NAME##_mem_resize(l, old_capacity, l->capacity); \
+    } else if (l->shrink_at && l->current <= l->shrink_at) { \
+      size_t old_capacity = l->capacity; \
+      do { \
+        l->capacity /= 2; \
+        if (l->capacity < BLOCK) { \
+          l->capacity = BLOCK; \
+        } \
+        DYNAMIC_ARRAY_ADJUST_SHRINK(l, NAME, TYPE, BLOCK) \
+      } while (l->shrink_at && l->current <= l->shrink_at); \
+      l->data = NAME##_mem_resize(l, old_capacity, l->capacity); \
+    } \
+  }
+
+#define SMALL_DYNAMIC_ARRAY(name, type, inline_n, block) \
+  SMALL_DYNAMIC_ARRAY_TYPE(name, type, inline_n); \
+  SMALL_DYNAMIC_ARRAY_HOOKS(name, type, inline_n) \
+  SMALL_DYNAMIC_ARRAY_INIT(name, inline_n) \
+  DYNAMIC_ARRAY_FREE(name) \
+  SMALL_DYNAMIC_ARRAY_INCREASE(name, type, block) \
+  DYNAMIC_ARRAY_PUSH(name, type) \
+  SMALL_DYNAMIC_ARRAY_SHRINK(name, type, inline_n, block) \
+  DYNAMIC_ARRAY_POP(name, type) \
+  DYNAMIC_ARRAY_CONCAT(name, type, block) \
+  DYNAMIC_ARRAY_REMOVE(name, type) \
+  DYNAMIC_ARRAY_SWAP_REMOVE(name, type) \
   DYNAMIC_ARRAY_SIZE(name) \
+  DYNAMIC_ARRAY_ITER(name, type) \
   DYNAMIC_ARRAY_DELETE_MATCHING(name, type)
 
+/**
+ * DYNAMIC_DEQUE declares a double ended queue backed by a growable circular buffer.
+ * Elements can be pushed and popped at either end in amortized O(1), where using a
+ * DYNAMIC_ARRAY as a queue with _remove(l, 0) moves every remaining element on each pop.
+ *
+ * The elements are the current elements starting at data[head], wrapping around to
+ * data[0] after the end of the buffer. The buffer grows and shrinks with the same policy
+ * as DYNAMIC_ARRAY: its capacity doubles when full and halves (to no less than SIZE) once
+ * no more than a third of it is used. It is initialized with _init or _init_lazy and
+ * released with _free, as for a DYNAMIC_ARRAY.
+ */
+#define DYNAMIC_DEQUE_TYPE(NAME, TYPE) typedef struct NAME { \
+  TYPE* data; \
+  /* The index of the first element in data */ \
+  size_t head; \
+  size_t current; \
+  size_t capacity; \
+  size_t shrink_at; \
+} NAME##_t;
+
+/**
+ * INTERNAL CALL: Maps the index of an element to its position in data.
+ */
+#define DYNAMIC_DEQUE_SLOT(NAME) \
+  static inline size_t NAME##_slot(struct NAME* l, size_t index) { \
+    size_t slot = l->head + index; \
+    return slot >= l->capacity ? slot - l->capacity : slot; \
+  }
+
+/**
+ * INTERNAL CALL: Doubles the capacity of the deque. After the buffer is reallocated the
+ * elements that had wrapped around to the start are moved to follow the others, into the
+ * newly allocated space.
+ */
+#define DYNAMIC_DEQUE_INCREASE(NAME, TYPE, SIZE) \
+  static inline void NAME##_increase(struct NAME* l) { \
+    size_t old_capacity = l->capacity; \
+    l->capacity = l->capacity ? l->capacity * 2 : SIZE; \
+    DYNAMIC_ARRAY_ADJUST_SHRINK(l, NAME, TYPE, SIZE) \
+    l->data = NAME##_mem_resize(l, old_capacity, l->capacity); \
+    if (l->head + l->current > old_capacity) { \
+      memcpy(l->data + old_capacity, l->data, sizeof(TYPE) * (l->head + l->current - old_capacity)); \
+    } \
+  }
+
+/**
+ * INTERNAL CALL: Halves the capacity of the deque once it is at most a third full. The
+ * elements are first moved to the start of the buffer so they survive the reallocation.
+ * Since at most a third of the buffer is in use, the wrapped and unwrapped parts can each
+ * be moved with a single memmove without overwriting the other.
+ */
+#define DYNAMIC_DEQUE_SHRINK(NAME, TYPE, SIZE) \
+  static inline void NAME##_shrink(struct NAME* l) { \
+    if (l->shrink_at && l->current <= l->shrink_at) { \
+      size_t first = l->capacity - l->head; \
+      if (first >= l->current) { \
+        memmove(l->data, l->data + l->head, sizeof(TYPE) * l->current); \
+      } else { \
+        memmove(l->data + first, l->data, sizeof(TYPE) * (l->current - first)); \
+        memmove(l->data, l->data + l->head, sizeof(TYPE) * first); \
+      } \
+      l->head = 0; \
+      size_t old_capacity = l->capacity; \
+      l->capacity /= 2; \
+      if (l->capacity < SIZE) { \
+        l->capacity = SIZE; \
+      } \
+      l->data = NAME##_mem_resize(l, old_capacity, l->capacity); \
+      DYNAMIC_ARRAY_ADJUST_SHRINK(l, NAME, TYPE, SIZE) \
+    } \
+  }
+
+/**
+ * _push_back adds an element after the last element and _push_front adds an element
+ * before the first, expanding the capacity of the deque if necessary.
+ */
+#define DYNAMIC_DEQUE_PUSH(NAME, TYPE) \
+  static inline void NAME##_push_back(struct NAME* l, TYPE v) { \
+    if (l->current >= l->capacity) { \
+      NAME##_increase(l); \
+    } \
+    l->data[NAME##_slot(l, l->current)] = v; \
+    l->current += 1; \
+  } \
+  static inline void NAME##_push_front(struct NAME* l, TYPE v) { \
+    if (l->current >= l->capacity) { \
+      NAME##_increase(l); \
+    } \
+    l->head = l->head ? l->head - 1 : l->capacity - 1; \
+    l->data[l->head] = v; \
+    l->current += 1; \
+  }
+
+/**
+ * _pop_back removes and returns the last element and _pop_front removes and returns the
+ * first element, shrinking the deque if necessary.
+ */
+#define DYNAMIC_DEQUE_POP(NAME, TYPE) \
+  static inline TYPE NAME##_pop_back(struct NAME* l) { \
+    if (l->current == 0) { \
+      LIST_ILLEGAL_OP("pop an empty deque"); \
+    } \
+    l->current -= 1; \
+    TYPE r = l->data[NAME##_slot(l, l->current)]; \
+    NAME##_shrink(l); \
+    return r; \
+  } \
+  static inline TYPE NAME##_pop_front(struct NAME* l) { \
+    if (l->current == 0) { \
+      LIST_ILLEGAL_OP("pop an empty deque"); \
+    } \
+    TYPE r = l->data[l->head]; \
+    l->head = NAME##_slot(l, 1); \
+    l->current -= 1; \
+    NAME##_shrink(l); \
+    return r; \
+  }
+
+/**
+ * _at returns a pointer to the element at a given index, where index 0 is the front of
+ * the deque. The pointer is invalidated by any push or pop.
+ */
+#define DYNAMIC_DEQUE_AT(NAME, TYPE) \
+  static inline TYPE* NAME##_at(struct NAME* l, size_t index) { \
+    if (index >= l->current) { \
+      LIST_ILLEGAL_OP("deque index out of bounds"); \
+    } \
+    return &l->data[NAME##_slot(l, index)]; \
+  }
+
+#define DYNAMIC_DEQUE(name, type, block_size) \
+  DYNAMIC_DEQUE_TYPE(name, type); \
+  DYNAMIC_ARRAY_MALLOC_HOOKS(name, type) \
+  DYNAMIC_ARRAY_INIT(name, type, block_size) \
+  DYNAMIC_ARRAY_INIT_LAZY(name) \
+  DYNAMIC_ARRAY_FREE(name) \
+  DYNAMIC_DEQUE_SLOT(name) \
+  DYNAMIC_DEQUE_INCREASE(name, type, block_size) \
+  DYNAMIC_DEQUE_SHRINK(name, type, block_size) \
+  DYNAMIC_DEQUE_PUSH(name, type) \
+  DYNAMIC_DEQUE_POP(name, type) \
+  DYNAMIC_DEQUE_AT(name, type) \
+  DYNAMIC_ARRAY_SIZE(name)
+
+/**
+ * DYNAMIC_ARRAY_SORT declares sorting and searching for an array declared by any of the
+ * generators above, specialized for a comparison function:
+ *
+ *   DYNAMIC_ARRAY(int_list, int, 16);
+ *   DYNAMIC_ARRAY_SORT(int_list, int, int_cmp);
+ *
+ * CMP_FN(a, b) must return a negative value, zero or a positive value when a is less than,
+ * equal to or greater than b. Since it is expanded in place it can be inlined, unlike the
+ * comparator passed to qsort which is called through a pointer on every comparison.
+ */
+
+/// Partitions at or below this size are sorted by insertion sort
+#ifndef DYNAMIC_ARRAY_INSERTION_SORT_MAX
+#define DYNAMIC_ARRAY_INSERTION_SORT_MAX 16
+#endif
+
+/**
+ * _sort sorts the array in place with an introsort. This is a quicksort with a
+ * median-of-three pivot, that switches to heapsort when the recursion gets deeper than
+ * 2 log2(n) so the worst case stays O(n log n), and finishes small partitions with an
+ * insertion sort. The sort is not stable.
+ */
+#define DYNAMIC_ARRAY_SORT_INTRO(NAME, TYPE, CMP_FN) \
+  static inline void NAME##_insertion_sort(TYPE* data, size_t n) { \
+    for (size_t i = 1; i < n; i++) { \
+      TYPE v = data[i]; \
+      size_t j = i; \
+      while (j > 0 && CMP_FN(v, data[j - 1]) < 0) { \
+        data[j] = data[j - 1]; \
+        j--; \
+      } \
+      data[j] = v; \
+    } \
+  } \
+  static inline void NAME##_sift_down(TYPE* data, size_t root, size_t n) { \
+    TYPE v = data[root]; \
+    size_t child; \
+    while ((child = 2 * root + 1) < n) { \
+      if (child + 1 < n && CMP_FN(data[child], data[child + 1]) < 0) { \
+        child++; \
+      } \
+      if (CMP_FN(v, data[child]) >= 0) { \
+        break; \
+      } \
+      data[root] = data[child]; \
+      root = child; \
+    } \
+    data[root] = v; \
+  } \
+  static inline void NAME##_heap_sort(TYPE* data, size_t n) { \
+    for (size_t i = n / 2; i > 0; i--) { \
+      NAME##_sift_down(data, i - 1, n); \
+    } \
+    for (size_t i = n; i > 1; i--) { \
+      TYPE t = data[0]; \
+      data[0] = data[i - 1]; \
+      data[i - 1] = t; \
+      NAME##_sift_down(data, 0, i - 1); \
+    } \
+  } \
+  static inline void NAME##_intro_sort(TYPE* data, size_t n, size_t depth) { \
+    while (n > DYNAMIC_ARRAY_INSERTION_SORT_MAX) { \
+      if (depth == 0) { \
+        NAME##_heap_sort(data, n); \
+        return; \
+      } \
+      depth--; \
+      /* Order the first, middle and last elements so the median is in the middle and */ \
+      /* the ends act as sentinels for the partition loops */ \
+      size_t mid = n / 2; \
+      TYPE t; \
+      if (CMP_FN(data[mid], data[0]) < 0) { t = data[mid]; data[mid] = data[0]; data[0] = t; } \
+      if (CMP_FN(data[n - 1], data[mid]) < 0) { \
+        t = data[n - 1]; data[n - 1] = data[mid]; data[mid] = t; \
+        if (CMP_FN(data[mid], data[0]) < 0) { t = data[mid]; data[mid] = data[0]; data[0] = t; } \
+      } \
+      TYPE pivot = data[mid]; \
+      size_t i = 0; \
+      size_t j = n - 1; \
+      for (;;) { \
+        while (CMP_FN(data[i], pivot) < 0) { \
+          i++; \
+        } \
+        while (CMP_FN(pivot, data[j]) < 0) { \
+          j--; \
+        } \
+        if (i >= j) { \
+          break; \
+        } \
+        t = data[i]; data[i] = data[j]; data[j] = t; \
+        i++; \
+        j--; \
+      } \
+      /* Recurse into the smaller side and loop on the larger to bound the stack depth */ \
+      size_t split = j + 1; \
+      if (split < n - split) { \
+        NAME##_intro_sort(data, split, depth); \
+        data += split; \
+        n -= split; \
+      } else { \
+        NAME##_intro_sort(data + split, n - split, depth); \
+        n = split; \
+      } \
+    } \
+    NAME##_insertion_sort(data, n); \
+  } \
+  static inline void NAME##_sort(struct NAME* l) { \
+    size_t depth = 0; \
+    for (size_t n = l->current; n > 1; n >>= 1) { \
+      depth += 2; \
+    } \
+    NAME##_intro_sort(l->data, l->current, depth); \
+  }
+
+/**
+ * _bsearch searches a sorted array for an element equal to key. It returns true if one
+ * is found, and sets *index (if not NULL) to the position of the first element that is not
+ * less than key, which is the position key would be inserted at to keep the array sorted.
+ */
+#define DYNAMIC_ARRAY_BSEARCH(NAME, TYPE, CMP_FN) \
+  static inline bool NAME##_bsearch(struct NAME* l, TYPE key, size_t* index) { \
+    size_t low = 0; \
+    size_t high = l->current; \
+    while (low < high) { \
+      size_t mid = low + ((high - low) / 2); \
+      if (CMP_FN(l->data[mid], key) < 0) { \
+        low = mid + 1; \
+      } else { \
+        high = mid; \
+      } \
+    } \
+    if (index) { \
+      *index = low; \
+    } \
+    return low < l->current && !CMP_FN(l->data[low], key); \
+  }
+
+#define DYNAMIC_ARRAY_SORT(NAME, TYPE, CMP_FN) \
+  DYNAMIC_ARRAY_SORT_INTRO(NAME, TYPE, CMP_FN) \
+  DYNAMIC_ARRAY_BSEARCH(NAME, TYPE, CMP_FN)
+
+/**
+ * DYNAMIC_ARRAY_RADIX_SORT declares _radix_sort, a stable least-significant-digit radix
+ * sort for arrays whose elements are ordered by an integer key. KEY_EXTRACT(v) must map an
+ * element to a uint64_t whose unsigned order is the desired order; for signed keys flip the
+ * sign bit, e.g. ((uint64_t) v.id ^ (1ull << 63)).
+ *
+ * Keys are sorted a byte at a time. The counts for every byte are gathered in a single pass
+ * and bytes that are the same for every key (e.g, the high bytes of small keys) are
+ * skipped, so sorting 32 bit keys stored in a uint64_t takes at most four passes. Each pass
+ * is O(n) without comparisons, which for large arrays is several times faster than a
+ * comparison sort. The sort uses a temporary buffer of l->current elements.
+ */
+#define DYNAMIC_ARRAY_RADIX_SORT(NAME, TYPE, KEY_EXTRACT) \
+  static inline void NAME##_radix_sort(struct NAME* l) { \
+    size_t n = l->current; \
+    if (n < 2) { \
+      return; \
+    } \
+    size_t (*counts)[256] = calloc(8, sizeof(*counts)); \
+    for (size_t i = 0; i < n; i++) { \
+      uint64_t key = KEY_EXTRACT(l->data[i]); \
+      for (size_t b = 0; b < 8; b++) { \
+        counts[b][(key >> (b * 8)) & 0xFF]++; \
+      } \
+    } \
+    TYPE* src = l->data; \
+    TYPE* dst = malloc(sizeof(TYPE) * n); \
+    TYPE* scratch = dst; \
+    for (size_t b = 0; b < 8; b++) { \
+      size_t* count = counts[b]; \
+      if (count[(KEY_EXTRACT(src[0]) >> (b * 8)) & 0xFF] == n) { \
+        continue; \
+      } \
+      size_t offset = 0; \
+      for (size_t d = 0; d < 256; d++) { \
+        size_t c = count[d]; \
+        count[d] = offset; \
+        offset += c; \
+      } \
+      for (size_t i = 0; i < n; i++) { \
+        dst[count[(KEY_EXTRACT(src[i]) >> (b * 8)) & 0xFF]++] = src[i]; \
+      } \
+      TYPE* t = src; \
+      src = dst; \
+      dst = t; \
+    } \
+    if (src != l->data) { \
+      memcpy(l->data, src, sizeof(TYPE) * n); \
+    } \
+    free(scratch); \
+    free(counts); \
+  }
+
 #endif
@@ -2,12 +2,29 @@
 #define _BLAKE_LINKED_LIST_H_
 
 /**
- * WORK IN PROGRESS: DO NOT USE YET
+ * Doubly linked list. Every operation other than _free is O(1).
+ *
+ * CREATE_LINKED_LIST allocates each node with malloc. CREATE_LINKED_LIST_POOL instead carves
+ * nodes out of slabs of SLAB_SIZE contiguous nodes and recycles removed nodes through an
+ * intrusive free list, so a list in steady state does not allocate, nodes allocated together
+ * are adjacent in memory, and _free releases whole slabs rather than walking the list.
  */
 
 #include <string.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include "blalloc.h"
+
+/**
+ * This can be overwritten to set custom behaviour when popping from an empty list.
+ * When overriding, either return a value or terminate.
+ */
+#ifndef LINKED_LIST_ILLEGAL_OP
+#define LINKED_LIST_ILLEGAL_OP(msg) \
+  fprintf(stderr, "Exit because of illegal linked list operation: %s\n", msg); \
+  exit(EXIT_FAILURE);
+#endif
 
 #define LINKED_LIST_TYPE(NAME, TYPE) \
 struct NAME##_elem { \
@@ -21,27 +38,146 @@ struct NAME { \
   size_t size; \
 };
 
+/**
+ * A linked list which allocates its nodes from a struct bl_allocator (see blalloc.h)
+ */
+#define LINKED_LIST_ALLOCATOR_TYPE(NAME, TYPE) \
+struct NAME##_elem { \
+  TYPE data; \
+  struct NAME##_elem* next; \
+  struct NAME##_elem* prev; \
+};\
+struct NAME { \
+  struct NAME##_elem* start; \
+  struct NAME##_elem* end; \
+  size_t size; \
+  struct bl_allocator const* allocator; \
+};
+
+/**
+ * A linked list whose nodes are allocated from slabs of SLAB_SIZE nodes.
+ * Nodes on the free list are chained through their next pointer.
+ */
+#define LINKED_LIST_POOL_TYPE(NAME, TYPE, SLAB_SIZE) \
+struct NAME##_elem { \
+  TYPE data; \
+  struct NAME##_elem* next; \
+  struct NAME##_elem* prev; \
+};\
+struct NAME##_slab { \
+  struct NAME##_slab* next; \
+  struct NAME##_elem nodes[SLAB_SIZE]; \
+}; \
+struct NAME { \
+  struct NAME##_elem* start; \
+  struct NAME##_elem* end; \
+  size_t size; \
+  /* Every slab allocated by this list, most recent first */ \
+  struct NAME##_slab* slabs; \
+  /* The number of nodes handed out from the most recent slab */ \
+  size_t slab_used; \
+  /* Nodes that have been removed and can be reused */ \
+  struct NAME##_elem* free_nodes; \
+};
+
+/**
+ * INTERNAL USE MACRO: Node allocation hooks, forwarding to malloc and free
+ */
+#define LINKED_LIST_MALLOC_HOOKS(NAME) \
+  static inline struct NAME##_elem* NAME##_node_alloc(struct NAME* l) { \
+    (void) l; \
+    return malloc(sizeof(struct NAME##_elem)); \
+  } \
+  static inline void NAME##_node_release(struct NAME* l, struct NAME##_elem* node) { \
+    (void) l; \
+    free(node); \
+  }
+
+/**
+ * INTERNAL USE MACRO: Node allocation hooks, forwarding to l->allocator
+ */
+#define LINKED_LIST_ALLOCATOR_HOOKS(NAME) \
+  static inline struct NAME##_elem* NAME##_node_alloc(struct NAME* l) { \
+    return bl_allocator_realloc(l->allocator, NULL, 0, sizeof(struct NAME##_elem)); \
+  } \
+  static inline void NAME##_node_release(struct NAME* l, struct NAME##_elem* node) { \
+    bl_allocator_free(l->allocator, node, sizeof(struct NAME##_elem)); \
+  }
+
+/**
+ * INTERNAL USE MACRO: Node allocation hooks for pooled lists.
+ * Recycled nodes are preferred, then unused nodes of the current slab, and only
+ * once both are exhausted is a new slab allocated.
+ */
+#define LINKED_LIST_POOL_HOOKS(NAME, SLAB_SIZE) \
+  static inline struct NAME##_elem* NAME##_node_alloc(struct NAME* l) { \
+    if (l->free_nodes) { \
+      struct NAME##_elem* node = l->free_nodes; \
+      l->free_nodes = node->next; \
+      return node; \
+    } \
+    if (!l->slabs || l->slab_used == SLAB_SIZE) { \
+      struct NAME##_slab* slab = malloc(sizeof(struct NAME##_slab)); \
+      slab->next = l->slabs; \
+      l->slabs = slab; \
+      l->slab_used = 0; \
+    } \
+    return &l->slabs->nodes[l->slab_used++]; \
+  } \
+  static inline void NAME##_node_release(struct NAME* l, struct NAME##_elem* node) { \
+    node->next = l->free_nodes; \
+    l->free_nodes = node; \
+  }
+
 #define LINKED_LIST_INIT(NAME) \
   static inline void NAME##_init(struct NAME* l) { \
     memset(l, 0, sizeof(struct NAME)); \
   }
 
+/**
+ * _init_with prepares an allocator aware list, taking nodes from the supplied allocator.
+ * _init uses bl_malloc_allocator.
+ */
+#define LINKED_LIST_ALLOCATOR_INIT(NAME) \
+  static inline void NAME##_init_with(struct NAME* l, struct bl_allocator const* allocator) { \
+    memset(l, 0, sizeof(struct NAME)); \
+    l->allocator = allocator; \
+  } \
+  static inline void NAME##_init(struct NAME* l) { \
+    NAME##_init_with(l, &bl_malloc_allocator); \
+  }
+
 #define LINKED_LIST_FREE(NAME) \
   static inline void NAME##_free(struct NAME* l) { \
     struct NAME##_elem* head = l->start; \
     struct NAME##_elem* next; \
     while (head) { \
       next = head->next; \
-      free(head); \
+      NAME##_node_release(l, head); \
       head = next; \
     } \
     memset(l, 0, sizeof(struct NAME)); \
   }
 
 
+/**
+ * _free for pooled lists releases every slab at once, without walking the list.
+ */
+#define LINKED_LIST_POOL_FREE(NAME) \
+  static inline void NAME##_free(struct NAME* l) { \
+    struct NAME##_slab* slab = l->slabs; \
+    struct NAME##_slab* next; \
+    while (slab) { \
+      next = slab->next; \
+      free(slab); \
+      slab = next; \
+    } \
+    memset(l, 0, sizeof(struct NAME)); \
+  }
+
 #define LINKED_LIST_PREPEND(NAME, TYPE) \
   static inline void NAME##_prepend(struct NAME* l, TYPE v) { \
-    struct NAME##_elem* new_node = malloc(sizeof(struct NAME##_elem)); \
+    struct NAME##_elem* new_node = NAME##_node_alloc(l); \
     new_node->prev = NULL; \
     new_node->next = l->start; \
     new_node->data = v; \
@@ -55,6 +191,65 @@ struct NAME { \
     l->size += 1; \
   }
 
+/**
+ * _append adds an element to the end of the list.
+ */
+#define LINKED_LIST_APPEND(NAME, TYPE) \
+  static inline void NAME##_append(struct NAME* l, TYPE v) { \
+    struct NAME##_elem* new_node = NAME##_node_alloc(l); \
+    new_node->next = NULL; \
+    new_node->prev = l->end; \
+    new_node->data = v; \
+    if (l->end) { \
+      l->end->next = new_node; \
+    } \
+    l->end = new_node; \
+    if (!l->start) { \
+      l->start = new_node; \
+    } \
+    l->size += 1; \
+  }
+
+/**
+ * _remove unlinks a node from the list, releases it, and returns its data.
+ * The node must belong to this list and may not be used afterwards.
+ */
+#define LINKED_LIST_REMOVE(NAME, TYPE) \
+  static inline TYPE NAME##_remove(struct NAME* l, struct NAME##_elem* node) { \
+    if (node->prev) { \
+      node->prev->next = node->next; \
+    } else { \
+      l->start = node->next; \
+    } \
+    if (node->next) { \
+      node->next->prev = node->prev; \
+    } else { \
+      l->end = node->prev; \
+    } \
+    TYPE r = node->data; \
+    NAME##_node_release(l, node); \
+    l->size -= 1; \
+    return r; \
+  }
+
+/**
+ * _pop_front and _pop_back remove the first or last element of the list and return it.
+ * Popping from an empty list is an illegal operation.
+ */
+#define LINKED_LIST_POP(NAME, TYPE) \
+  static inline TYPE NAME##_pop_front(struct NAME* l) { \
+    if (!l->start) { \
+      LINKED_LIST_ILLEGAL_OP("pop_front an empty list"); \
+    } \
+    return NAME##_remove(l, l->start); \
+  } \
+  static inline TYPE NAME##_pop_back(struct NAME* l) { \
+    if (!l->end) { \
+      LINKED_LIST_ILLEGAL_OP("pop_back an empty list"); \
+    } \
+    return NAME##_remove(l, l->end); \
+  }
+
 #define LINKED_LIST_ITER(NAME) struct NAME##_elem* NAME##_iter(struct NAME* l) { \
   return l->start; \
 }
@@ -65,9 +260,37 @@ struct NAME { \
 
 #define CREATE_LINKED_LIST(NAME, TYPE) \
   LINKED_LIST_TYPE(NAME, TYPE) \
+  LINKED_LIST_MALLOC_HOOKS(NAME) \
   LINKED_LIST_INIT(NAME) \
   LINKED_LIST_FREE(NAME) \
   LINKED_LIST_PREPEND(NAME, TYPE) \
+  LINKED_LIST_APPEND(NAME, TYPE) \
+  LINKED_LIST_REMOVE(NAME, TYPE) \
+  LINKED_LIST_POP(NAME, TYPE) \
+  LINKED_LIST_ITER(NAME) \
+  LINKED_LIST_SIZE(NAME)
+
+#define CREATE_LINKED_LIST_ALLOCATOR(NAME, TYPE) \
+  LINKED_LIST_ALLOCATOR_TYPE(NAME, TYPE) \
+  LINKED_LIST_ALLOCATOR_HOOKS(NAME) \
+  LINKED_LIST_ALLOCATOR_INIT(NAME) \
+  LINKED_LIST_FREE(NAME) \
+  LINKED_LIST_PREPEND(NAME, TYPE) \
+  LINKED_LIST_APPEND(NAME, TYPE) \
+  LINKED_LIST_REMOVE(NAME, TYPE) \
+  LINKED_LIST_POP(NAME, TYPE) \
+  LINKED_LIST_ITER(NAME) \
+  LINKED_LIST_SIZE(NAME)
+
+#define CREATE_LINKED_LIST_POOL(NAME, TYPE, SLAB_SIZE) \
+  LINKED_LIST_POOL_TYPE(NAME, TYPE, SLAB_SIZE) \
+  LINKED_LIST_POOL_HOOKS(NAME, SLAB_SIZE) \
+  LINKED_LIST_INIT(NAME) \
+  LINKED_LIST_POOL_FREE(NAME) \
+  LINKED_LIST_PREPEND(NAME, TYPE) \
+  LINKED_LIST_APPEND(NAME, TYPE) \
+  LINKED_LIST_REMOVE(NAME, TYPE) \
+  LINKED_LIST_POP(NAME, TYPE) \
   LINKED_LIST_ITER(NAME) \
   LINKED_LIST_SIZE(NAME)
 
@@ -0,0 +1,446 @@
+#ifndef _BLAKE_PARALLEL_H_
+#define _BLAKE_PARALLEL_H_
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bllist.h"
+
+/**
+ * An optional work-stealing thread pool, and parallel loops, reductions and sorts over
+ * dynamic arrays built on top of it. Including this header requires linking with pthreads.
+ *
+ * The pool runs one job at a time. A job is a function called once for every index in
+ * [0, n). Indices are dealt out to every thread as an equal contiguous range, and each
+ * thread works through its own range from the front. A thread that runs out of work steals
+ * the back half of another thread's remaining range. Uneven work is therefore rebalanced,
+ * while a thread that is never robbed touches only its own indices and its own lock.
+ *
+ * The thread submitting a job takes part in it and returns when every index has run. A job
+ * submitted from inside a running job, on any pool, runs serially on the calling thread
+ * rather than deadlocking.
+ */
+
+/// The default number of elements processed by a single task of the parallel array operations
+#ifndef BL_PARALLEL_GRAIN
+#define BL_PARALLEL_GRAIN 4096
+#endif
+
+/**
+ * The range of job indices owned by a thread. Slots are padded to a cache line so that
+ * threads working on their own range do not contend with each other.
+ */
+struct bl_pool_slot {
+  pthread_mutex_t lock;
+  size_t begin;
+  size_t end;
+  char pad[64];
+};
+
+struct bl_pool {
+  /* The number of threads that take part in a job, including the caller */
+  size_t num_threads;
+  /* The number of elements processed by each task of the parallel array operations */
+  size_t grain;
+  pthread_t* threads;
+  struct bl_pool_slot* slots;
+  /* Held for the duration of a job so that jobs from different threads are serialized */
+  pthread_mutex_t submit;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t done;
+  size_t generation;
+  size_t active;
+  bool stop;
+  void (*job_fn)(void* ctx, size_t index);
+  void* job_ctx;
+};
+
+/// Set while a thread is executing a job, so that nested jobs run inline
+static _Thread_local bool bl_pool_in_job = false;
+
+/**
+ * INTERNAL CALL: Takes the next index of a thread's own range.
+ */
+static inline bool bl_pool_take(struct bl_pool_slot* slot, size_t* index) {
+  bool found = false;
+  pthread_mutex_lock(&slot->lock);
+  if (slot->begin < slot->end) {
+    *index = slot->begin++;
+    found = true;
+  }
+  pthread_mutex_unlock(&slot->lock);
+  return found;
+}
+
+/**
+ * INTERNAL CALL: Moves the back half of another thread's remaining range into a thread's
+ * own slot. Returns false if every other slot is empty.
+ */
+static inline bool bl_pool_steal(struct bl_pool* pool, size_t self) {
+  for (size_t i = 1; i < pool->num_threads; i++) {
+    struct bl_pool_slot* victim = &pool->slots[(self + i) % pool->num_threads];
+    pthread_mutex_lock(&victim->lock);
+    size_t remaining = victim->end - victim->begin;
+    if (remaining == 0) {
+      pthread_mutex_unlock(&victim->lock);
+      continue;
+    }
+    size_t take = (remaining + 1) / 2;
+    size_t end = victim->end;
+    victim->end -= take;
+    pthread_mutex_unlock(&victim->lock);
+    struct bl_pool_slot* slot = &pool->slots[self];
+    pthread_mutex_lock(&slot->lock);
+    slot->begin = end - take;
+    slot->end = end;
+    pthread_mutex_unlock(&slot->lock);
+    return true;
+  }
+  return false;
+}
+
+/**
+ * INTERNAL CALL: Runs indices of the current job until there are none left to take or steal.
+ */
+static inline void bl_pool_participate(struct bl_pool* pool, size_t self) {
+  bl_pool_in_job = true;
+  for (;;) {
+    size_t index;
+    if (bl_pool_take(&pool->slots[self], &index)) {
+      pool->job_fn(pool->job_ctx, index);
+    } else if (!bl_pool_steal(pool, self)) {
+      break;
+    }
+  }
+  bl_pool_in_job = false;
+}
+
+struct bl_pool_worker_arg {
+  struct bl_pool* pool;
+  size_t self;
+};
+
+/**
+ * INTERNAL CALL: The loop of each pool thread, which waits for a new job and takes part in it.
+ */
+static inline void* bl_pool_worker(void* varg) {
+  struct bl_pool_worker_arg arg = *(struct bl_pool_worker_arg*) varg;
+  free(varg);
+  struct bl_pool* pool = arg.pool;
+  size_t seen = 0;
+  pthread_mutex_lock(&pool->lock);
+  for (;;) {
+    while (pool->generation == seen && !pool->stop) {
+      pthread_cond_wait(&pool->wake, &pool->lock);
+    }
+    if (pool->stop) {
+      break;
+    }
+    seen = pool->generation;
+    pthread_mutex_unlock(&pool->lock);
+    bl_pool_participate(pool, arg.self);
+    pthread_mutex_lock(&pool->lock);
+    pool->active -= 1;
+    if (pool->active == 0) {
+      pthread_cond_signal(&pool->done);
+    }
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+/**
+ * bl_pool_init starts a pool in which num_threads threads, including the caller of each
+ * job, take part in jobs. If num_threads is 0 the number of online processors is used.
+ * The grain of the parallel array operations starts at BL_PARALLEL_GRAIN and can be
+ * changed through pool->grain between jobs.
+ */
+static inline void bl_pool_init(struct bl_pool* pool, size_t num_threads) {
+  if (num_threads == 0) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    num_threads = online > 0 ? (size_t) online : 1;
+  }
+  memset(pool, 0, sizeof(struct bl_pool));
+  pool->num_threads = num_threads;
+  pool->grain = BL_PARALLEL_GRAIN;
+  pthread_mutex_init(&pool->submit, NULL);
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->wake, NULL);
+  pthread_cond_init(&pool->done, NULL);
+  pool->slots = calloc(num_threads, sizeof(struct bl_pool_slot));
+  for (size_t i = 0; i < num_threads; i++) {
+    pthread_mutex_init(&pool->slots[i].lock, NULL);
+  }
+  /* Slot 0 belongs to the thread that submits a job */
+  pool->threads = malloc(sizeof(pthread_t) * num_threads);
+  for (size_t i = 1; i < num_threads; i++) {
+    struct bl_pool_worker_arg* arg = malloc(sizeof(struct bl_pool_worker_arg));
+    arg->pool = pool;
+    arg->self = i;
+    pthread_create(&pool->threads[i], NULL, bl_pool_worker, arg);
+  }
+}
+
+/**
+ * bl_pool_free stops and joins the threads of a pool. It must not be called during a job.
+ */
+static inline void bl_pool_free(struct bl_pool* pool) {
+  pthread_mutex_lock(&pool->lock);
+  pool->stop = true;
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+  for (size_t i = 1; i < pool->num_threads; i++) {
+    pthread_join(pool->threads[i], NULL);
+  }
+  for (size_t i = 0; i < pool->num_threads; i++) {
+    pthread_mutex_destroy(&pool->slots[i].lock);
+  }
+  pthread_cond_destroy(&pool->done);
+  pthread_cond_destroy(&pool->wake);
+  pthread_mutex_destroy(&pool->lock);
+  pthread_mutex_destroy(&pool->submit);
+  free(pool->slots);
+  free(pool->threads);
+  memset(pool, 0, sizeof(struct bl_pool));
+}
+
+/**
+ * bl_pool_run calls fn(ctx, i) for every i in [0, n) across the threads of the pool and
+ * returns once all calls have completed. Calls may run in any order and concurrently.
+ */
+static inline void bl_pool_run(struct bl_pool* pool, void (*fn)(void* ctx, size_t index), void* ctx, size_t n) {
+  if (n == 0) {
+    return;
+  }
+  if (bl_pool_in_job || pool->num_threads == 1 || n == 1) {
+    for (size_t i = 0; i < n; i++) {
+      fn(ctx, i);
+    }
+    return;
+  }
+  pthread_mutex_lock(&pool->submit);
+  for (size_t i = 0; i < pool->num_threads; i++) {
+    pthread_mutex_lock(&pool->slots[i].lock);
+    pool->slots[i].begin = (n * i) / pool->num_threads;
+    pool->slots[i].end = (n * (i + 1)) / pool->num_threads;
+    pthread_mutex_unlock(&pool->slots[i].lock);
+  }
+  pthread_mutex_lock(&pool->lock);
+  pool->job_fn = fn;
+  pool->job_ctx = ctx;
+  pool->active = pool->num_threads - 1;
+  pool->generation += 1;
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+  bl_pool_participate(pool, 0);
+  pthread_mutex_lock(&pool->lock);
+  while (pool->active > 0) {
+    pthread_cond_wait(&pool->done, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  pthread_mutex_unlock(&pool->submit);
+}
+
+/**
+ * INTERNAL CALL: The number of tasks needed to cover n elements at a given grain.
+ */
+static inline size_t bl_pool_num_tasks(size_t n, size_t grain) {
+  grain = grain ? grain : BL_PARALLEL_GRAIN;
+  return (n + grain - 1) / grain;
+}
+
+/**
+ * _parallel_for calls fn(&l->data[i], i, ctx) for every element of an array, in parallel
+ * tasks of pool->grain elements. fn may modify the element it is given but must not
+ * change the size of the array.
+ */
+#define DYNAMIC_ARRAY_PARALLEL_FOR(NAME, TYPE) \
+  typedef void (*NAME##_parallel_for_fn_t)(TYPE* v, size_t index, void* ctx); \
+  struct NAME##_parallel_for_job { \
+    TYPE* data; \
+    size_t n; \
+    size_t grain; \
+    NAME##_parallel_for_fn_t fn; \
+    void* ctx; \
+  }; \
+  static inline void NAME##_parallel_for_task(void* vjob, size_t task) { \
+    struct NAME##_parallel_for_job* job = vjob; \
+    size_t end = (task + 1) * job->grain < job->n ? (task + 1) * job->grain : job->n; \
+    for (size_t i = task * job->grain; i < end; i++) { \
+      job->fn(&job->data[i], i, job->ctx); \
+    } \
+  } \
+  static inline void NAME##_parallel_for(struct bl_pool* pool, struct NAME* l, NAME##_parallel_for_fn_t fn, void* ctx) { \
+    struct NAME##_parallel_for_job job = { l->data, l->current, pool->grain ? pool->grain : BL_PARALLEL_GRAIN, fn, ctx }; \
+    bl_pool_run(pool, NAME##_parallel_for_task, &job, bl_pool_num_tasks(job.n, job.grain)); \
+  }
+
+/**
+ * _parallel_reduce folds every element of an array into a single value, starting from
+ * identity and combining with fn(acc, v, ctx).
+ *
+ * The array is split into tasks of pool->grain elements. Each task folds its elements in
+ * order from identity, and the results of the tasks are then folded in order on the calling
+ * thread. The order of every combination therefore depends only on the grain, not on the
+ * number of threads or how tasks were scheduled, so the result is reproducible even when fn
+ * is not exactly associative (e.g, floating point addition).
+ */
+#define DYNAMIC_ARRAY_PARALLEL_REDUCE(NAME, TYPE) \
+  typedef TYPE (*NAME##_parallel_reduce_fn_t)(TYPE acc, TYPE v, void* ctx); \
+  struct NAME##_parallel_reduce_job { \
+    TYPE* data; \
+    size_t n; \
+    size_t grain; \
+    TYPE identity; \
+    TYPE* partials; \
+    NAME##_parallel_reduce_fn_t fn; \
+    void* ctx; \
+  }; \
+  static inline void NAME##_parallel_reduce_task(void* vjob, size_t task) { \
+    struct NAME##_parallel_reduce_job* job = vjob; \
+    size_t end = (task + 1) * job->grain < job->n ? (task + 1) * job->grain : job->n; \
+    TYPE acc = job->identity; \
+    for (size_t i = task * job->grain; i < end; i++) { \
+      acc = job->fn(acc, job->data[i], job->ctx); \
+    } \
+    job->partials[task] = acc; \
+  } \
+  static inline TYPE NAME##_parallel_reduce(struct bl_pool* pool, struct NAME* l, TYPE identity, NAME##_parallel_reduce_fn_t fn, void* ctx) { \
+    size_t grain = pool->grain ? pool->grain : BL_PARALLEL_GRAIN; \
+    size_t tasks = bl_pool_num_tasks(l->current, grain); \
+    struct NAME##_parallel_reduce_job job = { l->data, l->current, grain, identity, malloc(sizeof(TYPE) * (tasks + 1)), fn, ctx }; \
+    bl_pool_run(pool, NAME##_parallel_reduce_task, &job, tasks); \
+    TYPE acc = identity; \
+    for (size_t i = 0; i < tasks; i++) { \
+      acc = fn(acc, job.partials[i], ctx); \
+    } \
+    free(job.partials); \
+    return acc; \
+  }
+
+/**
+ * _parallel_sort sorts an array with CMP_FN using every thread of a pool. It requires
+ * DYNAMIC_ARRAY_SORT(NAME, TYPE, CMP_FN) to be declared first.
+ *
+ * The array is split into one run per thread and each run is sorted with _sort's
+ * introsort. Runs are then merged in pairs into a scratch buffer of l->current elements
+ * until one run remains. Every pairwise merge is itself split into tasks of about
+ * pool->grain output elements, by binary searching for where each task's output begins in
+ * the two inputs, so the final merges are as parallel as the first. Like _sort, the sort
+ * is not stable.
+ */
+#define DYNAMIC_ARRAY_PARALLEL_SORT(NAME, TYPE, CMP_FN) \
+  struct NAME##_merge_task { \
+    /* The two sorted inputs */ \
+    TYPE* a; \
+    size_t a_len; \
+    TYPE* b; \
+    size_t b_len; \
+    TYPE* out; \
+    /* The range of the merged output this task writes */ \
+    size_t begin; \
+    size_t end; \
+  }; \
+  struct NAME##_sort_job { \
+    TYPE* data; \
+    size_t* bounds; \
+    struct NAME##_merge_task* tasks; \
+  }; \
+  /* INTERNAL CALL: The number of elements of a among the first d outputs of merging a and b */ \
+  static inline size_t NAME##_merge_split(TYPE* a, size_t a_len, TYPE* b, size_t b_len, size_t d) { \
+    size_t low = d > b_len ? d - b_len : 0; \
+    size_t high = d < a_len ? d : a_len; \
+    while (low < high) { \
+      size_t mid = low + ((high - low) / 2); \
+      if (CMP_FN(a[mid], b[d - mid - 1]) <= 0) { \
+        low = mid + 1; \
+      } else { \
+        high = mid; \
+      } \
+    } \
+    return low; \
+  } \
+  static inline void NAME##_merge_task_run(void* vjob, size_t index) { \
+    struct NAME##_merge_task* t = &((struct NAME##_sort_job*) vjob)->tasks[index]; \
+    size_t i = NAME##_merge_split(t->a, t->a_len, t->b, t->b_len, t->begin); \
+    size_t j = t->begin - i; \
+    for (size_t d = t->begin; d < t->end; d++) { \
+      if (j >= t->b_len || (i < t->a_len && CMP_FN(t->a[i], t->b[j]) <= 0)) { \
+        t->out[d] = t->a[i++]; \
+      } else { \
+        t->out[d] = t->b[j++]; \
+      } \
+    } \
+  } \
+  static inline void NAME##_sort_run(void* vjob, size_t index) { \
+    struct NAME##_sort_job* job = vjob; \
+    size_t n = job->bounds[index + 1] - job->bounds[index]; \
+    size_t depth = 0; \
+    for (size_t k = n; k > 1; k >>= 1) { \
+      depth += 2; \
+    } \
+    NAME##_intro_sort(job->data + job->bounds[index], n, depth); \
+  } \
+  static inline void NAME##_parallel_sort(struct bl_pool* pool, struct NAME* l) { \
+    size_t n = l->current; \
+    size_t grain = pool->grain ? pool->grain : BL_PARALLEL_GRAIN; \
+    size_t runs = bl_pool_num_tasks(n, grain); \
+    runs = runs < pool->num_threads ? runs : pool->num_threads; \
+    if (runs <= 1) { \
+      NAME##_sort(l); \
+      return; \
+    } \
+    struct NAME##_sort_job job; \
+    job.data = l->data; \
+    job.bounds = malloc(sizeof(size_t) * (runs + 1)); \
+    for (size_t i = 0; i <= runs; i++) { \
+      job.bounds[i] = (n * i) / runs; \
+    } \
+    bl_pool_run(pool, NAME##_sort_run, &job, runs); \
+    TYPE* src = l->data; \
+    TYPE* dst = malloc(sizeof(TYPE) * n); \
+    TYPE* scratch = dst; \
+    /* Every output element is written by exactly one task, so there are at most this many */ \
+    job.tasks = malloc(sizeof(struct NAME##_merge_task) * (bl_pool_num_tasks(n, grain) + runs)); \
+    while (runs > 1) { \
+      size_t num_tasks = 0; \
+      size_t merged = 0; \
+      for (size_t r = 0; r < runs; r += 2) { \
+        size_t a_begin = job.bounds[r]; \
+        size_t b_begin = job.bounds[r + 1]; \
+        size_t b_end = r + 2 <= runs ? job.bounds[r + 2] : b_begin; \
+        for (size_t d = 0; d < b_end - a_begin; d += grain) { \
+          struct NAME##_merge_task* t = &job.tasks[num_tasks++]; \
+          t->a = src + a_begin; \
+          t->a_len = b_begin - a_begin; \
+          t->b = src + b_begin; \
+          t->b_len = b_end - b_begin; \
+          t->out = dst + a_begin; \
+          t->begin = d; \
+          t->end = d + grain < b_end - a_begin ? d + grain : b_end - a_begin; \
+        } \
+        job.bounds[merged++] = a_begin; \
+      } \
+      job.bounds[merged] = n; \
+      bl_pool_run(pool, NAME##_merge_task_run, &job, num_tasks); \
+      runs = merged; \
+      TYPE* t = src; \
+      src = dst; \
+      dst = t; \
+    } \
+    if (src != l->data) { \
+      memcpy(l->data, src, sizeof(TYPE) * n); \
+    } \
+    free(scratch); \
+    free(job.tasks); \
+    free(job.bounds); \
+  }
+
+#define DYNAMIC_ARRAY_PARALLEL(NAME, TYPE) \
+  DYNAMIC_ARRAY_PARALLEL_FOR(NAME, TYPE) \
+  DYNAMIC_ARRAY_PARALLEL_REDUCE(NAME, TYPE)
+
+#endif
@@ -0,0 +1,342 @@
+#ifndef _BLAKE_PHM_H_
+#define _BLAKE_PHM_H_
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdbool.h>
+#include "blhash.h"
+#include "blhm.h"
+
+/**
+ * HASH_MAP_FROZEN adds _freeze to a fixed bucket HASH_MAP (or any of its variants), which
+ * copies a populated map into an immutable table indexed by a perfect hash function, for
+ * maps that are built once and then only read.
+ *
+ * The perfect hash is built with the hash and displace method (CHD). Keys are split into
+ * groups of about HASH_MAP_FROZEN_GROUP_SIZE by their hash, and each group is given a
+ * pilot: a number which, mixed with the hash of each key in the group, sends every key to
+ * a different slot not already used by an earlier group. Groups are placed largest first,
+ * while most slots are still free. A lookup is then one pilot read, one slot read and one
+ * CMP_FN call, with no buckets to scan.
+ *
+ * There is one slot per key plus HASH_MAP_FROZEN_SLACK_PERCENT spare slots, which make the
+ * last groups much quicker to place. Spare slots hold a copy of a real entry, so a lookup
+ * for a missing key that lands on one simply fails the comparison.
+ *
+ * The table is a single allocation: a struct bl_frozen_header, the pilots and the slots,
+ * each section aligned to HASH_MAP_FROZEN_ALIGN bytes. Since it contains no pointers, it
+ * can be saved and memory-mapped with HASH_MAP_FROZEN_SNAPSHOT in blsnap.h.
+ *
+ * _freeze fails if HASH_FN returns the same value for two keys in the map, since no pilot
+ * could then separate them.
+ */
+
+/// Average number of keys sharing a pilot. Larger groups use less memory but take longer to place.
+#ifndef HASH_MAP_FROZEN_GROUP_SIZE
+#define HASH_MAP_FROZEN_GROUP_SIZE 4
+#endif
+
+/// Number of spare slots, as a percentage of the number of keys.
+#ifndef HASH_MAP_FROZEN_SLACK_PERCENT
+#define HASH_MAP_FROZEN_SLACK_PERCENT 1
+#endif
+
+/// Number of seeds tried before _freeze gives up.
+#define HASH_MAP_FROZEN_MAX_SEEDS 16
+
+/// Number of pilots tried for a group before _freeze moves on to the next seed.
+#define HASH_MAP_FROZEN_MAX_PILOT (1u << 24)
+
+/// Alignment of each section of a frozen table.
+#define HASH_MAP_FROZEN_ALIGN 64
+
+/**
+ * The start of a frozen table.
+ */
+struct bl_frozen_header {
+  /* Mixed into every key hash, changed when a table cannot be built with the previous seed */
+  uint64_t seed;
+  /* The number of pilots */
+  uint64_t groups;
+  /* The number of slots, zero only if the table is empty */
+  uint64_t slots;
+  /* The number of keys */
+  uint64_t count;
+};
+
+/**
+ * INTERNAL CALL: Maps a well mixed 64-bit value onto [0, n) with a multiply rather than a
+ * division.
+ */
+static inline uint64_t bl_frozen_reduce(uint64_t x, uint64_t n) {
+#ifdef __SIZEOF_INT128__
+  return (uint64_t) (((unsigned __int128) x * n) >> 64);
+#else
+  return x % n;
+#endif
+}
+
+/**
+ * INTERNAL CALL: The slot a key with hash h is sent to by a pilot. The pilot is mixed in
+ * before the final mix rather than after it, so that keys of a group which share their
+ * high bits are still sent to unrelated slots by different pilots.
+ */
+static inline uint64_t bl_frozen_slot(uint64_t h, uint32_t pilot, uint64_t slots) {
+  return bl_frozen_reduce(bl_hash_mix64(h ^ bl_hash_mix64((uint64_t) pilot + 1)), slots);
+}
+
+/**
+ * INTERNAL CALL: Rounds a position in a frozen table up to the next section, and returns
+ * the position of the slots in a table with a given number of pilots. The pilots always
+ * start at HASH_MAP_FROZEN_ALIGN.
+ */
+static inline size_t bl_frozen_align(size_t pos) {
+  return (pos + (HASH_MAP_FROZEN_ALIGN - 1)) & ~(size_t) (HASH_MAP_FROZEN_ALIGN - 1);
+}
+
+static inline size_t bl_frozen_slots_offset(uint64_t groups) {
+  return bl_frozen_align(HASH_MAP_FROZEN_ALIGN + sizeof(uint32_t) * groups);
+}
+
+/**
+ * INTERNAL CALL: Tries to place every key with a given seed, writing the pilots on success.
+ * hashes holds HASH_FN of each key, and slot_of receives the slot of each key.
+ * Returns 1 on success, 0 if the seed failed, and -1 if two keys have the same hash.
+ */
+static inline int bl_frozen_place(uint64_t const* hashes, size_t n, uint64_t seed, uint64_t groups, uint64_t slots, uint32_t* pilots, size_t* slot_of) {
+  int result = 1;
+  uint64_t* mixed = malloc(sizeof(uint64_t) * n);
+  size_t* group_start = calloc(groups + 2, sizeof(size_t));
+  size_t* by_group = malloc(sizeof(size_t) * n);
+  uint64_t* taken = calloc((slots + 63) / 64, sizeof(uint64_t));
+  size_t max_size = 0;
+  for (size_t i = 0; i < n; i++) {
+    mixed[i] = bl_hash_mix64(hashes[i] ^ seed);
+    group_start[bl_frozen_reduce(mixed[i], groups) + 2] += 1;
+  }
+  /* Counting sort the keys by group */
+  for (size_t g = 0; g < groups; g++) {
+    if (group_start[g + 2] > max_size) {
+      max_size = group_start[g + 2];
+    }
+    group_start[g + 2] += group_start[g + 1];
+  }
+  for (size_t i = 0; i < n; i++) {
+    by_group[group_start[bl_frozen_reduce(mixed[i], groups) + 1]++] = i;
+  }
+  /* group g now holds by_group[group_start[g], group_start[g + 1]) */
+  size_t* size_start = calloc(max_size + 2, sizeof(size_t));
+  size_t* order = malloc(sizeof(size_t) * groups);
+  uint64_t* placed = malloc(sizeof(uint64_t) * (max_size + 1));
+  /* Counting sort the groups by size, largest first */
+  for (size_t g = 0; g < groups; g++) {
+    size_start[max_size - (group_start[g + 1] - group_start[g]) + 1] += 1;
+  }
+  for (size_t s = 0; s < max_size; s++) {
+    size_start[s + 1] += size_start[s];
+  }
+  for (size_t g = 0; g < groups; g++) {
+    order[size_start[max_size - (group_start[g + 1] - group_start[g])]++] = g;
+  }
+  for (size_t o = 0; o < groups && result == 1; o++) {
+    size_t g = order[o];
+    size_t begin = group_start[g];
+    size_t size = group_start[g + 1] - begin;
+    if (!size) {
+      pilots[g] = 0;
+      continue;
+    }
+    for (size_t i = 0; i < size && result == 1; i++) {
+      for (size_t j = i + 1; j < size; j++) {
+        if (mixed[by_group[begin + i]] == mixed[by_group[begin + j]]) {
+          result = -1;
+          break;
+        }
+      }
+    }
+    uint32_t pilot = 0;
+    for (; result == 1; pilot++) {
+      if (pilot == HASH_MAP_FROZEN_MAX_PILOT) {
+        result = 0;
+        break;
+      }
+      size_t k = 0;
+      for (; k < size; k++) {
+        uint64_t slot = bl_frozen_slot(mixed[by_group[begin + k]], pilot, slots);
+        if (taken[slot / 64] & ((uint64_t) 1 << (slot % 64))) {
+          break;
+        }
+        taken[slot / 64] |= (uint64_t) 1 << (slot % 64);
+        placed[k] = slot;
+      }
+      if (k == size) {
+        pilots[g] = pilot;
+        for (size_t i = 0; i < size; i++) {
+          slot_of[by_group[begin + i]] = placed[i];
+        }
+        break;
+      }
+      /* Undo a partial placement, including keys of the group that collided with each other */
+      for (size_t i = 0; i < k; i++) {
+        taken[placed[i] / 64] &= ~((uint64_t) 1 << (placed[i] % 64));
+      }
+    }
+  }
+  free(mixed);
+  free(group_start);
+  free(by_group);
+  free(taken);
+  free(size_start);
+  free(order);
+  free(placed);
+  return result;
+}
+
+/**
+ * The frozen table. table points to the header at the start of the table, and pilots and
+ * slots into it. block is the allocation owning the table, or NULL if the table is owned by
+ * something else (such as a memory mapping).
+ */
+#define HASH_MAP_FROZEN_TYPE(NAME) \
+  typedef struct NAME##_frozen { \
+    struct bl_frozen_header const* table; \
+    uint32_t const* pilots; \
+    struct NAME##_entry const* slots; \
+    void* block; \
+  } NAME##_frozen_t;
+
+/**
+ * INTERNAL CALL: Returns HASH_FN of a key.
+ */
+#define HASH_MAP_FROZEN_KEY_HASH(NAME, KEY_TYPE, HASH_FN) \
+  static inline uint64_t NAME##_frozen_key_hash(KEY_TYPE key) { \
+    return (uint64_t) HASH_FN(key); \
+  }
+
+/**
+ * _frozen_attach points a frozen map at a table produced by _freeze which starts at table
+ * and is length bytes long. The table is not copied and must outlive the frozen map.
+ * Returns false if length is too short for the table described by its header.
+ */
+#define HASH_MAP_FROZEN_ATTACH(NAME) \
+  static inline bool NAME##_frozen_attach(struct NAME##_frozen* f, void const* table, size_t length) { \
+    memset(f, 0, sizeof(struct NAME##_frozen)); \
+    struct bl_frozen_header const* header = table; \
+    if (length < HASH_MAP_FROZEN_ALIGN || header->groups == 0 || \
+        header->groups > (length - HASH_MAP_FROZEN_ALIGN) / sizeof(uint32_t) || \
+        bl_frozen_slots_offset(header->groups) > length || \
+        header->slots < header->count || \
+        header->slots > (length - bl_frozen_slots_offset(header->groups)) / sizeof(struct NAME##_entry)) { \
+      return false; \
+    } \
+    f->table = header; \
+    f->pilots = (uint32_t const*) ((char const*) table + HASH_MAP_FROZEN_ALIGN); \
+    f->slots = (struct NAME##_entry const*) ((char const*) table + bl_frozen_slots_offset(header->groups)); \
+    return true; \
+  } \
+  static inline size_t NAME##_frozen_table_size(struct NAME##_frozen* f) { \
+    return bl_frozen_slots_offset(f->table->groups) + sizeof(struct NAME##_entry) * f->table->slots; \
+  }
+
+/**
+ * _freeze builds a frozen copy of every entry in map into f, which is released with
+ * _frozen_free. The map is left unchanged and may be freed afterwards.
+ * Returns false, leaving f empty, if HASH_FN gives two keys the same hash.
+ */
+#define HASH_MAP_FROZEN_FREEZE(NAME) \
+  static inline bool NAME##_freeze(struct NAME* map, struct NAME##_frozen* f) { \
+    memset(f, 0, sizeof(struct NAME##_frozen)); \
+    size_t n = NAME##_count(map); \
+    uint64_t groups = n / HASH_MAP_FROZEN_GROUP_SIZE + 1; \
+    uint64_t slots = n ? n + (n * HASH_MAP_FROZEN_SLACK_PERCENT) / 100 + 1 : 0; \
+    struct NAME##_entry const** entries = malloc(sizeof(struct NAME##_entry*) * (n + 1)); \
+    uint64_t* hashes = malloc(sizeof(uint64_t) * (n + 1)); \
+    size_t* slot_of = malloc(sizeof(size_t) * (n + 1)); \
+    size_t i = 0; \
+    HASH_MAP_FOREACH(NAME, map, e) { \
+      entries[i] = e; \
+      hashes[i] = NAME##_frozen_key_hash(e->key); \
+      i += 1; \
+    } \
+    size_t length = bl_frozen_slots_offset(groups) + sizeof(struct NAME##_entry) * slots; \
+    char* block = calloc(1, length); \
+    struct bl_frozen_header* header = (struct bl_frozen_header*) block; \
+    uint32_t* pilots = (uint32_t*) (block + HASH_MAP_FROZEN_ALIGN); \
+    struct NAME##_entry* out = (struct NAME##_entry*) (block + bl_frozen_slots_offset(groups)); \
+    int placed = 0; \
+    for (uint64_t attempt = 0; attempt < HASH_MAP_FROZEN_MAX_SEEDS && placed == 0; attempt++) { \
+      header->seed = bl_hash_mix64(attempt + 1); \
+      placed = n ? bl_frozen_place(hashes, n, header->seed, groups, slots, pilots, slot_of) : 1; \
+    } \
+    if (placed == 1) { \
+      header->groups = groups; \
+      header->slots = slots; \
+      header->count = n; \
+      for (size_t s = 0; s < slots; s++) { \
+        out[s] = *entries[0]; \
+      } \
+      for (size_t k = 0; k < n; k++) { \
+        out[slot_of[k]] = *entries[k]; \
+      } \
+      NAME##_frozen_attach(f, block, length); \
+      f->block = block; \
+    } else { \
+      free(block); \
+    } \
+    free(entries); \
+    free(hashes); \
+    free(slot_of); \
+    return placed == 1; \
+  }
+
+/**
+ * _frozen_find_ptr returns a pointer to the data of a key in a frozen map, or NULL if the
+ * key is not present. The data is read-only. _frozen_find copies the data to *data if the
+ * key is present and data is not NULL, returning whether the key was present.
+ */
+#define HASH_MAP_FROZEN_FIND(NAME, KEY_TYPE, DATA_TYPE, CMP_FN) \
+  static inline DATA_TYPE const* NAME##_frozen_find_ptr(struct NAME##_frozen* f, KEY_TYPE key) { \
+    struct bl_frozen_header const* header = f->table; \
+    if (!header || !header->slots) { \
+      return NULL; \
+    } \
+    uint64_t hash = bl_hash_mix64(NAME##_frozen_key_hash(key) ^ header->seed); \
+    uint32_t pilot = f->pilots[bl_frozen_reduce(hash, header->groups)]; \
+    struct NAME##_entry const* entry = &f->slots[bl_frozen_slot(hash, pilot, header->slots)]; \
+    return CMP_FN(key, entry->key) ? NULL : &entry->data; \
+  } \
+  static inline bool NAME##_frozen_find(struct NAME##_frozen* f, KEY_TYPE key, DATA_TYPE* data) { \
+    DATA_TYPE const* ptr = NAME##_frozen_find_ptr(f, key); \
+    if (ptr && data) { \
+      *data = *ptr; \
+    } \
+    return ptr != NULL; \
+  }
+
+/**
+ * _frozen_count returns the number of keys in a frozen map, and _frozen_free releases a
+ * table built by _freeze.
+ */
+#define HASH_MAP_FROZEN_FREE(NAME) \
+  static inline size_t NAME##_frozen_count(struct NAME##_frozen* f) { \
+    return f->table ? f->table->count : 0; \
+  } \
+  static inline void NAME##_frozen_free(struct NAME##_frozen* f) { \
+    free(f->block); \
+    memset(f, 0, sizeof(struct NAME##_frozen)); \
+  }
+
+/**
+ * Declares _freeze and the frozen map NAME_frozen for an existing map NAME, which must have
+ * been declared by HASH_MAP or one of its fixed bucket variants with the same arguments.
+ */
+#define HASH_MAP_FROZEN(NAME, KEY_TYPE, DATA_TYPE, HASH_FN, CMP_FN) \
+  HASH_MAP_FROZEN_TYPE(NAME) \
+  HASH_MAP_FROZEN_KEY_HASH(NAME, KEY_TYPE, HASH_FN) \
+  HASH_MAP_FROZEN_ATTACH(NAME) \
+  HASH_MAP_FROZEN_FREEZE(NAME) \
+  HASH_MAP_FROZEN_FIND(NAME, KEY_TYPE, DATA_TYPE, CMP_FN) \
+  HASH_MAP_FROZEN_FREE(NAME)
+
+#endif
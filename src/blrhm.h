@@ -0,0 +1,397 @@
+#ifndef _BLAKE_RHM_H_
+#define _BLAKE_RHM_H_
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdbool.h>
+#include "blhash.h"
+
+/**
+ * This robin hood hash map is an open-addressing alternative to the chained HASH_MAP in
+ * blhm.h, built for tables that are kept very full (up to 90% by default) while still
+ * needing a predictable worst-case lookup.
+ *
+ * Entries are stored inline in a single slot array, and alongside it is an array holding the
+ * probe distance of each slot: how far the entry sits from its home slot, plus one, with zero
+ * marking an empty slot. Keys are placed by linear probing, but an insert that reaches an
+ * entry closer to its home slot than the key being inserted takes that slot and carries the
+ * displaced entry onwards instead ("robin hood" insertion). This keeps the distances of all
+ * entries close to the average, so the longest probe sequence stays short even at high load.
+ *
+ * Because entries along a probe sequence are ordered by distance, a lookup can stop as soon
+ * as it reaches a slot whose distance is lower than its own, so a failed lookup costs about
+ * as much as a successful one. Removal shifts the following entries of the cluster back by
+ * one slot rather than leaving a tombstone, so the table never degrades under churn.
+ *
+ * The generated API mirrors HASH_MAP (_set, _find, _find_ptr, _remove, _change_key,
+ * _count and _delete_matching) so that switching between the two is a one line change.
+ *
+ * The user supplied HASH_FN is mixed before use, so identity hashes on integer keys
+ * still spread across the table. HASH_FN must not map tens of thousands of keys to the
+ * same value, since they would all have to share one probe sequence.
+ */
+
+/// Percentage of slots that may be filled before the table doubles in size.
+#ifndef ROBIN_HOOD_MAP_MAX_LOAD_PERCENT
+#define ROBIN_HOOD_MAP_MAX_LOAD_PERCENT 90
+#endif
+
+/**
+ * Longest probe sequence an insert may create before the table grows instead, bounding the
+ * cost of every lookup. This is only enforced once the table is at least 1/8th full, so a
+ * poor HASH_FN cannot make a small table grow without limit.
+ */
+#ifndef ROBIN_HOOD_MAP_MAX_PROBE
+#define ROBIN_HOOD_MAP_MAX_PROBE 128
+#endif
+
+/// Number of slots allocated by the first insert into an empty map.
+#define ROBIN_HOOD_MAP_INITIAL_CAPACITY 16
+
+/**
+ * The map structure holds the distance array and the slot array. Both are NULL until
+ * the first insert, so an initialized but unused map does not allocate.
+ */
+#define ROBIN_HOOD_MAP_TYPE(NAME, KEY_TYPE, DATA_TYPE) \
+  typedef struct NAME##_entry { \
+    KEY_TYPE key; \
+    DATA_TYPE data; \
+  } NAME##_entry_t; \
+  typedef struct NAME { \
+    /* Distance of each slot from its home slot plus one, or zero if the slot is empty */ \
+    uint16_t* dist; \
+    /* The slot array, only slots with a non-zero distance are initialized */ \
+    struct NAME##_entry* slots; \
+    /* Number of slots, always zero or a power of two */ \
+    size_t capacity; \
+    /* Number of used slots */ \
+    size_t count; \
+    /* Largest distance placed since the table was last rehashed */ \
+    size_t max_probe; \
+  } NAME##_t;
+
+/**
+ * _init puts a map structure into a state where it is ready to include elements.
+ * This function must be called before the hashmap is used.
+ */
+#define ROBIN_HOOD_MAP_INIT(NAME) \
+  static inline void NAME##_init(struct NAME* map) { \
+    memset(map, 0, sizeof(struct NAME)); \
+  }
+
+/**
+ * _free free's any memory associated with the hash map.
+ * NOTE: This does not free underlying memory in cases
+ * where DATA_TYPE is a pointer. That is left to the user
+ */
+#define ROBIN_HOOD_MAP_FREE(NAME) \
+  static inline void NAME##_free(struct NAME* map) { \
+    free(map->dist); \
+    free(map->slots); \
+    memset(map, 0, sizeof(struct NAME)); \
+  }
+
+/**
+ * INTERNAL CALL: Returns the mixed hash of a key.
+ */
+#define ROBIN_HOOD_MAP_HASH(NAME, KEY_TYPE, HASH_FN) \
+  static inline uint64_t NAME##_mixed_hash(KEY_TYPE key) { \
+    return bl_hash_fold((uint64_t) HASH_FN(key)); \
+  }
+
+/**
+ * INTERNAL CALL: Places *carried, which has reached slot idx at distance d, using robin
+ * hood insertion. Whenever an entry closer to its home slot is found, the two swap and the
+ * displaced entry is carried onwards.
+ *
+ * Returns false if the entry being carried would need a distance greater than limit. In
+ * that case *carried holds the entry still to be placed (which may no longer be the one
+ * passed in) and every other entry is in a valid position.
+ */
+#define ROBIN_HOOD_MAP_PLACE(NAME) \
+  static inline bool NAME##_place(struct NAME* map, size_t idx, uint16_t d, struct NAME##_entry* carried, uint16_t limit) { \
+    size_t mask = map->capacity - 1; \
+    for (;; d++, idx = (idx + 1) & mask) { \
+      uint16_t slot_dist = map->dist[idx]; \
+      if (d > map->max_probe) { \
+        map->max_probe = d; \
+      } \
+      if (slot_dist == 0) { \
+        map->dist[idx] = d; \
+        map->slots[idx] = *carried; \
+        return true; \
+      } \
+      if (slot_dist < d) { \
+        struct NAME##_entry tmp = map->slots[idx]; \
+        map->slots[idx] = *carried; \
+        map->dist[idx] = d; \
+        *carried = tmp; \
+        d = slot_dist; \
+      } \
+      if (d >= limit) { \
+        return false; \
+      } \
+    } \
+  }
+
+/**
+ * INTERNAL CALL: Re-allocates the table with new_capacity slots and re-inserts every
+ * element. The capacity doubles again in the unlikely event that an entry cannot be
+ * placed within the largest representable distance.
+ */
+#define ROBIN_HOOD_MAP_RESIZE(NAME) \
+  static inline void NAME##_resize(struct NAME* map, size_t new_capacity) { \
+    uint16_t* old_dist = map->dist; \
+    struct NAME##_entry* old_slots = map->slots; \
+    size_t old_capacity = map->capacity; \
+    for (bool placed = false; !placed; new_capacity *= 2) { \
+      map->dist = calloc(new_capacity, sizeof(uint16_t)); \
+      map->slots = malloc(sizeof(struct NAME##_entry) * new_capacity); \
+      map->capacity = new_capacity; \
+      map->max_probe = 0; \
+      placed = true; \
+      for (size_t i = 0; i < old_capacity && placed; i++) { \
+        if (old_dist[i]) { \
+          struct NAME##_entry e = old_slots[i]; \
+          size_t home = NAME##_mixed_hash(e.key) & (new_capacity - 1); \
+          placed = NAME##_place(map, home, 1, &e, UINT16_MAX); \
+        } \
+      } \
+      if (!placed) { \
+        free(map->dist); \
+        free(map->slots); \
+      } \
+    } \
+    free(old_dist); \
+    free(old_slots); \
+  }
+
+/**
+ * INTERNAL CALL: Returns the slot index holding a key, or SIZE_MAX if it is not present.
+ * The probe stops at the first slot whose entry is closer to its home slot than the key
+ * would be, since robin hood insertion would have placed the key there.
+ */
+#define ROBIN_HOOD_MAP_FIND_SLOT(NAME, KEY_TYPE, CMP_FN) \
+  static inline size_t NAME##_find_slot(struct NAME* map, KEY_TYPE key) { \
+    if (!map->capacity) { \
+      return SIZE_MAX; \
+    } \
+    size_t mask = map->capacity - 1; \
+    size_t idx = NAME##_mixed_hash(key) & mask; \
+    for (uint16_t d = 1;; d++, idx = (idx + 1) & mask) { \
+      uint16_t slot_dist = map->dist[idx]; \
+      if (slot_dist < d) { \
+        return SIZE_MAX; \
+      } \
+      if (slot_dist == d && !CMP_FN(key, map->slots[idx].key)) { \
+        return idx; \
+      } \
+    } \
+  }
+
+/**
+ * _find_ptr returns a pointer to any matching element inside the map or NULL otherwise.
+ * If find_ptr finds an element, then updating the element by dereferencing will change
+ * the underlying value in the map.
+ *
+ * WARNING: find_ptr is not stable between inserts or deletions since both move entries.
+ */
+#define ROBIN_HOOD_MAP_FIND_PTR(NAME, KEY_TYPE, DATA_TYPE) \
+  static inline DATA_TYPE* NAME##_find_ptr(struct NAME* map, KEY_TYPE key) { \
+    size_t idx = NAME##_find_slot(map, key); \
+    return idx == SIZE_MAX ? NULL : &map->slots[idx].data; \
+  }
+
+/**
+ * _find returns true or false if an element with a given key exists inside the map.
+ * The data argument will be ignored if set to NULL or the element does not exist
+ * within the map, otherwise the pointed value will be set to the value with
+ * the corresponding key (*data = *NAME_find_ptr(map, key)).
+ */
+#define ROBIN_HOOD_MAP_FIND(NAME, KEY_TYPE, DATA_TYPE) \
+  static inline bool NAME##_find(struct NAME* map, KEY_TYPE key, DATA_TYPE* data) { \
+    DATA_TYPE* ptr = NAME##_find_ptr(map, key); \
+    if (ptr) { \
+      if (data) { \
+        *data = *ptr; \
+      } \
+      return true; \
+    } else { \
+      return false; \
+    } \
+  }
+
+/**
+ * INTERNAL CALL: Empties slot idx by backward shift. Each following entry of the cluster
+ * that is not in its home slot moves back by one, until an empty slot or an entry in its
+ * home slot is reached, so no tombstone is needed.
+ */
+#define ROBIN_HOOD_MAP_ERASE_SLOT(NAME) \
+  static inline void NAME##_erase_slot(struct NAME* map, size_t idx) { \
+    size_t mask = map->capacity - 1; \
+    size_t next = (idx + 1) & mask; \
+    while (map->dist[next] > 1) { \
+      map->slots[idx] = map->slots[next]; \
+      map->dist[idx] = map->dist[next] - 1; \
+      idx = next; \
+      next = (next + 1) & mask; \
+    } \
+    map->dist[idx] = 0; \
+    map->count -= 1; \
+  }
+
+/**
+ * _remove removes the key-value pair with a given key from the map, if present.
+ */
+#define ROBIN_HOOD_MAP_REMOVE(NAME, KEY_TYPE) \
+  static inline void NAME##_remove(struct NAME* map, KEY_TYPE key) { \
+    size_t idx = NAME##_find_slot(map, key); \
+    if (idx != SIZE_MAX) { \
+      NAME##_erase_slot(map, idx); \
+    } \
+  }
+
+/**
+ * _set places the supplied key-value pair into the hash map.
+ *
+ * If this key is in the map then _set replaces the value associated with
+ * that key with the supplied value.
+ *
+ * Otherwise the key is inserted by robin hood insertion, found in the same probe that
+ * checked for an existing key. The table doubles in size first if the insert would take
+ * it past ROBIN_HOOD_MAP_MAX_LOAD_PERCENT, or afterwards if the insert would create a
+ * probe sequence longer than ROBIN_HOOD_MAP_MAX_PROBE.
+ */
+#define ROBIN_HOOD_MAP_SET(NAME, KEY_TYPE, DATA_TYPE, CMP_FN) \
+  static inline void NAME##_set(struct NAME* map, KEY_TYPE key, DATA_TYPE val) { \
+    if (!map->capacity) { \
+      NAME##_resize(map, ROBIN_HOOD_MAP_INITIAL_CAPACITY); \
+    } \
+    uint64_t hash = NAME##_mixed_hash(key); \
+    size_t mask = map->capacity - 1; \
+    size_t idx = hash & mask; \
+    uint16_t d = 1; \
+    for (;; d++, idx = (idx + 1) & mask) { \
+      uint16_t slot_dist = map->dist[idx]; \
+      if (slot_dist < d) { \
+        break; \
+      } \
+      if (slot_dist == d && !CMP_FN(key, map->slots[idx].key)) { \
+        map->slots[idx].data = val; \
+        return; \
+      } \
+    } \
+    if ((map->count + 1) * 100 > map->capacity * ROBIN_HOOD_MAP_MAX_LOAD_PERCENT) { \
+      NAME##_resize(map, map->capacity * 2); \
+      mask = map->capacity - 1; \
+      idx = hash & mask; \
+      d = 1; \
+    } \
+    struct NAME##_entry carried = { key, val }; \
+    map->count += 1; \
+    while (!NAME##_place(map, idx, d, &carried, \
+          map->count >= map->capacity / 8 ? ROBIN_HOOD_MAP_MAX_PROBE : UINT16_MAX)) { \
+      NAME##_resize(map, map->capacity * 2); \
+      idx = NAME##_mixed_hash(carried.key) & (map->capacity - 1); \
+      d = 1; \
+    } \
+  }
+
+/**
+ * _change_key replaces the key of a key-value pair with a new one.
+ *
+ * If there is no value with a given key in the map then this call will do nothing.
+ */
+#define ROBIN_HOOD_MAP_CHANGE_KEY(NAME, KEY_TYPE, DATA_TYPE) \
+  static inline void NAME##_change_key(struct NAME* map, KEY_TYPE current_key, KEY_TYPE new_key) { \
+    size_t idx = NAME##_find_slot(map, current_key); \
+    if (idx != SIZE_MAX) { \
+      DATA_TYPE val = map->slots[idx].data; \
+      NAME##_erase_slot(map, idx); \
+      NAME##_set(map, new_key, val); \
+    } \
+  }
+
+/**
+ * This macro creates a method which will delete any elements in the map which match a predicate.
+ *
+ * The delete callback is called once for every single element in the hashmap. If the callback
+ * returns true for a given element then that element will be removed from the map.
+ *
+ * The post callback will be called after a method has been removed from the map, so that a cleanup
+ * function may safely be called. If the post callback is NULL we ignore it.
+ *
+ * The scan starts just after an empty slot so that no entry can be shifted back past the
+ * start, and after a removal the same slot is checked again since the next entry of the
+ * cluster may have been shifted into it. Every entry is therefore visited exactly once.
+ */
+#define ROBIN_HOOD_MAP_DELETE_MATCHING(NAME) \
+  typedef bool (* NAME##_delete_callback_ptr_t)(struct NAME##_entry* v); \
+  typedef void (* NAME##_post_delete_callback_ptr_t)(struct NAME##_entry* v); \
+  static inline void NAME##_delete_matching(struct NAME* l, NAME##_delete_callback_ptr_t matches, NAME##_post_delete_callback_ptr_t post) { \
+    if (!l->count) { \
+      return; \
+    } \
+    size_t mask = l->capacity - 1; \
+    size_t start = 0; \
+    while (l->dist[start]) { \
+      start++; \
+    } \
+    for (size_t i = 1; i < l->capacity; i++) { \
+      size_t idx = (start + i) & mask; \
+      while (l->dist[idx] && matches(&l->slots[idx])) { \
+        struct NAME##_entry nval = l->slots[idx]; \
+        NAME##_erase_slot(l, idx); \
+        if (post) { \
+          post(&nval); \
+        } \
+      } \
+    } \
+  }
+
+/**
+ * _count returns the total number of elements in the map.
+ */
+#define ROBIN_HOOD_MAP_COUNT(NAME) \
+  static inline size_t NAME##_count(struct NAME* l) { \
+    return l->count; \
+  }
+
+/**
+ * _capacity returns the number of slots currently allocated by the map.
+ */
+#define ROBIN_HOOD_MAP_CAPACITY(NAME) \
+  static inline size_t NAME##_capacity(struct NAME* l) { \
+    return l->capacity; \
+  }
+
+/**
+ * _max_probe returns an upper bound on the number of slots any lookup will inspect, which
+ * is the longest probe sequence created since the table last grew.
+ */
+#define ROBIN_HOOD_MAP_MAX_PROBE_LENGTH(NAME) \
+  static inline size_t NAME##_max_probe(struct NAME* l) { \
+    return l->max_probe; \
+  }
+
+#define ROBIN_HOOD_MAP(NAME, KEY_TYPE, DATA_TYPE, HASH_FN, CMP_FN) \
+  ROBIN_HOOD_MAP_TYPE(NAME, KEY_TYPE, DATA_TYPE); \
+  ROBIN_HOOD_MAP_INIT(NAME) \
+  ROBIN_HOOD_MAP_FREE(NAME) \
+  ROBIN_HOOD_MAP_HASH(NAME, KEY_TYPE, HASH_FN) \
+  ROBIN_HOOD_MAP_PLACE(NAME) \
+  ROBIN_HOOD_MAP_RESIZE(NAME) \
+  ROBIN_HOOD_MAP_FIND_SLOT(NAME, KEY_TYPE, CMP_FN) \
+  ROBIN_HOOD_MAP_FIND_PTR(NAME, KEY_TYPE, DATA_TYPE) \
+  ROBIN_HOOD_MAP_FIND(NAME, KEY_TYPE, DATA_TYPE) \
+  ROBIN_HOOD_MAP_ERASE_SLOT(NAME) \
+  ROBIN_HOOD_MAP_REMOVE(NAME, KEY_TYPE) \
+  ROBIN_HOOD_MAP_SET(NAME, KEY_TYPE, DATA_TYPE, CMP_FN) \
+  ROBIN_HOOD_MAP_CHANGE_KEY(NAME, KEY_TYPE, DATA_TYPE) \
+  ROBIN_HOOD_MAP_DELETE_MATCHING(NAME) \
+  ROBIN_HOOD_MAP_COUNT(NAME) \
+  ROBIN_HOOD_MAP_CAPACITY(NAME) \
+  ROBIN_HOOD_MAP_MAX_PROBE_LENGTH(NAME)
+
+#endif
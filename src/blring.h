@@ -0,0 +1,155 @@
+#ifndef _BLAKE_RING_H_
+#define _BLAKE_RING_H_
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+/**
+ * RING_BUFFER declares a fixed capacity FIFO queue of CAPACITY elements stored inline in
+ * the structure, so the queue never allocates. CAPACITY must be a power of two.
+ *
+ * The queue is safe without locks when there is a single producer thread (calling _push
+ * and _push_n) and a single consumer thread (calling _pop and _pop_n). It can equally be
+ * used as a plain queue by one thread.
+ *
+ * head and tail are free running counters of the elements popped and pushed, so the size
+ * of the queue is tail - head and a counter is mapped to a slot by masking. Each side only
+ * writes its own counter and publishes it with a release store, which the other side reads
+ * with an acquire load before touching the slots it covers.
+ *
+ * The consumer's fields and the producer's fields are separated by padding so that they
+ * never share a cache line, and each side keeps a cached copy of the other's counter. The
+ * other side's cache line is therefore only read when the cached copy says the queue looks
+ * full (producer) or empty (consumer), rather than on every operation. The batched
+ * _push_n and _pop_n move many elements for a single counter update.
+ */
+#define RING_BUFFER_TYPE(NAME, TYPE, CAPACITY) \
+  typedef struct NAME { \
+    /* Written by the consumer */ \
+    atomic_size_t head; \
+    size_t cached_tail; \
+    char pad0[64]; \
+    /* Written by the producer */ \
+    atomic_size_t tail; \
+    size_t cached_head; \
+    char pad1[64]; \
+    TYPE data[CAPACITY]; \
+  } NAME##_t; \
+  _Static_assert((CAPACITY) > 0 && ((CAPACITY) & ((CAPACITY) - 1)) == 0, "RING_BUFFER capacity must be a power of two");
+
+/**
+ * _init puts a ring buffer into an empty state. This must not be called while another
+ * thread is using the buffer.
+ */
+#define RING_BUFFER_INIT(NAME) \
+  static inline void NAME##_init(struct NAME* rb) { \
+    atomic_init(&rb->head, 0); \
+    atomic_init(&rb->tail, 0); \
+    rb->cached_head = 0; \
+    rb->cached_tail = 0; \
+  }
+
+/**
+ * _push adds an element to the back of the queue. Producer only.
+ * Returns false, without adding the element, if the queue is full.
+ */
+#define RING_BUFFER_PUSH(NAME, TYPE, CAPACITY) \
+  static inline bool NAME##_push(struct NAME* rb, TYPE v) { \
+    size_t tail = atomic_load_explicit(&rb->tail, memory_order_relaxed); \
+    if (tail - rb->cached_head == (CAPACITY)) { \
+      rb->cached_head = atomic_load_explicit(&rb->head, memory_order_acquire); \
+      if (tail - rb->cached_head == (CAPACITY)) { \
+        return false; \
+      } \
+    } \
+    rb->data[tail & ((CAPACITY) - 1)] = v; \
+    atomic_store_explicit(&rb->tail, tail + 1, memory_order_release); \
+    return true; \
+  }
+
+/**
+ * _pop removes the element at the front of the queue and copies it to *out. Consumer only.
+ * Returns false if the queue is empty.
+ */
+#define RING_BUFFER_POP(NAME, TYPE, CAPACITY) \
+  static inline bool NAME##_pop(struct NAME* rb, TYPE* out) { \
+    size_t head = atomic_load_explicit(&rb->head, memory_order_relaxed); \
+    if (head == rb->cached_tail) { \
+      rb->cached_tail = atomic_load_explicit(&rb->tail, memory_order_acquire); \
+      if (head == rb->cached_tail) { \
+        return false; \
+      } \
+    } \
+    *out = rb->data[head & ((CAPACITY) - 1)]; \
+    atomic_store_explicit(&rb->head, head + 1, memory_order_release); \
+    return true; \
+  }
+
+/**
+ * _push_n adds up to n elements from items to the back of the queue, as many as there is
+ * space for. Producer only. Returns the number of elements added.
+ */
+#define RING_BUFFER_PUSH_N(NAME, TYPE, CAPACITY) \
+  static inline size_t NAME##_push_n(struct NAME* rb, TYPE const* items, size_t n) { \
+    size_t tail = atomic_load_explicit(&rb->tail, memory_order_relaxed); \
+    size_t space = (CAPACITY) - (tail - rb->cached_head); \
+    if (space < n) { \
+      rb->cached_head = atomic_load_explicit(&rb->head, memory_order_acquire); \
+      space = (CAPACITY) - (tail - rb->cached_head); \
+    } \
+    n = n < space ? n : space; \
+    size_t idx = tail & ((CAPACITY) - 1); \
+    size_t first = n < (CAPACITY) - idx ? n : (CAPACITY) - idx; \
+    memcpy(&rb->data[idx], items, sizeof(TYPE) * first); \
+    memcpy(&rb->data[0], items + first, sizeof(TYPE) * (n - first)); \
+    atomic_store_explicit(&rb->tail, tail + n, memory_order_release); \
+    return n; \
+  }
+
+/**
+ * _pop_n removes up to n elements from the front of the queue into out, as many as are
+ * available. Consumer only. Returns the number of elements removed.
+ */
+#define RING_BUFFER_POP_N(NAME, TYPE, CAPACITY) \
+  static inline size_t NAME##_pop_n(struct NAME* rb, TYPE* out, size_t n) { \
+    size_t head = atomic_load_explicit(&rb->head, memory_order_relaxed); \
+    size_t available = rb->cached_tail - head; \
+    if (available < n) { \
+      rb->cached_tail = atomic_load_explicit(&rb->tail, memory_order_acquire); \
+      available = rb->cached_tail - head; \
+    } \
+    n = n < available ? n : available; \
+    size_t idx = head & ((CAPACITY) - 1); \
+    size_t first = n < (CAPACITY) - idx ? n : (CAPACITY) - idx; \
+    memcpy(out, &rb->data[idx], sizeof(TYPE) * first); \
+    memcpy(out + first, &rb->data[0], sizeof(TYPE) * (n - first)); \
+    atomic_store_explicit(&rb->head, head + n, memory_order_release); \
+    return n; \
+  }
+
+/**
+ * _size returns the number of elements in the queue. When called while the other side is
+ * running the result may be out of date by the time it is returned.
+ */
+#define RING_BUFFER_SIZE(NAME, CAPACITY) \
+  static inline size_t NAME##_size(struct NAME* rb) { \
+    size_t head = atomic_load_explicit(&rb->head, memory_order_acquire); \
+    size_t tail = atomic_load_explicit(&rb->tail, memory_order_acquire); \
+    return tail - head; \
+  } \
+  static inline size_t NAME##_capacity(struct NAME* rb) { \
+    (void) rb; \
+    return (CAPACITY); \
+  }
+
+#define RING_BUFFER(NAME, TYPE, CAPACITY) \
+  RING_BUFFER_TYPE(NAME, TYPE, CAPACITY) \
+  RING_BUFFER_INIT(NAME) \
+  RING_BUFFER_PUSH(NAME, TYPE, CAPACITY) \
+  RING_BUFFER_POP(NAME, TYPE, CAPACITY) \
+  RING_BUFFER_PUSH_N(NAME, TYPE, CAPACITY) \
+  RING_BUFFER_POP_N(NAME, TYPE, CAPACITY) \
+  RING_BUFFER_SIZE(NAME, CAPACITY)
+
+#endif
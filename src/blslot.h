@@ -0,0 +1,270 @@
+#ifndef _BLAKE_SLOT_H_
+#define _BLAKE_SLOT_H_
+#include <stdint.h>
+#include <stdbool.h>
+#include "bllist.h"
+#include "blhm.h"
+
+/**
+ * A slot map stores values densely in a dynamic array and hands out 64-bit handles to
+ * them. Unlike a pointer from HASH_MAP's _find_ptr, a handle stays valid for as long as
+ * the element it refers to is in the map, however many other elements are inserted or
+ * erased, and looking a handle up is two array reads with no hashing or comparisons.
+ *
+ * A handle holds the index of a slot in its low 32 bits and the generation of that slot in
+ * its high 32 bits. Each slot records where its value currently sits in the dense array
+ * and its own generation, which is odd while the slot is in use and even while it is free.
+ * Erasing an element bumps the generation of its slot, so handles to it stop matching, and
+ * moves the last value into the gap to keep the values dense. Free slots are kept in a
+ * list and reused by later inserts.
+ *
+ * Because the values are dense, iterating over _data(map)[0 .. _count(map)) touches only
+ * live values. Pointers into the values are invalidated by inserts and erases in the same
+ * way as a DYNAMIC_ARRAY, so hold handles rather than pointers across modifications.
+ *
+ * A slot's generation wraps after 2^31 reuses, at which point a very old handle to that
+ * slot could match again.
+ */
+
+/// A handle that never refers to an element, since generation 0 is never in use.
+#define SLOT_MAP_NULL_HANDLE ((uint64_t) 0)
+
+/// Marks the end of the free slot list.
+#define SLOT_MAP_NO_SLOT UINT32_MAX
+
+/// Block size of the arrays backing a slot map.
+#define SLOT_MAP_BLOCK_SIZE 16
+
+/**
+ * The map holds the dense values, the slot owning each value (so that a moved value's
+ * slot can be updated), and the slots themselves.
+ */
+#define SLOT_MAP_TYPE(NAME, TYPE) \
+  struct NAME##_slot { \
+    /* The index of the slot's value in the dense array, or the next free slot */ \
+    uint32_t index; \
+    /* Odd while the slot is in use, even while it is free */ \
+    uint32_t generation; \
+  }; \
+  DYNAMIC_ARRAY(NAME##_values, TYPE, SLOT_MAP_BLOCK_SIZE); \
+  DYNAMIC_ARRAY(NAME##_owners, uint32_t, SLOT_MAP_BLOCK_SIZE); \
+  DYNAMIC_ARRAY(NAME##_slots, struct NAME##_slot, SLOT_MAP_BLOCK_SIZE); \
+  typedef struct NAME { \
+    struct NAME##_values values; \
+    struct NAME##_owners owners; \
+    struct NAME##_slots slots; \
+    /* The first free slot, or SLOT_MAP_NO_SLOT */ \
+    uint32_t free_head; \
+  } NAME##_t;
+
+/**
+ * _init puts a slot map into an empty state. An empty slot map does not allocate.
+ */
+#define SLOT_MAP_INIT(NAME) \
+  static inline void NAME##_init(struct NAME* map) { \
+    NAME##_values_init_lazy(&map->values); \
+    NAME##_owners_init_lazy(&map->owners); \
+    NAME##_slots_init_lazy(&map->slots); \
+    map->free_head = SLOT_MAP_NO_SLOT; \
+  }
+
+/**
+ * _free free's any memory associated with the slot map.
+ * NOTE: This does not free underlying memory in cases
+ * where TYPE is a pointer. That is left to the user
+ */
+#define SLOT_MAP_FREE(NAME) \
+  static inline void NAME##_free(struct NAME* map) { \
+    NAME##_values_free(&map->values); \
+    NAME##_owners_free(&map->owners); \
+    NAME##_slots_free(&map->slots); \
+    map->free_head = SLOT_MAP_NO_SLOT; \
+  }
+
+/**
+ * INTERNAL CALL: Returns the slot a handle refers to, or NULL if the handle is stale or
+ * was never issued by this map.
+ */
+#define SLOT_MAP_GET_SLOT(NAME) \
+  static inline struct NAME##_slot* NAME##_get_slot(struct NAME* map, uint64_t handle) { \
+    uint32_t idx = (uint32_t) handle; \
+    uint32_t generation = (uint32_t) (handle >> 32); \
+    if (idx >= map->slots.current) { \
+      return NULL; \
+    } \
+    struct NAME##_slot* slot = &map->slots.data[idx]; \
+    if (slot->generation != generation || !(generation & 1)) { \
+      return NULL; \
+    } \
+    return slot; \
+  }
+
+/**
+ * _insert adds a value to the map and returns its handle.
+ */
+#define SLOT_MAP_INSERT(NAME, TYPE) \
+  static inline uint64_t NAME##_insert(struct NAME* map, TYPE v) { \
+    uint32_t idx = map->free_head; \
+    if (idx != SLOT_MAP_NO_SLOT) { \
+      map->free_head = map->slots.data[idx].index; \
+      map->slots.data[idx].generation += 1; \
+    } else { \
+      if (map->slots.current >= SLOT_MAP_NO_SLOT) { \
+        LIST_ILLEGAL_OP("slot map is full"); \
+      } \
+      idx = (uint32_t) map->slots.current; \
+      struct NAME##_slot fresh = { 0, 1 }; \
+      NAME##_slots_push(&map->slots, fresh); \
+    } \
+    struct NAME##_slot* slot = &map->slots.data[idx]; \
+    slot->index = (uint32_t) map->values.current; \
+    NAME##_values_push(&map->values, v); \
+    NAME##_owners_push(&map->owners, idx); \
+    return ((uint64_t) slot->generation << 32) | idx; \
+  }
+
+/**
+ * _get returns a pointer to the value a handle refers to, or NULL if it has been erased.
+ * WARNING: The pointer is invalidated by the next _insert or _erase, the handle is not.
+ */
+#define SLOT_MAP_GET(NAME, TYPE) \
+  static inline TYPE* NAME##_get(struct NAME* map, uint64_t handle) { \
+    struct NAME##_slot* slot = NAME##_get_slot(map, handle); \
+    return slot ? &map->values.data[slot->index] : NULL; \
+  } \
+  static inline bool NAME##_contains(struct NAME* map, uint64_t handle) { \
+    return NAME##_get_slot(map, handle) != NULL; \
+  }
+
+/**
+ * _erase removes the value a handle refers to. Returns false if the handle was stale.
+ * The last value in the dense array is moved into the gap, so this is O(1).
+ */
+#define SLOT_MAP_ERASE(NAME) \
+  static inline bool NAME##_erase(struct NAME* map, uint64_t handle) { \
+    struct NAME##_slot* slot = NAME##_get_slot(map, handle); \
+    if (!slot) { \
+      return false; \
+    } \
+    uint32_t index = slot->index; \
+    NAME##_values_swap_remove(&map->values, index); \
+    NAME##_owners_swap_remove(&map->owners, index); \
+    if (index < map->owners.current) { \
+      map->slots.data[map->owners.data[index]].index = index; \
+    } \
+    slot->generation += 1; \
+    slot->index = map->free_head; \
+    map->free_head = (uint32_t) handle; \
+    return true; \
+  }
+
+/**
+ * _count returns the number of values in the map, and _data the dense array holding them.
+ * _handle_at returns the handle of the value at a given index of the dense array.
+ */
+#define SLOT_MAP_DATA(NAME, TYPE) \
+  static inline size_t NAME##_count(struct NAME* map) { \
+    return map->values.current; \
+  } \
+  static inline TYPE* NAME##_data(struct NAME* map) { \
+    return map->values.data; \
+  } \
+  static inline uint64_t NAME##_handle_at(struct NAME* map, size_t index) { \
+    uint32_t idx = map->owners.data[index]; \
+    return ((uint64_t) map->slots.data[idx].generation << 32) | idx; \
+  }
+
+#define SLOT_MAP(NAME, TYPE) \
+  SLOT_MAP_TYPE(NAME, TYPE) \
+  SLOT_MAP_INIT(NAME) \
+  SLOT_MAP_FREE(NAME) \
+  SLOT_MAP_GET_SLOT(NAME) \
+  SLOT_MAP_INSERT(NAME, TYPE) \
+  SLOT_MAP_GET(NAME, TYPE) \
+  SLOT_MAP_ERASE(NAME) \
+  SLOT_MAP_DATA(NAME, TYPE)
+
+/**
+ * KEYED_SLOT_MAP pairs a slot map of values with a HASH_MAP from keys to handles. The
+ * index only ever stores handles, which do not change when values move, so values stay
+ * densely packed for iteration while a key can be resolved to a handle once and the
+ * handle reused on hot paths without hashing again.
+ *
+ * Declares the SLOT_MAP NAME_values and the HASH_MAP NAME_index, both of which should only
+ * be modified through the methods below.
+ */
+#define KEYED_SLOT_MAP_TYPE(NAME) \
+  typedef struct NAME { \
+    struct NAME##_values values; \
+    struct NAME##_index index; \
+  } NAME##_t;
+
+#define KEYED_SLOT_MAP_INIT(NAME) \
+  static inline void NAME##_init(struct NAME* map) { \
+    NAME##_values_init(&map->values); \
+    NAME##_index_init(&map->index); \
+  } \
+  static inline void NAME##_free(struct NAME* map) { \
+    NAME##_values_free(&map->values); \
+    NAME##_index_free(&map->index); \
+  }
+
+/**
+ * _set places a value under a key and returns its handle. If the key is already present
+ * its value is replaced in place and its existing handle is returned.
+ */
+#define KEYED_SLOT_MAP_SET(NAME, KEY_TYPE, TYPE) \
+  static inline uint64_t NAME##_set(struct NAME* map, KEY_TYPE key, TYPE v) { \
+    uint64_t* handle = NAME##_index_find_ptr(&map->index, key); \
+    if (handle) { \
+      *NAME##_values_get(&map->values, *handle) = v; \
+      return *handle; \
+    } \
+    uint64_t h = NAME##_values_insert(&map->values, v); \
+    NAME##_index_set(&map->index, key, h); \
+    return h; \
+  }
+
+/**
+ * _handle returns the handle of a key, or SLOT_MAP_NULL_HANDLE if it is not present.
+ * _get returns the value of a handle, and _find_ptr the value of a key, or NULL.
+ */
+#define KEYED_SLOT_MAP_FIND(NAME, KEY_TYPE, TYPE) \
+  static inline uint64_t NAME##_handle(struct NAME* map, KEY_TYPE key) { \
+    uint64_t h; \
+    return NAME##_index_find(&map->index, key, &h) ? h : SLOT_MAP_NULL_HANDLE; \
+  } \
+  static inline TYPE* NAME##_get(struct NAME* map, uint64_t handle) { \
+    return NAME##_values_get(&map->values, handle); \
+  } \
+  static inline TYPE* NAME##_find_ptr(struct NAME* map, KEY_TYPE key) { \
+    uint64_t h; \
+    return NAME##_index_find(&map->index, key, &h) ? NAME##_values_get(&map->values, h) : NULL; \
+  }
+
+/**
+ * _remove removes a key and its value. Returns true if the key was present.
+ */
+#define KEYED_SLOT_MAP_REMOVE(NAME, KEY_TYPE) \
+  static inline bool NAME##_remove(struct NAME* map, KEY_TYPE key) { \
+    uint64_t h; \
+    if (!NAME##_index_take(&map->index, key, &h)) { \
+      return false; \
+    } \
+    NAME##_values_erase(&map->values, h); \
+    return true; \
+  } \
+  static inline size_t NAME##_count(struct NAME* map) { \
+    return NAME##_values_count(&map->values); \
+  }
+
+#define KEYED_SLOT_MAP(NAME, KEY_TYPE, TYPE, HASH_FN, CMP_FN, BUCKETS, BLOCK_SIZE) \
+  SLOT_MAP(NAME##_values, TYPE) \
+  HASH_MAP(NAME##_index, KEY_TYPE, uint64_t, HASH_FN, CMP_FN, BUCKETS, BLOCK_SIZE); \
+  KEYED_SLOT_MAP_TYPE(NAME) \
+  KEYED_SLOT_MAP_INIT(NAME) \
+  KEYED_SLOT_MAP_SET(NAME, KEY_TYPE, TYPE) \
+  KEYED_SLOT_MAP_FIND(NAME, KEY_TYPE, TYPE) \
+  KEYED_SLOT_MAP_REMOVE(NAME, KEY_TYPE)
+
+#endif
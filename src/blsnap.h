@@ -0,0 +1,358 @@
+#ifndef _BLAKE_SNAP_H_
+#define _BLAKE_SNAP_H_
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "bllist.h"
+#include "blhm.h"
+
+/**
+ * Snapshots write a DYNAMIC_ARRAY or HASH_MAP to a file in a flat layout that can later be
+ * mmap'd and read in place, so a large map can be reloaded without re-inserting anything.
+ * This header is optional and requires a POSIX system.
+ *
+ * Snapshots copy elements byte for byte, so they are only meaningful for plain old data
+ * element types: no pointers (including strings), and nothing that needs a destructor.
+ * Since struct padding is copied as well, element types without padding are preferred.
+ *
+ * The file starts with a struct bl_snapshot_header which records what was saved and the
+ * byte order and element size of the machine that saved it. Opening a snapshot checks all
+ * of these, and fails rather than misreading a file written by another type or machine.
+ * Every section starts at a multiple of BL_SNAPSHOT_ALIGN bytes, and all positions in the
+ * file are relative to its start, so the mapping can be placed at any address.
+ *
+ * An array snapshot is the header followed by the elements. A hash map snapshot is the
+ * header, then BUCKETS + 1 uint64_t offsets, then the entries of every bucket one after
+ * another: bucket i holds entries [offsets[i], offsets[i + 1]). A mapped hash map selects
+ * the bucket with the same _get_bucket as the live map, so the map must be reopened by a
+ * map declared with the same HASH_FN and BUCKETS, and HASH_FN must not depend on anything
+ * that changes between runs (such as the address of the key). Whether HASH_MAP_MASK_BUCKETS
+ * was defined is recorded too, and a program built the other way rejects the file.
+ *
+ * A frozen hash map snapshot (see blphm.h) is the header followed by the frozen table,
+ * which is already a single block with no pointers.
+ */
+
+/// Identifies a snapshot file.
+#define BL_SNAPSHOT_MAGIC "BLSNAP\0"
+
+/// Incremented whenever the file layout changes.
+#define BL_SNAPSHOT_VERSION 2
+
+/// Written in native byte order, so that a file from a machine with another byte order is rejected.
+#define BL_SNAPSHOT_BYTE_ORDER 0x01020304u
+
+/// Alignment of every section of a snapshot file.
+#define BL_SNAPSHOT_ALIGN 64
+
+/// The kinds of container a snapshot can hold.
+#define BL_SNAPSHOT_ARRAY 1
+#define BL_SNAPSHOT_HASH_MAP 2
+#define BL_SNAPSHOT_FROZEN_HASH_MAP 3
+
+/// Set in the flags of a hash map saved by a program built with HASH_MAP_MASK_BUCKETS.
+#define BL_SNAPSHOT_MASKED_BUCKETS 1u
+
+#ifdef HASH_MAP_MASK_BUCKETS
+#define BL_SNAPSHOT_BUCKET_FLAGS BL_SNAPSHOT_MASKED_BUCKETS
+#else
+#define BL_SNAPSHOT_BUCKET_FLAGS 0u
+#endif
+
+struct bl_snapshot_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t kind;
+  uint32_t byte_order;
+  /* sizeof the array element, or of the hash map entry */
+  uint32_t element_size;
+  /* The number of elements */
+  uint64_t count;
+  /* The number of buckets in a hash map, zero otherwise */
+  uint64_t buckets;
+  /* How a hash map selects buckets (BL_SNAPSHOT_MASKED_BUCKETS), zero otherwise */
+  uint32_t flags;
+  uint32_t reserved;
+};
+
+/**
+ * A read-only mapping of a snapshot file.
+ */
+struct bl_snapshot_mapping {
+  void* base;
+  size_t length;
+};
+
+/**
+ * INTERNAL CALL: Rounds a file position up to the next section boundary.
+ */
+static inline uint64_t bl_snapshot_align(uint64_t pos) {
+  return (pos + (BL_SNAPSHOT_ALIGN - 1)) & ~(uint64_t) (BL_SNAPSHOT_ALIGN - 1);
+}
+
+/**
+ * INTERNAL CALL: Writes len bytes to fd, retrying after short writes and interrupts.
+ */
+static inline bool bl_snapshot_write_all(int fd, void const* buf, size_t len) {
+  char const* p = buf;
+  while (len) {
+    ssize_t written = write(fd, p, len);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    p += written;
+    len -= (size_t) written;
+  }
+  return true;
+}
+
+/**
+ * INTERNAL CALL: Writes zeros to fd to move from file position pos to the next section.
+ */
+static inline bool bl_snapshot_write_padding(int fd, uint64_t pos) {
+  static char const zeros[BL_SNAPSHOT_ALIGN];
+  return bl_snapshot_write_all(fd, zeros, (size_t) (bl_snapshot_align(pos) - pos));
+}
+
+/**
+ * INTERNAL CALL: Writes a header describing a container, followed by padding to the first
+ * section. Returns false if the write failed.
+ */
+static inline bool bl_snapshot_write_header(int fd, uint32_t kind, size_t element_size, uint64_t count, uint64_t buckets) {
+  struct bl_snapshot_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, BL_SNAPSHOT_MAGIC, sizeof(header.magic));
+  header.version = BL_SNAPSHOT_VERSION;
+  header.kind = kind;
+  header.byte_order = BL_SNAPSHOT_BYTE_ORDER;
+  header.element_size = (uint32_t) element_size;
+  header.count = count;
+  header.buckets = buckets;
+  header.flags = kind == BL_SNAPSHOT_HASH_MAP ? BL_SNAPSHOT_BUCKET_FLAGS : 0;
+  return bl_snapshot_write_all(fd, &header, sizeof(header)) &&
+    bl_snapshot_write_padding(fd, sizeof(header));
+}
+
+/**
+ * INTERNAL CALL: Maps a snapshot file read-only and checks that its header matches the
+ * expected container, and that the file is long enough to hold the bucket offsets (for a
+ * hash map) and every element. Returns the header, or NULL (leaving nothing mapped) if the
+ * file cannot be mapped or does not match.
+ */
+static inline struct bl_snapshot_header const* bl_snapshot_open(struct bl_snapshot_mapping* m, char const* path, uint32_t kind, size_t element_size, uint64_t buckets) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (uint64_t) st.st_size < BL_SNAPSHOT_ALIGN) {
+    close(fd);
+    return NULL;
+  }
+  void* base = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    return NULL;
+  }
+  struct bl_snapshot_header const* header = base;
+  uint64_t body = (uint64_t) st.st_size - BL_SNAPSHOT_ALIGN;
+  uint64_t index_size = kind == BL_SNAPSHOT_HASH_MAP ? bl_snapshot_align((buckets + 1) * sizeof(uint64_t)) : 0;
+  if (memcmp(header->magic, BL_SNAPSHOT_MAGIC, sizeof(header->magic)) ||
+      header->version != BL_SNAPSHOT_VERSION ||
+      header->kind != kind ||
+      header->byte_order != BL_SNAPSHOT_BYTE_ORDER ||
+      header->element_size != element_size ||
+      header->buckets != buckets ||
+      header->flags != (kind == BL_SNAPSHOT_HASH_MAP ? BL_SNAPSHOT_BUCKET_FLAGS : 0) ||
+      body < index_size ||
+      header->count > (body - index_size) / element_size) {
+    munmap(base, (size_t) st.st_size);
+    return NULL;
+  }
+  m->base = base;
+  m->length = (size_t) st.st_size;
+  return header;
+}
+
+/**
+ * INTERNAL CALL: Releases a mapping made by bl_snapshot_open.
+ */
+static inline void bl_snapshot_close(struct bl_snapshot_mapping* m) {
+  if (m->base) {
+    munmap(m->base, m->length);
+  }
+  memset(m, 0, sizeof(*m));
+}
+
+/**
+ * DYNAMIC_ARRAY_SNAPSHOT declares _save and _open_mapped for a dynamic array NAME of TYPE,
+ * which must already be declared.
+ *
+ * _save(l, fd) writes the array to fd, which is left open, and returns false if a write
+ * failed. _open_mapped(m, path) maps a saved array into m, returning false if the file
+ * could not be mapped or was not saved from an array of TYPE. The elements are then
+ * available, read-only, through _mapped_data and _mapped_size until _mapped_close.
+ */
+#define DYNAMIC_ARRAY_SNAPSHOT(NAME, TYPE) \
+  typedef struct NAME##_mapped { \
+    struct bl_snapshot_mapping mapping; \
+    TYPE const* data; \
+    size_t current; \
+  } NAME##_mapped_t; \
+  static inline bool NAME##_save(struct NAME* l, int fd) { \
+    return bl_snapshot_write_header(fd, BL_SNAPSHOT_ARRAY, sizeof(TYPE), l->current, 0) && \
+      bl_snapshot_write_all(fd, l->data, sizeof(TYPE) * l->current); \
+  } \
+  static inline bool NAME##_open_mapped(struct NAME##_mapped* m, char const* path) { \
+    memset(m, 0, sizeof(struct NAME##_mapped)); \
+    struct bl_snapshot_header const* header = bl_snapshot_open(&m->mapping, path, BL_SNAPSHOT_ARRAY, sizeof(TYPE), 0); \
+    if (!header) { \
+      return false; \
+    } \
+    m->data = (TYPE const*) ((char const*) header + BL_SNAPSHOT_ALIGN); \
+    m->current = header->count; \
+    return true; \
+  } \
+  static inline TYPE const* NAME##_mapped_data(struct NAME##_mapped* m) { \
+    return m->data; \
+  } \
+  static inline size_t NAME##_mapped_size(struct NAME##_mapped* m) { \
+    return m->current; \
+  } \
+  static inline void NAME##_mapped_close(struct NAME##_mapped* m) { \
+    bl_snapshot_close(&m->mapping); \
+    m->data = NULL; \
+    m->current = 0; \
+  }
+
+/**
+ * HASH_MAP_SNAPSHOT declares _save and _open_mapped for a hash map NAME, which must already
+ * be declared by HASH_MAP or one of its fixed bucket variants with the same KEY_TYPE,
+ * DATA_TYPE, CMP_FN and BUCKETS.
+ *
+ * _save(map, fd) writes the map to fd, which is left open, and returns false if a write
+ * failed. _open_mapped(m, path) maps a saved map into m, returning false if the file could
+ * not be mapped or was not saved from a map with the same entry type and bucket count.
+ *
+ * The mapped map is read in place: _mapped_find_ptr and _mapped_find behave like _find_ptr
+ * and _find on the live map, but the memory is read-only, so the returned pointer is const.
+ * Pointers remain valid until _mapped_close.
+ */
+#define HASH_MAP_SNAPSHOT(NAME, KEY_TYPE, DATA_TYPE, CMP_FN, BUCKETS) \
+  typedef struct NAME##_mapped { \
+    struct bl_snapshot_mapping mapping; \
+    /* BUCKETS + 1 offsets into entries, bucket i holds entries [offsets[i], offsets[i + 1]) */ \
+    uint64_t const* offsets; \
+    struct NAME##_entry const* entries; \
+    size_t count; \
+  } NAME##_mapped_t; \
+  static inline bool NAME##_save(struct NAME* map, int fd) { \
+    size_t offsets_size = sizeof(uint64_t) * (BUCKETS + 1); \
+    uint64_t* offsets = malloc(offsets_size); \
+    if (!offsets) { \
+      return false; \
+    } \
+    offsets[0] = 0; \
+    for (size_t i = 0; i < BUCKETS; i++) { \
+      offsets[i + 1] = offsets[i] + map->buckets[i].current; \
+    } \
+    bool ok = bl_snapshot_write_header(fd, BL_SNAPSHOT_HASH_MAP, sizeof(struct NAME##_entry), offsets[BUCKETS], BUCKETS) && \
+      bl_snapshot_write_all(fd, offsets, offsets_size) && \
+      bl_snapshot_write_padding(fd, offsets_size); \
+    free(offsets); \
+    for (size_t i = 0; ok && i < BUCKETS; i++) { \
+      ok = bl_snapshot_write_all(fd, map->buckets[i].data, sizeof(struct NAME##_entry) * map->buckets[i].current); \
+    } \
+    return ok; \
+  } \
+  static inline bool NAME##_open_mapped(struct NAME##_mapped* m, char const* path) { \
+    memset(m, 0, sizeof(struct NAME##_mapped)); \
+    struct bl_snapshot_header const* header = bl_snapshot_open(&m->mapping, path, BL_SNAPSHOT_HASH_MAP, sizeof(struct NAME##_entry), BUCKETS); \
+    if (!header) { \
+      return false; \
+    } \
+    char const* base = (char const*) header; \
+    m->offsets = (uint64_t const*) (base + BL_SNAPSHOT_ALIGN); \
+    m->entries = (struct NAME##_entry const*) (base + BL_SNAPSHOT_ALIGN + bl_snapshot_align((BUCKETS + 1) * sizeof(uint64_t))); \
+    m->count = header->count; \
+    bool valid = m->offsets[0] == 0 && m->offsets[BUCKETS] == m->count; \
+    for (size_t i = 0; valid && i < BUCKETS; i++) { \
+      valid = m->offsets[i] <= m->offsets[i + 1]; \
+    } \
+    if (!valid) { \
+      bl_snapshot_close(&m->mapping); \
+      memset(m, 0, sizeof(struct NAME##_mapped)); \
+    } \
+    return valid; \
+  } \
+  static inline DATA_TYPE const* NAME##_mapped_find_ptr(struct NAME##_mapped* m, KEY_TYPE key) { \
+    size_t bucket = NAME##_get_bucket(key); \
+    for (uint64_t i = m->offsets[bucket]; i < m->offsets[bucket + 1]; i++) { \
+      if (!CMP_FN(key, m->entries[i].key)) { \
+        return &m->entries[i].data; \
+      } \
+    } \
+    return NULL; \
+  } \
+  static inline bool NAME##_mapped_find(struct NAME##_mapped* m, KEY_TYPE key, DATA_TYPE* data) { \
+    DATA_TYPE const* ptr = NAME##_mapped_find_ptr(m, key); \
+    if (ptr && data) { \
+      *data = *ptr; \
+    } \
+    return ptr != NULL; \
+  } \
+  static inline size_t NAME##_mapped_count(struct NAME##_mapped* m) { \
+    return m->count; \
+  } \
+  static inline void NAME##_mapped_close(struct NAME##_mapped* m) { \
+    bl_snapshot_close(&m->mapping); \
+    memset(m, 0, sizeof(struct NAME##_mapped)); \
+  }
+
+/**
+ * HASH_MAP_FROZEN_SNAPSHOT declares _frozen_save and _frozen_open_mapped for the frozen map
+ * of NAME, which must already be declared by HASH_MAP_FROZEN (see blphm.h).
+ *
+ * _frozen_save(f, fd) writes a frozen map to fd, which is left open, and returns false if a
+ * write failed. _frozen_open_mapped(m, path) maps a saved frozen map into m, returning false
+ * if the file could not be mapped or does not hold a frozen table with the same entry type.
+ * m->table can then be passed to _frozen_find and _frozen_find_ptr until _frozen_mapped_close.
+ * It must not be passed to _frozen_free.
+ */
+#define HASH_MAP_FROZEN_SNAPSHOT(NAME) \
+  typedef struct NAME##_frozen_mapped { \
+    struct bl_snapshot_mapping mapping; \
+    struct NAME##_frozen table; \
+  } NAME##_frozen_mapped_t; \
+  static inline bool NAME##_frozen_save(struct NAME##_frozen* f, int fd) { \
+    return bl_snapshot_write_header(fd, BL_SNAPSHOT_FROZEN_HASH_MAP, sizeof(struct NAME##_entry), f->table->count, 0) && \
+      bl_snapshot_write_all(fd, f->table, NAME##_frozen_table_size(f)); \
+  } \
+  static inline bool NAME##_frozen_open_mapped(struct NAME##_frozen_mapped* m, char const* path) { \
+    memset(m, 0, sizeof(struct NAME##_frozen_mapped)); \
+    struct bl_snapshot_header const* header = bl_snapshot_open(&m->mapping, path, BL_SNAPSHOT_FROZEN_HASH_MAP, sizeof(struct NAME##_entry), 0); \
+    if (!header) { \
+      return false; \
+    } \
+    if (!NAME##_frozen_attach(&m->table, (char const*) header + BL_SNAPSHOT_ALIGN, m->mapping.length - BL_SNAPSHOT_ALIGN) || \
+        m->table.table->count != header->count) { \
+      bl_snapshot_close(&m->mapping); \
+      memset(m, 0, sizeof(struct NAME##_frozen_mapped)); \
+      return false; \
+    } \
+    return true; \
+  } \
+  static inline void NAME##_frozen_mapped_close(struct NAME##_frozen_mapped* m) { \
+    bl_snapshot_close(&m->mapping); \
+    memset(m, 0, sizeof(struct NAME##_frozen_mapped)); \
+  }
+
+#endif
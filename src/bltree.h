@@ -18,4 +18,587 @@
 #define BINARY_TREE(NAME, KEY_TYPE, DATA_TYPE, CMP_FN) \
   BINARY_TREE_TYPE(NAME, KEY_TYPE, DATA_TYPE)
 
+/**
+ * BTREE_MAP declares an ordered key-data map backed by a B+ tree.
+ *
+ * Nodes are wide: each holds up to ORDER keys stored contiguously, so a search within a node
+ * is a binary search over a few adjacent cache lines rather than a pointer dereference per
+ * comparison. Data is only stored in leaves, and leaves are linked to their neighbours so
+ * that ordered iteration from any position (see _lower_bound and _iter_next) walks leaf
+ * arrays sequentially without returning to the root.
+ *
+ * With ORDER keys per node a tree of n keys has a height of about log_(ORDER/2)(n), e.g. a
+ * 10M key tree with ORDER 64 is 4 to 5 levels deep where a balanced binary tree would be
+ * around 24. BTREE_NODE_ORDER picks an ORDER that fills BTREE_NODE_BYTES of keys.
+ *
+ * CMP_FN must be a three-way comparison, returning a negative value, zero or a positive
+ * value when the first key is less than, equal to or greater than the second.
+ * ORDER must be at least 4.
+ */
+
+/// Target size of the key array of a node. Four 64 byte cache lines by default.
+#ifndef BTREE_NODE_BYTES
+#define BTREE_NODE_BYTES 256
+#endif
+
+/// An ORDER that fills BTREE_NODE_BYTES with keys of a given type, and is at least 4.
+#define BTREE_NODE_ORDER(KEY_TYPE) \
+  ((BTREE_NODE_BYTES / sizeof(KEY_TYPE)) < 4 ? 4 : (BTREE_NODE_BYTES / sizeof(KEY_TYPE)))
+
+/**
+ * Every node begins with a common header so that leaves and inner nodes can be
+ * distinguished through a struct NAME_node pointer.
+ *
+ * Inner nodes have count keys and count + 1 children. Every key in children[i] is
+ * less than keys[i], and every key in children[i + 1] is greater than or equal to it.
+ */
+#define BTREE_MAP_TYPE(NAME, KEY_TYPE, DATA_TYPE, ORDER) \
+  struct NAME##_node { \
+    size_t count; \
+    bool leaf; \
+  }; \
+  struct NAME##_leaf { \
+    struct NAME##_node hdr; \
+    struct NAME##_leaf* prev; \
+    struct NAME##_leaf* next; \
+    KEY_TYPE keys[ORDER]; \
+    DATA_TYPE data[ORDER]; \
+  }; \
+  struct NAME##_inner { \
+    struct NAME##_node hdr; \
+    KEY_TYPE keys[ORDER]; \
+    struct NAME##_node* children[(ORDER) + 1]; \
+  }; \
+  /* A key-data pair, the element type accepted by _build_sorted_entries */ \
+  struct NAME##_entry { \
+    KEY_TYPE key; \
+    DATA_TYPE data; \
+  }; \
+  typedef struct NAME { \
+    /* NULL while the tree is empty */ \
+    struct NAME##_node* root; \
+    size_t count; \
+  } NAME##_t; \
+  /* A position in the tree, valid until the tree is next modified */ \
+  typedef struct NAME##_iter { \
+    struct NAME##_leaf* leaf; \
+    size_t index; \
+  } NAME##_iter_t;
+
+/**
+ * _init puts a tree into a state where it is ready to include elements.
+ * An empty tree does not allocate.
+ */
+#define BTREE_MAP_INIT(NAME) \
+  static inline void NAME##_init(struct NAME* tree) { \
+    memset(tree, 0, sizeof(struct NAME)); \
+  }
+
+/**
+ * _free frees every node of the tree.
+ * NOTE: This does not free underlying memory in cases
+ * where DATA_TYPE is a pointer. That is left to the user
+ */
+#define BTREE_MAP_FREE(NAME) \
+  static inline void NAME##_free_node(struct NAME##_node* node) { \
+    if (!node->leaf) { \
+      struct NAME##_inner* inner = (struct NAME##_inner*) node; \
+      for (size_t i = 0; i <= node->count; i++) { \
+        NAME##_free_node(inner->children[i]); \
+      } \
+    } \
+    free(node); \
+  } \
+  static inline void NAME##_free(struct NAME* tree) { \
+    if (tree->root) { \
+      NAME##_free_node(tree->root); \
+    } \
+    memset(tree, 0, sizeof(struct NAME)); \
+  }
+
+/**
+ * INTERNAL CALL: Binary searches for the first key greater than (upper bound) or not less
+ * than (lower bound) a given key in a node's key array.
+ */
+#define BTREE_MAP_SEARCH(NAME, KEY_TYPE, CMP_FN) \
+  static inline size_t NAME##_upper_bound_in(KEY_TYPE const* keys, size_t count, KEY_TYPE key) { \
+    size_t low = 0; \
+    size_t high = count; \
+    while (low < high) { \
+      size_t mid = low + ((high - low) / 2); \
+      if (CMP_FN(keys[mid], key) <= 0) { \
+        low = mid + 1; \
+      } else { \
+        high = mid; \
+      } \
+    } \
+    return low; \
+  } \
+  static inline size_t NAME##_lower_bound_in(KEY_TYPE const* keys, size_t count, KEY_TYPE key) { \
+    size_t low = 0; \
+    size_t high = count; \
+    while (low < high) { \
+      size_t mid = low + ((high - low) / 2); \
+      if (CMP_FN(keys[mid], key) < 0) { \
+        low = mid + 1; \
+      } else { \
+        high = mid; \
+      } \
+    } \
+    return low; \
+  } \
+  /* INTERNAL CALL: Descends to the leaf which would hold key */ \
+  static inline struct NAME##_leaf* NAME##_find_leaf(struct NAME* tree, KEY_TYPE key) { \
+    struct NAME##_node* node = tree->root; \
+    while (node && !node->leaf) { \
+      struct NAME##_inner* inner = (struct NAME##_inner*) node; \
+      node = inner->children[NAME##_upper_bound_in(inner->keys, node->count, key)]; \
+    } \
+    return (struct NAME##_leaf*) node; \
+  }
+
+/**
+ * _find_ptr returns a pointer to the data stored with a key, or NULL if the key is not
+ * in the tree.
+ *
+ * WARNING: find_ptr is not stable between inserts or deletions since entries move
+ * between nodes as they split and merge.
+ */
+#define BTREE_MAP_FIND_PTR(NAME, KEY_TYPE, DATA_TYPE, CMP_FN) \
+  static inline DATA_TYPE* NAME##_find_ptr(struct NAME* tree, KEY_TYPE key) { \
+    struct NAME##_leaf* leaf = NAME##_find_leaf(tree, key); \
+    if (!leaf) { \
+      return NULL; \
+    } \
+    size_t idx = NAME##_lower_bound_in(leaf->keys, leaf->hdr.count, key); \
+    if (idx < leaf->hdr.count && !CMP_FN(leaf->keys[idx], key)) { \
+      return &leaf->data[idx]; \
+    } \
+    return NULL; \
+  }
+
+/**
+ * _find returns true or false if an element with a given key exists inside the tree.
+ * The data argument will be ignored if set to NULL or the element does not exist,
+ * otherwise the pointed value will be set to the value with the corresponding key.
+ */
+#define BTREE_MAP_FIND(NAME, KEY_TYPE, DATA_TYPE) \
+  static inline bool NAME##_find(struct NAME* tree, KEY_TYPE key, DATA_TYPE* data) { \
+    DATA_TYPE* ptr = NAME##_find_ptr(tree, key); \
+    if (ptr) { \
+      if (data) { \
+        *data = *ptr; \
+      } \
+      return true; \
+    } else { \
+      return false; \
+    } \
+  }
+
+/**
+ * _set inserts a key-data pair into the tree, replacing the data of an existing key.
+ *
+ * Insertion descends to the leaf that holds the key. A full leaf is split in half and the
+ * first key of the new right half is inserted into the parent as a separator, which may in
+ * turn split the parent. When the root splits the tree grows by one level.
+ */
+#define BTREE_MAP_SET(NAME, KEY_TYPE, DATA_TYPE, CMP_FN, ORDER) \
+  static inline struct NAME##_leaf* NAME##_new_leaf() { \
+    struct NAME##_leaf* leaf = malloc(sizeof(struct NAME##_leaf)); \
+    leaf->hdr.count = 0; \
+    leaf->hdr.leaf = true; \
+    leaf->prev = NULL; \
+    leaf->next = NULL; \
+    return leaf; \
+  } \
+  static inline struct NAME##_inner* NAME##_new_inner() { \
+    struct NAME##_inner* inner = malloc(sizeof(struct NAME##_inner)); \
+    inner->hdr.count = 0; \
+    inner->hdr.leaf = false; \
+    return inner; \
+  } \
+  /* INTERNAL CALL: Inserts into the subtree at node. Returns false if the key already */ \
+  /* existed. If node had to split, *split is set to the new right node and *split_key */ \
+  /* to the separator between them. */ \
+  static inline bool NAME##_set_rec(struct NAME##_node* node, KEY_TYPE key, DATA_TYPE val, KEY_TYPE* split_key, struct NAME##_node** split) { \
+    *split = NULL; \
+    if (node->leaf) { \
+      struct NAME##_leaf* leaf = (struct NAME##_leaf*) node; \
+      size_t idx = NAME##_lower_bound_in(leaf->keys, node->count, key); \
+      if (idx < node->count && !CMP_FN(leaf->keys[idx], key)) { \
+        leaf->data[idx] = val; \
+        return false; \
+      } \
+      if (node->count == (ORDER)) { \
+        struct NAME##_leaf* right = NAME##_new_leaf(); \
+        size_t mid = (ORDER) / 2; \
+        right->hdr.count = (ORDER) - mid; \
+        memcpy(right->keys, leaf->keys + mid, sizeof(KEY_TYPE) * right->hdr.count); \
+        memcpy(right->data, leaf->data + mid, sizeof(DATA_TYPE) * right->hdr.count); \
+        node->count = mid; \
+        right->next = leaf->next; \
+        right->prev = leaf; \
+        if (leaf->next) { \
+          leaf->next->prev = right; \
+        } \
+        leaf->next = right; \
+        if (idx > mid) { \
+          leaf = right; \
+          idx -= mid; \
+        } \
+        *split = &right->hdr; \
+      } \
+      memmove(leaf->keys + idx + 1, leaf->keys + idx, sizeof(KEY_TYPE) * (leaf->hdr.count - idx)); \
+      memmove(leaf->data + idx + 1, leaf->data + idx, sizeof(DATA_TYPE) * (leaf->hdr.count - idx)); \
+      leaf->keys[idx] = key; \
+      leaf->data[idx] = val; \
+      leaf->hdr.count += 1; \
+      if (*split) { \
+        *split_key = ((struct NAME##_leaf*) *split)->keys[0]; \
+      } \
+      return true; \
+    } \
+    struct NAME##_inner* inner = (struct NAME##_inner*) node; \
+    size_t pos = NAME##_upper_bound_in(inner->keys, node->count, key); \
+    KEY_TYPE child_key; \
+    struct NAME##_node* child_split; \
+    bool inserted = NAME##_set_rec(inner->children[pos], key, val, &child_key, &child_split); \
+    if (!child_split) { \
+      return inserted; \
+    } \
+    if (node->count == (ORDER)) { \
+      struct NAME##_inner* right = NAME##_new_inner(); \
+      size_t mid = (ORDER) / 2; \
+      *split_key = inner->keys[mid]; \
+      right->hdr.count = (ORDER) - mid - 1; \
+      memcpy(right->keys, inner->keys + mid + 1, sizeof(KEY_TYPE) * right->hdr.count); \
+      memcpy(right->children, inner->children + mid + 1, sizeof(struct NAME##_node*) * (right->hdr.count + 1)); \
+      node->count = mid; \
+      *split = &right->hdr; \
+      if (pos > mid) { \
+        inner = right; \
+        pos -= mid + 1; \
+      } \
+    } \
+    memmove(inner->keys + pos + 1, inner->keys + pos, sizeof(KEY_TYPE) * (inner->hdr.count - pos)); \
+    memmove(inner->children + pos + 2, inner->children + pos + 1, sizeof(struct NAME##_node*) * (inner->hdr.count - pos)); \
+    inner->keys[pos] = child_key; \
+    inner->children[pos + 1] = child_split; \
+    inner->hdr.count += 1; \
+    return inserted; \
+  } \
+  static inline void NAME##_set(struct NAME* tree, KEY_TYPE key, DATA_TYPE val) { \
+    if (!tree->root) { \
+      tree->root = &NAME##_new_leaf()->hdr; \
+    } \
+    KEY_TYPE split_key; \
+    struct NAME##_node* split; \
+    if (NAME##_set_rec(tree->root, key, val, &split_key, &split)) { \
+      tree->count += 1; \
+    } \
+    if (split) { \
+      struct NAME##_inner* root = NAME##_new_inner(); \
+      root->hdr.count = 1; \
+      root->keys[0] = split_key; \
+      root->children[0] = tree->root; \
+      root->children[1] = split; \
+      tree->root = &root->hdr; \
+    } \
+  }
+
+/**
+ * _remove removes a key and its data from the tree, if present.
+ *
+ * A node left with fewer than half of ORDER keys borrows a key from a neighbouring
+ * sibling if the sibling can spare one, and is otherwise merged into it. When the
+ * root is left with a single child the tree shrinks by one level.
+ */
+#define BTREE_MAP_REMOVE(NAME, KEY_TYPE, DATA_TYPE, CMP_FN, ORDER) \
+  /* INTERNAL CALL: Removes separator keys[k] and children[k + 1] from an inner node */ \
+  static inline void NAME##_inner_erase(struct NAME##_inner* inner, size_t k) { \
+    memmove(inner->keys + k, inner->keys + k + 1, sizeof(KEY_TYPE) * (inner->hdr.count - k - 1)); \
+    memmove(inner->children + k + 1, inner->children + k + 2, sizeof(struct NAME##_node*) * (inner->hdr.count - k - 1)); \
+    inner->hdr.count -= 1; \
+  } \
+  /* INTERNAL CALL: Appends the contents of right to left and frees right */ \
+  static inline void NAME##_leaf_merge(struct NAME##_leaf* left, struct NAME##_leaf* right) { \
+    memcpy(left->keys + left->hdr.count, right->keys, sizeof(KEY_TYPE) * right->hdr.count); \
+    memcpy(left->data + left->hdr.count, right->data, sizeof(DATA_TYPE) * right->hdr.count); \
+    left->hdr.count += right->hdr.count; \
+    left->next = right->next; \
+    if (right->next) { \
+      right->next->prev = left; \
+    } \
+    free(right); \
+  } \
+  /* INTERNAL CALL: Appends separator and the contents of right to left and frees right */ \
+  static inline void NAME##_inner_merge(struct NAME##_inner* left, KEY_TYPE separator, struct NAME##_inner* right) { \
+    left->keys[left->hdr.count] = separator; \
+    memcpy(left->keys + left->hdr.count + 1, right->keys, sizeof(KEY_TYPE) * right->hdr.count); \
+    memcpy(left->children + left->hdr.count + 1, right->children, sizeof(struct NAME##_node*) * (right->hdr.count + 1)); \
+    left->hdr.count += right->hdr.count + 1; \
+    free(right); \
+  } \
+  /* INTERNAL CALL: Restores the minimum occupancy of parent->children[i] */ \
+  static inline void NAME##_fix_child(struct NAME##_inner* parent, size_t i) { \
+    struct NAME##_node* child = parent->children[i]; \
+    struct NAME##_node* left = i > 0 ? parent->children[i - 1] : NULL; \
+    struct NAME##_node* right = i < parent->hdr.count ? parent->children[i + 1] : NULL; \
+    if (child->leaf) { \
+      struct NAME##_leaf* c = (struct NAME##_leaf*) child; \
+      struct NAME##_leaf* l = (struct NAME##_leaf*) left; \
+      struct NAME##_leaf* r = (struct NAME##_leaf*) right; \
+      if (l && l->hdr.count > (ORDER) / 2) { \
+        memmove(c->keys + 1, c->keys, sizeof(KEY_TYPE) * c->hdr.count); \
+        memmove(c->data + 1, c->data, sizeof(DATA_TYPE) * c->hdr.count); \
+        l->hdr.count -= 1; \
+        c->keys[0] = l->keys[l->hdr.count]; \
+        c->data[0] = l->data[l->hdr.count]; \
+        c->hdr.count += 1; \
+        parent->keys[i - 1] = c->keys[0]; \
+      } else if (r && r->hdr.count > (ORDER) / 2) { \
+        c->keys[c->hdr.count] = r->keys[0]; \
+        c->data[c->hdr.count] = r->data[0]; \
+        c->hdr.count += 1; \
+        r->hdr.count -= 1; \
+        memmove(r->keys, r->keys + 1, sizeof(KEY_TYPE) * r->hdr.count); \
+        memmove(r->data, r->data + 1, sizeof(DATA_TYPE) * r->hdr.count); \
+        parent->keys[i] = r->keys[0]; \
+      } else if (l) { \
+        NAME##_leaf_merge(l, c); \
+        NAME##_inner_erase(parent, i - 1); \
+      } else { \
+        NAME##_leaf_merge(c, r); \
+        NAME##_inner_erase(parent, i); \
+      } \
+      return; \
+    } \
+    struct NAME##_inner* c = (struct NAME##_inner*) child; \
+    struct NAME##_inner* l = (struct NAME##_inner*) left; \
+    struct NAME##_inner* r = (struct NAME##_inner*) right; \
+    if (l && l->hdr.count > ((ORDER) - 1) / 2) { \
+      memmove(c->keys + 1, c->keys, sizeof(KEY_TYPE) * c->hdr.count); \
+      memmove(c->children + 1, c->children, sizeof(struct NAME##_node*) * (c->hdr.count + 1)); \
+      c->keys[0] = parent->keys[i - 1]; \
+      c->children[0] = l->children[l->hdr.count]; \
+      c->hdr.count += 1; \
+      parent->keys[i - 1] = l->keys[l->hdr.count - 1]; \
+      l->hdr.count -= 1; \
+    } else if (r && r->hdr.count > ((ORDER) - 1) / 2) { \
+      c->keys[c->hdr.count] = parent->keys[i]; \
+      c->children[c->hdr.count + 1] = r->children[0]; \
+      c->hdr.count += 1; \
+      parent->keys[i] = r->keys[0]; \
+      memmove(r->keys, r->keys + 1, sizeof(KEY_TYPE) * (r->hdr.count - 1)); \
+      memmove(r->children, r->children + 1, sizeof(struct NAME##_node*) * r->hdr.count); \
+      r->hdr.count -= 1; \
+    } else if (l) { \
+      NAME##_inner_merge(l, parent->keys[i - 1], c); \
+      NAME##_inner_erase(parent, i - 1); \
+    } else { \
+      NAME##_inner_merge(c, parent->keys[i], r); \
+      NAME##_inner_erase(parent, i); \
+    } \
+  } \
+  /* INTERNAL CALL: Removes key from the subtree at node, returning true if it was present */ \
+  static inline bool NAME##_remove_rec(struct NAME##_node* node, KEY_TYPE key) { \
+    if (node->leaf) { \
+      struct NAME##_leaf* leaf = (struct NAME##_leaf*) node; \
+      size_t idx = NAME##_lower_bound_in(leaf->keys, node->count, key); \
+      if (idx == node->count || CMP_FN(leaf->keys[idx], key)) { \
+        return false; \
+      } \
+      node->count -= 1; \
+      memmove(leaf->keys + idx, leaf->keys + idx + 1, sizeof(KEY_TYPE) * (node->count - idx)); \
+      memmove(leaf->data + idx, leaf->data + idx + 1, sizeof(DATA_TYPE) * (node->count - idx)); \
+      return true; \
+    } \
+    struct NAME##_inner* inner = (struct NAME##_inner*) node; \
+    size_t pos = NAME##_upper_bound_in(inner->keys, node->count, key); \
+    struct NAME##_node* child = inner->children[pos]; \
+    if (!NAME##_remove_rec(child, key)) { \
+      return false; \
+    } \
+    size_t min = child->leaf ? (ORDER) / 2 : ((ORDER) - 1) / 2; \
+    if (child->count < min) { \
+      NAME##_fix_child(inner, pos); \
+    } \
+    return true; \
+  } \
+  static inline void NAME##_remove(struct NAME* tree, KEY_TYPE key) { \
+    if (!tree->root || !NAME##_remove_rec(tree->root, key)) { \
+      return; \
+    } \
+    tree->count -= 1; \
+    struct NAME##_node* root = tree->root; \
+    if (root->leaf && root->count == 0) { \
+      free(root); \
+      tree->root = NULL; \
+    } else if (!root->leaf && root->count == 0) { \
+      tree->root = ((struct NAME##_inner*) root)->children[0]; \
+      free(root); \
+    } \
+  }
+
+/**
+ * Ordered iteration.
+ *
+ * _begin returns an iterator at the smallest key, and _lower_bound returns an iterator at
+ * the first key that is not less than a given key. _iter_valid is false once an iterator
+ * has moved past the largest key. _iter_key and _iter_data access the current entry and
+ * _iter_next advances to the next key in order.
+ *
+ * Iterating a range [lo, hi):
+ *   for (NAME_iter_t it = NAME_lower_bound(&tree, lo);
+ *        NAME_iter_valid(it) && CMP_FN(NAME_iter_key(it), hi) < 0;
+ *        NAME_iter_next(&it)) { ... }
+ *
+ * Iterators are invalidated by any insert or removal.
+ */
+#define BTREE_MAP_ITER(NAME, KEY_TYPE, DATA_TYPE) \
+  static inline bool NAME##_iter_valid(struct NAME##_iter it) { \
+    return it.leaf != NULL; \
+  } \
+  static inline KEY_TYPE NAME##_iter_key(struct NAME##_iter it) { \
+    return it.leaf->keys[it.index]; \
+  } \
+  static inline DATA_TYPE* NAME##_iter_data(struct NAME##_iter it) { \
+    return &it.leaf->data[it.index]; \
+  } \
+  static inline void NAME##_iter_next(struct NAME##_iter* it) { \
+    it->index += 1; \
+    if (it->index >= it->leaf->hdr.count) { \
+      it->leaf = it->leaf->next; \
+      it->index = 0; \
+    } \
+  } \
+  static inline struct NAME##_iter NAME##_begin(struct NAME* tree) { \
+    struct NAME##_node* node = tree->root; \
+    while (node && !node->leaf) { \
+      node = ((struct NAME##_inner*) node)->children[0]; \
+    } \
+    struct NAME##_iter it = { (struct NAME##_leaf*) node, 0 }; \
+    return it; \
+  } \
+  static inline struct NAME##_iter NAME##_lower_bound(struct NAME* tree, KEY_TYPE key) { \
+    struct NAME##_iter it = { NAME##_find_leaf(tree, key), 0 }; \
+    if (it.leaf) { \
+      it.index = NAME##_lower_bound_in(it.leaf->keys, it.leaf->hdr.count, key); \
+      if (it.index >= it.leaf->hdr.count) { \
+        it.leaf = it.leaf->next; \
+        it.index = 0; \
+      } \
+    } \
+    return it; \
+  }
+
+/**
+ * _build_sorted replaces the contents of a tree with n keys and their data, which must be
+ * sorted in strictly increasing order. _build_sorted_entries does the same from an array of
+ * struct NAME_entry, so that a DYNAMIC_ARRAY of entries can be passed as (l.data, l.current).
+ * Both return false, leaving the tree unchanged, if the keys are not strictly increasing.
+ *
+ * Rather than inserting keys one at a time, which is O(n log n) and leaves nodes about
+ * half full, the tree is built bottom-up in O(n): keys are copied into as few leaves as
+ * possible, spread evenly so every leaf is at least half full, and each inner level is then
+ * built over the level beneath it until a single root remains. Every node is allocated once.
+ *
+ * Since nodes are packed, the first inserts into a freshly built tree will split them.
+ */
+#define BTREE_MAP_BUILD_SORTED(NAME, KEY_TYPE, DATA_TYPE, CMP_FN, ORDER) \
+  /* INTERNAL CALL: Builds from either keys and vals or entries, whichever is not NULL */ \
+  static inline bool NAME##_build(struct NAME* tree, KEY_TYPE const* keys, DATA_TYPE const* vals, struct NAME##_entry const* entries, size_t n) { \
+    for (size_t i = 1; i < n; i++) { \
+      if (CMP_FN(entries ? entries[i - 1].key : keys[i - 1], entries ? entries[i].key : keys[i]) >= 0) { \
+        return false; \
+      } \
+    } \
+    NAME##_free(tree); \
+    if (n == 0) { \
+      return true; \
+    } \
+    size_t num_nodes = (n + (ORDER) - 1) / (ORDER); \
+    /* The nodes of the level being built and the smallest key beneath each of them */ \
+    struct NAME##_node** nodes = malloc(sizeof(struct NAME##_node*) * num_nodes); \
+    KEY_TYPE* lows = malloc(sizeof(KEY_TYPE) * num_nodes); \
+    struct NAME##_leaf* prev = NULL; \
+    size_t next = 0; \
+    for (size_t i = 0; i < num_nodes; i++) { \
+      struct NAME##_leaf* leaf = NAME##_new_leaf(); \
+      size_t take = n / num_nodes + (i < n % num_nodes); \
+      if (entries) { \
+        for (size_t j = 0; j < take; j++) { \
+          leaf->keys[j] = entries[next + j].key; \
+          leaf->data[j] = entries[next + j].data; \
+        } \
+      } else { \
+        memcpy(leaf->keys, keys + next, sizeof(KEY_TYPE) * take); \
+        memcpy(leaf->data, vals + next, sizeof(DATA_TYPE) * take); \
+      } \
+      next += take; \
+      leaf->hdr.count = take; \
+      leaf->prev = prev; \
+      if (prev) { \
+        prev->next = leaf; \
+      } \
+      prev = leaf; \
+      nodes[i] = &leaf->hdr; \
+      lows[i] = leaf->keys[0]; \
+    } \
+    /* Each level is written over the front of the one beneath it, which is safe since a */ \
+    /* parent is never stored past the index of its first child */ \
+    while (num_nodes > 1) { \
+      size_t num_parents = (num_nodes + (ORDER)) / ((ORDER) + 1); \
+      size_t child = 0; \
+      for (size_t i = 0; i < num_parents; i++) { \
+        struct NAME##_inner* inner = NAME##_new_inner(); \
+        size_t take = num_nodes / num_parents + (i < num_nodes % num_parents); \
+        KEY_TYPE low = lows[child]; \
+        for (size_t j = 0; j < take; j++) { \
+          inner->children[j] = nodes[child + j]; \
+          if (j > 0) { \
+            inner->keys[j - 1] = lows[child + j]; \
+          } \
+        } \
+        inner->hdr.count = take - 1; \
+        child += take; \
+        nodes[i] = &inner->hdr; \
+        lows[i] = low; \
+      } \
+      num_nodes = num_parents; \
+    } \
+    tree->root = nodes[0]; \
+    tree->count = n; \
+    free(nodes); \
+    free(lows); \
+    return true; \
+  } \
+  static inline bool NAME##_build_sorted(struct NAME* tree, KEY_TYPE const* keys, DATA_TYPE const* vals, size_t n) { \
+    return NAME##_build(tree, keys, vals, NULL, n); \
+  } \
+  static inline bool NAME##_build_sorted_entries(struct NAME* tree, struct NAME##_entry const* entries, size_t n) { \
+    return NAME##_build(tree, NULL, NULL, entries, n); \
+  }
+
+/**
+ * _count returns the number of keys in the tree.
+ */
+#define BTREE_MAP_COUNT(NAME) \
+  static inline size_t NAME##_count(struct NAME* tree) { \
+    return tree->count; \
+  }
+
+#define BTREE_MAP(NAME, KEY_TYPE, DATA_TYPE, CMP_FN, ORDER) \
+  BTREE_MAP_TYPE(NAME, KEY_TYPE, DATA_TYPE, ORDER) \
+  BTREE_MAP_INIT(NAME) \
+  BTREE_MAP_FREE(NAME) \
+  BTREE_MAP_SEARCH(NAME, KEY_TYPE, CMP_FN) \
+  BTREE_MAP_FIND_PTR(NAME, KEY_TYPE, DATA_TYPE, CMP_FN) \
+  BTREE_MAP_FIND(NAME, KEY_TYPE, DATA_TYPE) \
+  BTREE_MAP_SET(NAME, KEY_TYPE, DATA_TYPE, CMP_FN, ORDER) \
+  BTREE_MAP_REMOVE(NAME, KEY_TYPE, DATA_TYPE, CMP_FN, ORDER) \
+  BTREE_MAP_ITER(NAME, KEY_TYPE, DATA_TYPE) \
+  BTREE_MAP_BUILD_SORTED(NAME, KEY_TYPE, DATA_TYPE, CMP_FN, ORDER) \
+  BTREE_MAP_COUNT(NAME)
+
 #endif //_BL_BINARY_TREE_H
@@ -0,0 +1,46 @@
+#ifndef _BLAKE_TEST_COUNTING_ALLOCATOR_H_
+#define _BLAKE_TEST_COUNTING_ALLOCATOR_H_
+#include <stdlib.h>
+#include "blalloc.h"
+
+/**
+ * An allocator for tests which forwards to the standard library and counts the calls made
+ * through it, along with the number of bytes the container currently holds.
+ */
+struct counting_ctx {
+  size_t allocs;
+  size_t reallocs;
+  size_t frees;
+  size_t live_bytes;
+};
+
+static inline void* counting_alloc(void* ctx, size_t size) {
+  struct counting_ctx* c = ctx;
+  c->allocs += 1;
+  c->live_bytes += size;
+  return malloc(size);
+}
+
+static inline void* counting_realloc(void* ctx, void* ptr, size_t old_size, size_t new_size) {
+  struct counting_ctx* c = ctx;
+  c->reallocs += 1;
+  c->live_bytes = c->live_bytes - old_size + new_size;
+  return realloc(ptr, new_size);
+}
+
+static inline void counting_free(void* ctx, void* ptr, size_t size) {
+  struct counting_ctx* c = ctx;
+  c->frees += 1;
+  c->live_bytes -= size;
+  free(ptr);
+}
+
+/**
+ * Returns an allocator which counts into ctx.
+ */
+static inline struct bl_allocator counting_allocator(struct counting_ctx* ctx) {
+  struct bl_allocator allocator = { ctx, counting_alloc, counting_realloc, counting_free };
+  return allocator;
+}
+
+#endif
@@ -1,3 +1,4 @@
+#include "unity.h"
 #include "bltree.h"
 
 int key_cmp(int a, int b) {
@@ -5,3 +6,193 @@ int key_cmp(int a, int b) {
 }
 
 BINARY_TREE(inttree, int, int, key_cmp);
+
+BTREE_MAP(small_btree, int, int, key_cmp, 4);
+BTREE_MAP(wide_btree, int, int, key_cmp, BTREE_NODE_ORDER(int));
+
+static void check_ordered(struct small_btree* tree, bool const* present, int max) {
+  small_btree_iter_t it = small_btree_begin(tree);
+  size_t seen = 0;
+  for (int i = 0; i < max; i++) {
+    if (present[i]) {
+      TEST_ASSERT_TRUE(small_btree_iter_valid(it));
+      TEST_ASSERT_EQUAL(i, small_btree_iter_key(it));
+      TEST_ASSERT_EQUAL(i * 3, *small_btree_iter_data(it));
+      small_btree_iter_next(&it);
+      seen++;
+    }
+  }
+  TEST_ASSERT_FALSE(small_btree_iter_valid(it));
+  TEST_ASSERT_EQUAL(seen, small_btree_count(tree));
+}
+
+void test_btree_map_set_find() {
+  struct wide_btree tree;
+  wide_btree_init(&tree);
+  TEST_ASSERT_FALSE(wide_btree_find(&tree, 5, NULL));
+  TEST_ASSERT_FALSE(wide_btree_iter_valid(wide_btree_begin(&tree)));
+
+  for (int i = 0; i < 10000; i++) {
+    wide_btree_set(&tree, (i * 7919) % 10000, i);
+  }
+  TEST_ASSERT_EQUAL(10000, wide_btree_count(&tree));
+
+  for (int i = 0; i < 10000; i++) {
+    int val;
+    TEST_ASSERT_TRUE(wide_btree_find(&tree, (i * 7919) % 10000, &val));
+    TEST_ASSERT_EQUAL(i, val);
+  }
+  TEST_ASSERT_FALSE(wide_btree_find(&tree, 10000, NULL));
+  TEST_ASSERT_FALSE(wide_btree_find(&tree, -1, NULL));
+
+  wide_btree_set(&tree, 42, -42);
+  TEST_ASSERT_EQUAL(10000, wide_btree_count(&tree));
+  TEST_ASSERT_EQUAL(-42, *wide_btree_find_ptr(&tree, 42));
+  wide_btree_free(&tree);
+}
+
+void test_btree_map_lower_bound_range() {
+  struct wide_btree tree;
+  wide_btree_init(&tree);
+  for (int i = 0; i < 1000; i++) {
+    wide_btree_set(&tree, i * 2, i);
+  }
+
+  wide_btree_iter_t it = wide_btree_lower_bound(&tree, 501);
+  TEST_ASSERT_TRUE(wide_btree_iter_valid(it));
+  TEST_ASSERT_EQUAL(502, wide_btree_iter_key(it));
+
+  it = wide_btree_lower_bound(&tree, 500);
+  TEST_ASSERT_EQUAL(500, wide_btree_iter_key(it));
+
+  int expect = 500;
+  for (; wide_btree_iter_valid(it) && wide_btree_iter_key(it) < 1500; wide_btree_iter_next(&it)) {
+    TEST_ASSERT_EQUAL(expect, wide_btree_iter_key(it));
+    TEST_ASSERT_EQUAL(expect / 2, *wide_btree_iter_data(it));
+    expect += 2;
+  }
+  TEST_ASSERT_EQUAL(1500, expect);
+
+  TEST_ASSERT_FALSE(wide_btree_iter_valid(wide_btree_lower_bound(&tree, 1999)));
+  TEST_ASSERT_EQUAL(0, wide_btree_iter_key(wide_btree_lower_bound(&tree, -10)));
+  wide_btree_free(&tree);
+}
+
+void test_btree_map_remove() {
+  enum { MAX = 2000 };
+  static bool present[MAX];
+  memset(present, 0, sizeof(present));
+
+  struct small_btree tree;
+  small_btree_init(&tree);
+
+  srand(1);
+  for (int round = 0; round < 20000; round++) {
+    int key = rand() % MAX;
+    if (rand() % 3) {
+      small_btree_set(&tree, key, key * 3);
+      present[key] = true;
+    } else {
+      small_btree_remove(&tree, key);
+      present[key] = false;
+    }
+    TEST_ASSERT_EQUAL(present[key], small_btree_find(&tree, key, NULL));
+    if (round % 1000 == 0) {
+      check_ordered(&tree, present, MAX);
+    }
+  }
+  check_ordered(&tree, present, MAX);
+
+  for (int i = 0; i < MAX; i++) {
+    small_btree_remove(&tree, i);
+    present[i] = false;
+    if (i % 250 == 0) {
+      check_ordered(&tree, present, MAX);
+    }
+  }
+  TEST_ASSERT_EQUAL(0, small_btree_count(&tree));
+  TEST_ASSERT_NULL(tree.root);
+
+  small_btree_set(&tree, 1, 3);
+  TEST_ASSERT_EQUAL(1, small_btree_count(&tree));
+  small_btree_free(&tree);
+}
+
+DYNAMIC_ARRAY(entry_list, struct small_btree_entry, 16);
+
+void test_btree_map_build_sorted() {
+  size_t sizes[] = { 0, 1, 4, 5, 17, 21, 1000 };
+  static int keys[1000];
+  static int vals[1000];
+  static bool present[2000];
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    size_t n = sizes[s];
+    memset(present, 0, sizeof(present));
+    for (size_t i = 0; i < n; i++) {
+      keys[i] = i * 2;
+      vals[i] = i * 6;
+      present[i * 2] = true;
+    }
+
+    struct small_btree tree;
+    small_btree_init(&tree);
+    small_btree_set(&tree, 1, 3);
+    TEST_ASSERT_TRUE(small_btree_build_sorted(&tree, keys, vals, n));
+    check_ordered(&tree, present, 2000);
+
+    /* A built tree must remain valid under further inserts and removals */
+    for (size_t i = 0; i < n; i++) {
+      small_btree_set(&tree, i * 2 + 1, (i * 2 + 1) * 3);
+      present[i * 2 + 1] = true;
+    }
+    check_ordered(&tree, present, 2000);
+    for (size_t i = 0; i < 2 * n; i += 3) {
+      small_btree_remove(&tree, i);
+      present[i] = false;
+    }
+    check_ordered(&tree, present, 2000);
+    small_btree_free(&tree);
+  }
+}
+
+/// Unsorted or duplicate keys are rejected and the tree is left as it was
+void test_btree_map_build_sorted_rejects_unsorted() {
+  int keys[] = { 1, 3, 2 };
+  int dups[] = { 1, 2, 2 };
+  int vals[] = { 10, 30, 20 };
+
+  struct small_btree tree;
+  small_btree_init(&tree);
+  small_btree_set(&tree, 7, 70);
+
+  TEST_ASSERT_FALSE(small_btree_build_sorted(&tree, keys, vals, 3));
+  TEST_ASSERT_FALSE(small_btree_build_sorted(&tree, dups, vals, 3));
+  TEST_ASSERT_EQUAL(1, small_btree_count(&tree));
+  TEST_ASSERT_EQUAL(70, *small_btree_find_ptr(&tree, 7));
+
+  small_btree_free(&tree);
+}
+
+void test_btree_map_build_sorted_entries() {
+  struct entry_list entries;
+  entry_list_init(&entries);
+  for (int i = 0; i < 500; i++) {
+    struct small_btree_entry e = { i * 5, i };
+    entry_list_push(&entries, e);
+  }
+
+  struct small_btree tree;
+  small_btree_init(&tree);
+  TEST_ASSERT_TRUE(small_btree_build_sorted_entries(&tree, entries.data, entries.current));
+  TEST_ASSERT_EQUAL(500, small_btree_count(&tree));
+  for (int i = 0; i < 500; i++) {
+    int val;
+    TEST_ASSERT_TRUE(small_btree_find(&tree, i * 5, &val));
+    TEST_ASSERT_EQUAL(i, val);
+    TEST_ASSERT_FALSE(small_btree_find(&tree, i * 5 + 1, NULL));
+  }
+  TEST_ASSERT_EQUAL(105, small_btree_iter_key(small_btree_lower_bound(&tree, 101)));
+
+  small_btree_free(&tree);
+  entry_list_free(&entries);
+}
@@ -5,6 +5,7 @@ size_t illegal_ops = 0;
 #define LIST_ILLEGAL_OP(msg) illegal_ops += 1; return 0;
 #define LIST_ILLEGAL_CONCAT(msg) illegal_ops += 1; return;
 #include "bllist.h"
+#include "counting_allocator.h"
 DYNAMIC_ARRAY(int_list, int, 32);
 
 struct int_list l1;
@@ -272,3 +273,412 @@ void test_shrink() {
   TEST_ASSERT_EQUAL(l1.shrink_at, 0);
   TEST_ASSERT_EQUAL(l1.capacity, 32);
 }
+
+DYNAMIC_ARRAY_ALLOCATOR(alloc_list, int, 32);
+
+void test_allocator_list_uses_allocator() {
+  struct counting_ctx ctx = { 0 };
+  struct bl_allocator allocator = counting_allocator(&ctx);
+
+  struct alloc_list l;
+  alloc_list_init_with(&l, &allocator);
+  TEST_ASSERT_EQUAL(ctx.allocs, 1);
+  TEST_ASSERT_EQUAL(ctx.live_bytes, 32 * sizeof(int));
+
+  for (size_t i = 0; i < 1000; i++) {
+    alloc_list_push(&l, i);
+  }
+
+  TEST_ASSERT_GREATER_THAN(0, ctx.reallocs);
+  TEST_ASSERT_EQUAL(ctx.live_bytes, l.capacity * sizeof(int));
+
+  while (alloc_list_size(&l)) {
+    alloc_list_pop(&l);
+  }
+
+  TEST_ASSERT_EQUAL(ctx.live_bytes, l.capacity * sizeof(int));
+
+  alloc_list_free(&l);
+  TEST_ASSERT_EQUAL(ctx.frees, 1);
+  TEST_ASSERT_EQUAL(ctx.live_bytes, 0);
+}
+
+SMALL_DYNAMIC_ARRAY(small_list, int, 4, 32);
+
+void test_small_list_spills_and_returns() {
+  struct small_list s;
+  small_list_init(&s);
+  TEST_ASSERT_EQUAL(s.data, s.inline_data);
+
+  for (size_t i = 0; i < 4; i++) {
+    small_list_push(&s, i);
+  }
+
+  // Four elements fit inside the structure
+  TEST_ASSERT_EQUAL(s.data, s.inline_data);
+
+  small_list_push(&s, 4);
+  TEST_ASSERT(s.data != s.inline_data);
+  TEST_ASSERT_EQUAL(s.capacity, 32);
+
+  for (size_t i = 5; i < 1000; i++) {
+    small_list_push(&s, i);
+  }
+
+  for (size_t i = 0; i < 1000; i++) {
+    TEST_ASSERT_EQUAL(s.data[i], i);
+  }
+
+  TEST_ASSERT_EQUAL(small_list_remove(&s, 0), 0);
+
+  while (small_list_size(&s) > 3) {
+    small_list_pop(&s);
+  }
+
+  // Three elements would fit inline, but the array stays on the heap until it halves
+  TEST_ASSERT(s.data != s.inline_data);
+
+  small_list_pop(&s);
+  TEST_ASSERT_EQUAL(s.data, s.inline_data);
+  TEST_ASSERT_EQUAL(s.capacity, 4);
+  TEST_ASSERT_EQUAL(s.data[0], 1);
+  TEST_ASSERT_EQUAL(s.data[1], 2);
+
+  small_list_free(&s);
+}
+
+SMALL_DYNAMIC_ARRAY(narrow_small_list, int, 4, 8);
+
+/// When the block size is above the inline size a drained array still releases its heap block
+void test_small_list_drains_back_inline() {
+  struct narrow_small_list s;
+  narrow_small_list_init(&s);
+
+  for (size_t i = 0; i < 100; i++) {
+    narrow_small_list_push(&s, i);
+  }
+
+  while (narrow_small_list_size(&s) > 0) {
+    narrow_small_list_pop(&s);
+  }
+
+  TEST_ASSERT_EQUAL(s.data, s.inline_data);
+  TEST_ASSERT_EQUAL(narrow_small_list_memory_usage(&s), 0);
+
+  // The array is usable again after returning inline
+  for (size_t i = 0; i < 10; i++) {
+    narrow_small_list_push(&s, i);
+  }
+  TEST_ASSERT_EQUAL(s.data[9], 9);
+
+  narrow_small_list_free(&s);
+}
+
+SMALL_DYNAMIC_ARRAY(wide_small_list, int, 64, 16);
+
+/// When the block size is below the inline size shrinking moves elements back inline
+void test_small_list_shrinks_back_inline() {
+  struct wide_small_list s;
+  wide_small_list_init(&s);
+
+  for (size_t i = 0; i < 1000; i++) {
+    wide_small_list_push(&s, i);
+  }
+
+  TEST_ASSERT(s.data != s.inline_data);
+
+  while (wide_small_list_size(&s) > 3) {
+    wide_small_list_pop(&s);
+  }
+
+  TEST_ASSERT_EQUAL(s.data, s.inline_data);
+  TEST_ASSERT_EQUAL(s.data[0], 0);
+  TEST_ASSERT_EQUAL(s.data[2], 2);
+
+  wide_small_list_free(&s);
+}
+
+void test_init_lazy() {
+  struct int_list l;
+  int_list_init_lazy(&l);
+  TEST_ASSERT_EQUAL(int_list_memory_usage(&l), 0);
+  TEST_ASSERT_EQUAL(int_list_size(&l), 0);
+
+  int_list_push(&l, 5);
+  TEST_ASSERT_EQUAL(l.capacity, 32);
+  TEST_ASSERT_EQUAL(int_list_memory_usage(&l), 32 * sizeof(int));
+  TEST_ASSERT_EQUAL(int_list_pop(&l), 5);
+
+  int_list_free(&l);
+}
+
+int int_cmp(int a, int b) {
+  return (a > b) - (a < b);
+}
+
+DYNAMIC_ARRAY_SORT(int_list, int, int_cmp);
+
+#define INT_RADIX_KEY(v) ((uint64_t) (int64_t) (v) ^ (1ull << 63))
+DYNAMIC_ARRAY_RADIX_SORT(int_list, int, INT_RADIX_KEY);
+
+/* Records are a key in the high 32 bits and their insertion order in the low 32 bits */
+#define RECORD_KEY(r) ((r) >> 32)
+DYNAMIC_ARRAY(record_list, uint64_t, 32);
+DYNAMIC_ARRAY_RADIX_SORT(record_list, uint64_t, RECORD_KEY);
+
+static void fill_pattern(struct int_list* l, int pattern, size_t n) {
+  l->current = 0;
+  for (size_t i = 0; i < n; i++) {
+    int v;
+    switch (pattern) {
+      case 0: v = rand() - RAND_MAX / 2; break;
+      case 1: v = i; break;
+      case 2: v = n - i; break;
+      case 3: v = rand() % 4; break;
+      default: v = (i % 2) ? i : -i; break;
+    }
+    int_list_push(l, v);
+  }
+}
+
+void test_sort() {
+  size_t sizes[] = { 0, 1, 2, 3, 15, 17, 100, 5000 };
+  srand(7);
+  for (int pattern = 0; pattern < 5; pattern++) {
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+      fill_pattern(&l1, pattern, sizes[s]);
+      long sum = 0;
+      for (size_t i = 0; i < l1.current; i++) {
+        sum += l1.data[i];
+      }
+      int_list_sort(&l1);
+      for (size_t i = 1; i < l1.current; i++) {
+        TEST_ASSERT_TRUE(l1.data[i - 1] <= l1.data[i]);
+      }
+      for (size_t i = 0; i < l1.current; i++) {
+        sum -= l1.data[i];
+      }
+      TEST_ASSERT_EQUAL(0, sum);
+    }
+  }
+}
+
+void test_radix_sort_matches_sort() {
+  srand(11);
+  for (int pattern = 0; pattern < 5; pattern++) {
+    fill_pattern(&l1, pattern, 3000);
+    int_list_concat(&l2, &l1);
+    int_list_sort(&l1);
+    int_list_radix_sort(&l2);
+    TEST_ASSERT_EQUAL(l1.current, l2.current);
+    TEST_ASSERT_EQUAL_MEMORY(l1.data, l2.data, sizeof(int) * l1.current);
+    l2.current = 0;
+  }
+}
+
+void test_radix_sort_is_stable() {
+  struct record_list r;
+  record_list_init(&r);
+  srand(3);
+  for (size_t i = 0; i < 2000; i++) {
+    uint64_t key = rand() % 50 + ((rand() % 2) << 20);
+    record_list_push(&r, (key << 32) | i);
+  }
+  record_list_radix_sort(&r);
+  for (size_t i = 1; i < r.current; i++) {
+    TEST_ASSERT_TRUE(r.data[i - 1] < r.data[i]);
+  }
+  record_list_free(&r);
+}
+
+void test_bsearch() {
+  size_t idx;
+  TEST_ASSERT_FALSE(int_list_bsearch(&l1, 4, &idx));
+  TEST_ASSERT_EQUAL(0, idx);
+
+  for (int i = 0; i < 100; i++) {
+    int_list_push(&l1, i * 2);
+  }
+  for (int i = 0; i < 100; i++) {
+    TEST_ASSERT_TRUE(int_list_bsearch(&l1, i * 2, &idx));
+    TEST_ASSERT_EQUAL(i, idx);
+    TEST_ASSERT_FALSE(int_list_bsearch(&l1, i * 2 + 1, &idx));
+    TEST_ASSERT_EQUAL(i + 1, idx);
+  }
+  TEST_ASSERT_FALSE(int_list_bsearch(&l1, -1, NULL));
+}
+
+DYNAMIC_DEQUE(int_deque, int, 4);
+
+void test_deque_push_pop_both_ends() {
+  struct int_deque d;
+  int_deque_init(&d);
+  for (int i = 0; i < 10; i++) {
+    int_deque_push_back(&d, i);
+    int_deque_push_front(&d, -i - 1);
+  }
+  TEST_ASSERT_EQUAL(20, int_deque_size(&d));
+  for (int i = 0; i < 20; i++) {
+    TEST_ASSERT_EQUAL(i - 10, *int_deque_at(&d, i));
+  }
+  TEST_ASSERT_EQUAL(-10, int_deque_pop_front(&d));
+  TEST_ASSERT_EQUAL(9, int_deque_pop_back(&d));
+  TEST_ASSERT_EQUAL(-9, *int_deque_at(&d, 0));
+  TEST_ASSERT_EQUAL(8, *int_deque_at(&d, 17));
+
+  TEST_ASSERT_NULL(int_deque_at(&d, 18));
+  TEST_ASSERT_EQUAL(1, illegal_ops);
+  int_deque_free(&d);
+
+  int_deque_init_lazy(&d);
+  TEST_ASSERT_EQUAL(0, int_deque_pop_front(&d));
+  TEST_ASSERT_EQUAL(0, int_deque_pop_back(&d));
+  TEST_ASSERT_EQUAL(3, illegal_ops);
+  int_deque_push_front(&d, 7);
+  TEST_ASSERT_EQUAL(7, int_deque_pop_back(&d));
+  int_deque_free(&d);
+}
+
+void test_deque_as_queue() {
+  struct int_deque d;
+  int_deque_init(&d);
+  int next_in = 0;
+  int next_out = 0;
+  /* Interleave pushes and pops so the contents wrap around the buffer as it grows and shrinks */
+  for (int round = 0; round < 6; round++) {
+    for (int i = 0; i < 1000; i++) {
+      int_deque_push_back(&d, next_in++);
+      if (i % 3 == 0) {
+        TEST_ASSERT_EQUAL(next_out++, int_deque_pop_front(&d));
+      }
+    }
+    size_t grown = d.capacity;
+    while (int_deque_size(&d) > 10) {
+      TEST_ASSERT_EQUAL(next_out++, int_deque_pop_front(&d));
+      int_deque_push_back(&d, next_in++);
+      TEST_ASSERT_EQUAL(next_out++, int_deque_pop_front(&d));
+    }
+    TEST_ASSERT_TRUE(d.capacity < grown);
+    for (size_t i = 0; i < int_deque_size(&d); i++) {
+      TEST_ASSERT_EQUAL(next_out + (int) i, *int_deque_at(&d, i));
+    }
+  }
+  while (int_deque_size(&d)) {
+    TEST_ASSERT_EQUAL(next_out++, int_deque_pop_front(&d));
+  }
+  TEST_ASSERT_EQUAL(next_in, next_out);
+  TEST_ASSERT_EQUAL(4, d.capacity);
+  int_deque_free(&d);
+}
+
+void test_deque_as_stack_from_front() {
+  struct int_deque d;
+  int_deque_init(&d);
+  for (int i = 0; i < 500; i++) {
+    int_deque_push_front(&d, i);
+  }
+  for (int i = 499; i >= 0; i--) {
+    TEST_ASSERT_EQUAL(i, int_deque_pop_front(&d));
+  }
+  int_deque_free(&d);
+}
+
+static int next_deleted;
+
+bool is_multiple_of_three(int* v) {
+  return *v % 3 == 0;
+}
+
+bool is_not_small(int* v) {
+  return *v >= 10;
+}
+
+void check_deleted_in_order(int* v) {
+  TEST_ASSERT_EQUAL(next_deleted, *v);
+  next_deleted += 3;
+}
+
+void test_delete_matching_is_stable() {
+  for (int i = 0; i < 1000; i++) {
+    int_list_push(&l1, i);
+  }
+  next_deleted = 0;
+  int_list_delete_matching(&l1, is_multiple_of_three, check_deleted_in_order);
+  TEST_ASSERT_EQUAL(1002, next_deleted);
+  TEST_ASSERT_EQUAL(666, int_list_size(&l1));
+  for (size_t i = 0; i < int_list_size(&l1); i++) {
+    TEST_ASSERT_EQUAL((i / 2) * 3 + 1 + (i % 2), l1.data[i]);
+  }
+}
+
+void test_delete_matching_shrinks_once() {
+  struct counting_ctx ctx = { 0 };
+  struct bl_allocator allocator = counting_allocator(&ctx);
+
+  struct alloc_list l;
+  alloc_list_init_with(&l, &allocator);
+  for (int i = 0; i < 4096; i++) {
+    alloc_list_push(&l, i);
+  }
+  size_t reallocs = ctx.reallocs;
+  alloc_list_delete_matching(&l, is_not_small, NULL);
+
+  TEST_ASSERT_EQUAL(10, alloc_list_size(&l));
+  TEST_ASSERT_EQUAL(reallocs + 1, ctx.reallocs);
+  TEST_ASSERT_EQUAL(32, l.capacity);
+  TEST_ASSERT_EQUAL(9, l.data[9]);
+  alloc_list_free(&l);
+}
+
+void test_swap_remove() {
+  for (int i = 0; i < 10; i++) {
+    int_list_push(&l1, i);
+  }
+  TEST_ASSERT_EQUAL(3, int_list_swap_remove(&l1, 3));
+  TEST_ASSERT_EQUAL(9, l1.data[3]);
+  TEST_ASSERT_EQUAL(9, int_list_size(&l1));
+  TEST_ASSERT_EQUAL(8, int_list_swap_remove(&l1, 8));
+  TEST_ASSERT_EQUAL(8, int_list_size(&l1));
+  TEST_ASSERT_EQUAL(7, l1.data[7]);
+
+  TEST_ASSERT_EQUAL(0, int_list_swap_remove(&l1, 8));
+  TEST_ASSERT_EQUAL(1, illegal_ops);
+}
+
+void add_to(int* v, void* ctx) {
+  *(int*) ctx += *v;
+}
+
+void test_iterate() {
+  int visited = 0;
+
+  DYNAMIC_ARRAY_FOREACH(int_list, &l1, v) {
+    visited += 1;
+  }
+  TEST_ASSERT_EQUAL(visited, 0);
+
+  for (int i = 0; i < 100; i++) {
+    int_list_push(&l1, i);
+  }
+
+  int expected = 0;
+  int_list_iter_t it = int_list_iter_begin(&l1);
+  for (int* v; (v = int_list_iter_next(&it)) != NULL;) {
+    TEST_ASSERT_EQUAL(*v, expected);
+    expected += 1;
+  }
+  TEST_ASSERT_EQUAL(expected, 100);
+
+  int sum = 0;
+  DYNAMIC_ARRAY_FOREACH(int_list, &l1, v) {
+    if (*v == 50) {
+      break;
+    }
+    sum += *v;
+  }
+  TEST_ASSERT_EQUAL(sum, 49 * 50 / 2);
+
+  sum = 0;
+  int_list_for_each(&l1, add_to, &sum);
+  TEST_ASSERT_EQUAL(sum, 99 * 100 / 2);
+}
@@ -1,4 +1,5 @@
 #include "blll.h"
+#include "counting_allocator.h"
 #include <assert.h>
 #include <stdio.h>
 
@@ -13,3 +14,66 @@ void test_prepend() {
   assert(int_list_iter(&t)->data == 53);
   int_list_free(&t);
 }
+
+CREATE_LINKED_LIST_ALLOCATOR(alloc_list, int);
+
+void test_allocator_prepend() {
+  struct counting_ctx ctx = { 0 };
+  struct bl_allocator allocator = counting_allocator(&ctx);
+  struct alloc_list t;
+  alloc_list_init_with(&t, &allocator);
+  alloc_list_prepend(&t, 1);
+  alloc_list_prepend(&t, 2);
+  assert(ctx.allocs - ctx.frees == 2);
+  assert(alloc_list_iter(&t)->data == 2);
+  alloc_list_free(&t);
+  assert(ctx.allocs == ctx.frees);
+  assert(ctx.live_bytes == 0);
+}
+
+CREATE_LINKED_LIST_POOL(pool_list, int, 4);
+
+void test_append_pop_remove() {
+  struct int_list t;
+  int_list_init(&t);
+  int_list_append(&t, 1);
+  int_list_append(&t, 2);
+  int_list_prepend(&t, 0);
+  int_list_append(&t, 3);
+  assert(int_list_size(&t) == 4);
+  assert(int_list_remove(&t, int_list_iter(&t)->next) == 1);
+  assert(int_list_pop_back(&t) == 3);
+  assert(int_list_pop_front(&t) == 0);
+  assert(int_list_pop_front(&t) == 2);
+  assert(int_list_size(&t) == 0);
+  assert(int_list_iter(&t) == NULL);
+  int_list_free(&t);
+}
+
+void test_pool_reuses_nodes() {
+  struct pool_list t;
+  pool_list_init(&t);
+
+  for (int i = 0; i < 10; i++) {
+    pool_list_append(&t, i);
+  }
+
+  struct pool_list_slab* slabs = t.slabs;
+
+  // Steady state queue usage should recycle nodes rather than allocate slabs
+  for (int i = 10; i < 10000; i++) {
+    assert(pool_list_pop_front(&t) == i - 10);
+    pool_list_append(&t, i);
+  }
+
+  assert(t.slabs == slabs);
+  assert(pool_list_size(&t) == 10);
+
+  int expected = 9990;
+  for (struct pool_list_elem* e = pool_list_iter(&t); e; e = e->next) {
+    assert(e->data == expected++);
+  }
+
+  pool_list_free(&t);
+  assert(t.slabs == NULL);
+}
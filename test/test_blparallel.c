@@ -0,0 +1,134 @@
+#include "unity.h"
+#include "blparallel.h"
+
+int int_cmp(int a, int b) {
+  return (a > b) - (a < b);
+}
+
+DYNAMIC_ARRAY(int_list, int, 32);
+DYNAMIC_ARRAY_SORT(int_list, int, int_cmp);
+DYNAMIC_ARRAY_PARALLEL(int_list, int);
+DYNAMIC_ARRAY_PARALLEL_SORT(int_list, int, int_cmp);
+
+DYNAMIC_ARRAY(double_list, double, 32);
+DYNAMIC_ARRAY_PARALLEL(double_list, double);
+
+struct bl_pool pool;
+struct int_list l;
+
+void setUp(void) {
+  bl_pool_init(&pool, 4);
+  int_list_init(&l);
+}
+
+void tearDown(void) {
+  int_list_free(&l);
+  bl_pool_free(&pool);
+}
+
+static void square(int* v, size_t index, void* ctx) {
+  *v = (int) index * (int) index;
+}
+
+static void mark(void* ctx, size_t index) {
+  __atomic_fetch_add(&((int*) ctx)[index], 1, __ATOMIC_RELAXED);
+}
+
+static int add_ints(int acc, int v, void* ctx) {
+  return acc + v;
+}
+
+static double add_doubles(double acc, double v, void* ctx) {
+  return acc + v;
+}
+
+void test_pool_runs_every_index_once() {
+  static int seen[100000];
+  size_t counts[] = { 0, 1, 3, 4, 1000, 100000 };
+  for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+    memset(seen, 0, sizeof(seen));
+    bl_pool_run(&pool, mark, seen, counts[c]);
+    for (size_t i = 0; i < counts[c]; i++) {
+      TEST_ASSERT_EQUAL(1, seen[i]);
+    }
+  }
+}
+
+static void nested(void* ctx, size_t index) {
+  int* seen = ctx;
+  bl_pool_run(&pool, mark, seen + index * 10, 10);
+}
+
+void test_pool_nested_run_is_inline() {
+  static int seen[100];
+  memset(seen, 0, sizeof(seen));
+  bl_pool_run(&pool, nested, seen, 10);
+  for (size_t i = 0; i < 100; i++) {
+    TEST_ASSERT_EQUAL(1, seen[i]);
+  }
+}
+
+void test_parallel_for() {
+  for (int i = 0; i < 20000; i++) {
+    int_list_push(&l, -1);
+  }
+  pool.grain = 100;
+  int_list_parallel_for(&pool, &l, square, NULL);
+  for (int i = 0; i < 20000; i++) {
+    TEST_ASSERT_EQUAL(i * i, l.data[i]);
+  }
+}
+
+void test_parallel_reduce() {
+  TEST_ASSERT_EQUAL(7, int_list_parallel_reduce(&pool, &l, 7, add_ints, NULL));
+  for (int i = 0; i < 10001; i++) {
+    int_list_push(&l, i);
+  }
+  pool.grain = 64;
+  TEST_ASSERT_EQUAL(50005000, int_list_parallel_reduce(&pool, &l, 0, add_ints, NULL));
+}
+
+void test_parallel_reduce_is_deterministic() {
+  struct double_list d;
+  double_list_init(&d);
+  srand(5);
+  for (int i = 0; i < 50000; i++) {
+    double_list_push(&d, (rand() / (double) RAND_MAX) * 1e10 - 5e9 + 1e-3 * i);
+  }
+  pool.grain = 333;
+  double expected = double_list_parallel_reduce(&pool, &d, 0, add_doubles, NULL);
+
+  struct bl_pool other;
+  bl_pool_init(&other, 3);
+  other.grain = 333;
+  for (int round = 0; round < 5; round++) {
+    double result = double_list_parallel_reduce(&other, &d, 0, add_doubles, NULL);
+    TEST_ASSERT_EQUAL_MEMORY(&expected, &result, sizeof(double));
+  }
+  bl_pool_free(&other);
+  double_list_free(&d);
+}
+
+void test_parallel_sort() {
+  size_t sizes[] = { 0, 1, 5, 100, 1000, 30001 };
+  srand(9);
+  pool.grain = 128;
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    l.current = 0;
+    long sum = 0;
+    for (size_t i = 0; i < sizes[s]; i++) {
+      int v = rand() % 1000;
+      int_list_push(&l, v);
+      sum += v;
+    }
+    int_list_parallel_sort(&pool, &l);
+    TEST_ASSERT_EQUAL(sizes[s], l.current);
+    for (size_t i = 0; i < l.current; i++) {
+      if (i > 0) {
+        TEST_ASSERT_TRUE(l.data[i - 1] <= l.data[i]);
+      }
+      sum -= l.data[i];
+    }
+    TEST_ASSERT_EQUAL(0, sum);
+  }
+}
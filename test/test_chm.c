@@ -0,0 +1,111 @@
+#include "unity.h"
+#include "blchm.h"
+
+int cmp_key(int m, int r) {
+  return m - r;
+}
+
+size_t int_map_hash(int m) {
+  return m;
+}
+
+CONCURRENT_HASH_MAP(int_map, int, int, int_map_hash, cmp_key, 1024, 8, 64);
+
+#define THREADS 4
+#define KEYS 2000
+
+struct int_map a;
+
+void setUp(void) {
+  int_map_init(&a);
+}
+
+void tearDown(void) {
+  int_map_free(&a);
+}
+
+static bool increment(int key, int* data, bool present, void* ctx) {
+  *data += 1;
+  return true;
+}
+
+static bool remove_if_odd(int key, int* data, bool present, void* ctx) {
+  return present && *data % 2 == 0;
+}
+
+void test_upsert_find_remove() {
+  TEST_ASSERT_TRUE(int_map_upsert(&a, 5, 10));
+  TEST_ASSERT_FALSE(int_map_upsert(&a, 5, 11));
+  TEST_ASSERT_EQUAL(1, int_map_count(&a));
+
+  int val = 0;
+  TEST_ASSERT_TRUE(int_map_find_copy(&a, 5, &val));
+  TEST_ASSERT_EQUAL(11, val);
+  TEST_ASSERT_FALSE(int_map_find_copy(&a, 6, &val));
+
+  TEST_ASSERT_FALSE(int_map_remove(&a, 6));
+  TEST_ASSERT_TRUE(int_map_remove(&a, 5));
+  TEST_ASSERT_FALSE(int_map_find_copy(&a, 5, NULL));
+  TEST_ASSERT_EQUAL(0, int_map_count(&a));
+}
+
+void test_compute() {
+  TEST_ASSERT_TRUE(int_map_compute(&a, 3, increment, NULL));
+  TEST_ASSERT_TRUE(int_map_compute(&a, 3, increment, NULL));
+  int val;
+  TEST_ASSERT_TRUE(int_map_find_copy(&a, 3, &val));
+  TEST_ASSERT_EQUAL(2, val);
+
+  /* Returning false removes the key, or does not insert it */
+  TEST_ASSERT_FALSE(int_map_compute(&a, 4, remove_if_odd, NULL));
+  TEST_ASSERT_FALSE(int_map_find_copy(&a, 4, NULL));
+  TEST_ASSERT_TRUE(int_map_compute(&a, 3, remove_if_odd, NULL));
+  int_map_compute(&a, 3, increment, NULL);
+  TEST_ASSERT_FALSE(int_map_compute(&a, 3, remove_if_odd, NULL));
+  TEST_ASSERT_EQUAL(0, int_map_count(&a));
+}
+
+static void* count_worker(void* arg) {
+  for (int round = 0; round < 10; round++) {
+    for (int i = 0; i < KEYS; i++) {
+      int_map_compute(&a, i, increment, NULL);
+    }
+  }
+  return NULL;
+}
+
+static void* churn_worker(void* arg) {
+  int base = (int) (size_t) arg * KEYS + KEYS;
+  for (int round = 0; round < 10; round++) {
+    for (int i = 0; i < KEYS; i++) {
+      int_map_upsert(&a, base + i, i);
+    }
+    for (int i = 0; i < KEYS; i++) {
+      int val;
+      TEST_ASSERT_TRUE(int_map_find_copy(&a, base + i, &val));
+      TEST_ASSERT_EQUAL(i, val);
+    }
+    for (int i = 0; i < KEYS; i += 2) {
+      TEST_ASSERT_TRUE(int_map_remove(&a, base + i));
+    }
+  }
+  return NULL;
+}
+
+void test_concurrent_updates() {
+  pthread_t threads[THREADS * 2];
+  for (size_t i = 0; i < THREADS; i++) {
+    pthread_create(&threads[i], NULL, count_worker, NULL);
+    pthread_create(&threads[THREADS + i], NULL, churn_worker, (void*) i);
+  }
+  for (size_t i = 0; i < THREADS * 2; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  for (int i = 0; i < KEYS; i++) {
+    int val;
+    TEST_ASSERT_TRUE(int_map_find_copy(&a, i, &val));
+    TEST_ASSERT_EQUAL(THREADS * 10, val);
+  }
+  TEST_ASSERT_EQUAL(KEYS + THREADS * KEYS / 2, int_map_count(&a));
+}
@@ -0,0 +1,208 @@
+#include "unity.h"
+#include "blfhm.h"
+#include <stdio.h>
+
+int cmp_key(int m, int r) {
+  return m - r;
+}
+
+size_t int_map_hash(int m) {
+  return m;
+}
+
+FLAT_HASH_MAP(int_map, int, int, int_map_hash, cmp_key);
+
+size_t hash_calls = 0;
+
+size_t counting_hash(int m) {
+  hash_calls += 1;
+  return m;
+}
+
+FLAT_HASH_MAP(counting_map, int, int, counting_hash, cmp_key);
+
+struct int_map a;
+
+void setUp(void) {
+  int_map_init(&a);
+}
+
+void tearDown(void) {
+  int_map_free(&a);
+}
+
+void test_empty_map_does_not_allocate() {
+  TEST_ASSERT_EQUAL(int_map_capacity(&a), 0);
+  TEST_ASSERT_EQUAL(int_map_find_ptr(&a, 5), NULL);
+  int_map_remove(&a, 5);
+  TEST_ASSERT_EQUAL(int_map_count(&a), 0);
+}
+
+void test_set_and_find() {
+  int_map_set(&a, 5, 50);
+
+  TEST_ASSERT_EQUAL(*int_map_find_ptr(&a, 5), 50);
+
+  int found_value;
+  TEST_ASSERT_EQUAL(int_map_find(&a, 5, &found_value), true);
+  TEST_ASSERT_EQUAL(found_value, 50);
+
+  TEST_ASSERT_EQUAL(int_map_count(&a), 1);
+}
+
+void test_set_and_replacement_and_find() {
+  int_map_set(&a, 5, 50);
+  int_map_set(&a, 5, 20);
+
+  TEST_ASSERT_EQUAL(*int_map_find_ptr(&a, 5), 20);
+  TEST_ASSERT_EQUAL(int_map_count(&a), 1);
+}
+
+void test_set_and_remove() {
+  int_map_set(&a, 5, 50);
+  int_map_remove(&a, 5);
+  TEST_ASSERT_EQUAL(int_map_find_ptr(&a, 5), NULL);
+  TEST_ASSERT_EQUAL(int_map_count(&a), 0);
+}
+
+void test_set_and_remove_nothing() {
+  int_map_set(&a, 5, 50);
+  int_map_remove(&a, 10);
+  TEST_ASSERT_EQUAL(*int_map_find_ptr(&a, 5), 50);
+  TEST_ASSERT_EQUAL(int_map_count(&a), 1);
+}
+
+/// Growing the table must keep every element reachable
+void test_grows_and_keeps_elements() {
+
+  for (size_t i = 0; i < 100000; i++) {
+    int_map_set(&a, i, i + 10);
+  }
+
+  TEST_ASSERT_EQUAL(int_map_count(&a), 100000);
+  TEST_ASSERT_GREATER_OR_EQUAL(100000, int_map_capacity(&a));
+
+  for (size_t i = 0; i < 100000; i++) {
+    TEST_ASSERT_EQUAL(*int_map_find_ptr(&a, i), i + 10);
+  }
+
+  TEST_ASSERT_EQUAL(int_map_find_ptr(&a, 100000), NULL);
+  TEST_ASSERT_EQUAL(int_map_find_ptr(&a, -1), NULL);
+}
+
+/// This test makes sure that data doesn't get corrupted when removing from a loaded table
+void test_remove_from_loaded_map() {
+
+  for (size_t i = 0; i < 10000; i++) {
+    int_map_set(&a, i, i + 10);
+  }
+
+  int_map_remove(&a, 5000);
+
+  for (size_t i = 0; i < 10000; i++) {
+    int* found_ptr = int_map_find_ptr(&a, i);
+    if (i == 5000) {
+      TEST_ASSERT_EQUAL(found_ptr, NULL);
+    } else {
+      TEST_ASSERT_EQUAL(*found_ptr, i + 10);
+    }
+  }
+
+  TEST_ASSERT_EQUAL(int_map_count(&a), 9999);
+}
+
+/// Repeated insert and remove cycles should reuse tombstones rather than growing forever
+void test_churn_does_not_grow() {
+
+  for (size_t i = 0; i < 1000; i++) {
+    int_map_set(&a, i, i);
+  }
+
+  size_t capacity = int_map_capacity(&a);
+
+  for (size_t round = 1; round < 100; round++) {
+    for (size_t i = 0; i < 1000; i++) {
+      int_map_remove(&a, (round - 1) * 1000 + i);
+      int_map_set(&a, round * 1000 + i, i);
+    }
+    TEST_ASSERT_EQUAL(int_map_count(&a), 1000);
+  }
+
+  TEST_ASSERT_EQUAL(int_map_capacity(&a), capacity);
+
+  for (size_t i = 0; i < 1000; i++) {
+    TEST_ASSERT_EQUAL(*int_map_find_ptr(&a, 99 * 1000 + i), i);
+    TEST_ASSERT_EQUAL(int_map_find_ptr(&a, 98 * 1000 + i), NULL);
+  }
+}
+
+void test_change_key() {
+  int_map_set(&a, 5, 50);
+  int_map_change_key(&a, 5, 10);
+  TEST_ASSERT_EQUAL(int_map_find_ptr(&a, 5), NULL);
+  TEST_ASSERT_EQUAL(*int_map_find_ptr(&a, 10), 50);
+  TEST_ASSERT_EQUAL(int_map_count(&a), 1);
+}
+
+void test_change_replace() {
+  int_map_set(&a, 5, 50);
+  int_map_set(&a, 10, 100);
+  int_map_change_key(&a, 5, 10);
+  TEST_ASSERT_EQUAL(*int_map_find_ptr(&a, 10), 50);
+  TEST_ASSERT_EQUAL(int_map_count(&a), 1);
+}
+
+int touched = 0;
+int deleted = 0;
+
+bool delete_callback(struct int_map_entry* v) {
+  touched += 1;
+  return v->key % 2;
+}
+
+void post_delete_callback(struct int_map_entry* v) {
+  deleted += 1;
+}
+
+void test_delete_matching() {
+
+  for (size_t i = 0; i < 10000; i++) {
+    int_map_set(&a, i, i);
+  }
+
+  int_map_delete_matching(&a,
+    delete_callback,
+    post_delete_callback
+  );
+
+  TEST_ASSERT_EQUAL(touched, 10000);
+  TEST_ASSERT_EQUAL(deleted, 5000);
+  TEST_ASSERT_EQUAL(int_map_count(&a), 5000);
+
+  for (size_t i = 0; i < 10000; i++) {
+    if (i % 2) {
+      TEST_ASSERT_EQUAL(int_map_find_ptr(&a, i), NULL);
+    } else {
+      TEST_ASSERT_EQUAL(*int_map_find_ptr(&a, i), i);
+    }
+  }
+}
+
+/// Inserting a new key or replacing an existing one hashes the key once
+void test_set_hashes_once() {
+  struct counting_map m;
+  counting_map_init(&m);
+  counting_map_set(&m, 1, 1);
+
+  hash_calls = 0;
+  counting_map_set(&m, 2, 2);
+  TEST_ASSERT_EQUAL(hash_calls, 1);
+
+  hash_calls = 0;
+  counting_map_set(&m, 2, 3);
+  TEST_ASSERT_EQUAL(hash_calls, 1);
+  TEST_ASSERT_EQUAL(*counting_map_find_ptr(&m, 2), 3);
+  TEST_ASSERT_EQUAL(counting_map_count(&m), 2);
+
+  counting_map_free(&m);
+}
@@ -0,0 +1,161 @@
+#include "unity.h"
+#include "blghm.h"
+#include <stdio.h>
+
+int cmp_key(int m, int r) {
+  return m - r;
+}
+
+size_t int_map_hash(int m) {
+  return m;
+}
+
+GROWABLE_HASH_MAP(int_map, int, int, int_map_hash, cmp_key, 16, 8);
+
+struct int_map a;
+
+void setUp(void) {
+  int_map_init(&a);
+}
+
+void tearDown(void) {
+  int_map_free(&a);
+}
+
+void test_num_buckets() {
+  TEST_ASSERT_EQUAL(int_map_num_buckets(&a), 16);
+  TEST_ASSERT_EQUAL(int_map_is_rehashing(&a), false);
+}
+
+void test_set_and_find() {
+  int_map_set(&a, 5, 50);
+
+  TEST_ASSERT_EQUAL(*int_map_find_ptr(&a, 5), 50);
+
+  int found_value;
+  TEST_ASSERT_EQUAL(int_map_find(&a, 5, &found_value), true);
+  TEST_ASSERT_EQUAL(found_value, 50);
+
+  TEST_ASSERT_EQUAL(int_map_count(&a), 1);
+}
+
+void test_set_and_replacement_and_find() {
+  int_map_set(&a, 5, 50);
+  int_map_set(&a, 5, 20);
+  TEST_ASSERT_EQUAL(*int_map_find_ptr(&a, 5), 20);
+  TEST_ASSERT_EQUAL(int_map_count(&a), 1);
+}
+
+void test_set_and_remove() {
+  int_map_set(&a, 5, 50);
+  int_map_remove(&a, 5);
+  TEST_ASSERT_EQUAL(int_map_find_ptr(&a, 5), NULL);
+  TEST_ASSERT_EQUAL(int_map_count(&a), 0);
+}
+
+void test_remove_nothing() {
+  int_map_remove(&a, 5);
+  TEST_ASSERT_EQUAL(int_map_count(&a), 0);
+}
+
+/// Passing the load factor should start an incremental rehash rather than a full one
+void test_grow_starts_incremental_rehash() {
+
+  for (size_t i = 0; i < 16 * GROWABLE_HASH_MAP_LOAD_FACTOR + 1; i++) {
+    int_map_set(&a, i, i);
+  }
+
+  TEST_ASSERT_EQUAL(int_map_is_rehashing(&a), true);
+  TEST_ASSERT_EQUAL(int_map_num_buckets(&a), 32);
+
+  // Elements must be visible from both tables while the rehash is in progress
+  for (size_t i = 0; i < 16 * GROWABLE_HASH_MAP_LOAD_FACTOR + 1; i++) {
+    TEST_ASSERT_EQUAL(*int_map_find_ptr(&a, i), i);
+  }
+
+  TEST_ASSERT_EQUAL(int_map_is_rehashing(&a), false);
+  TEST_ASSERT_EQUAL(int_map_num_buckets(&a), 32);
+}
+
+/// This test makes sure that data doesn't get corrupted across many rehashes
+void test_grow_many() {
+
+  for (size_t i = 0; i < 100000; i++) {
+    int_map_set(&a, i, i + 10);
+  }
+
+  TEST_ASSERT_EQUAL(int_map_count(&a), 100000);
+  TEST_ASSERT_GREATER_OR_EQUAL(100000 / GROWABLE_HASH_MAP_LOAD_FACTOR, int_map_num_buckets(&a));
+
+  int_map_remove(&a, 5000);
+
+  for (size_t i = 0; i < 100000; i++) {
+    int* found_ptr = int_map_find_ptr(&a, i);
+    if (i == 5000) {
+      TEST_ASSERT_EQUAL(found_ptr, NULL);
+    } else {
+      TEST_ASSERT_EQUAL(*found_ptr, i + 10);
+    }
+  }
+
+  TEST_ASSERT_EQUAL(int_map_count(&a), 99999);
+}
+
+void test_change_key() {
+  int_map_set(&a, 5, 50);
+  int_map_change_key(&a, 5, 10);
+  TEST_ASSERT_EQUAL(int_map_find_ptr(&a, 5), NULL);
+  TEST_ASSERT_EQUAL(*int_map_find_ptr(&a, 10), 50);
+  TEST_ASSERT_EQUAL(int_map_count(&a), 1);
+}
+
+void test_change_replace() {
+  int_map_set(&a, 5, 50);
+  int_map_set(&a, 10, 100);
+  int_map_change_key(&a, 5, 10);
+  TEST_ASSERT_EQUAL(*int_map_find_ptr(&a, 10), 50);
+  TEST_ASSERT_EQUAL(int_map_count(&a), 1);
+}
+
+int touched = 0;
+int deleted = 0;
+
+bool delete_callback(struct int_map_entry* v) {
+  touched += 1;
+  return v->key % 2;
+}
+
+void post_delete_callback(struct int_map_entry* v) {
+  deleted += 1;
+}
+
+void test_delete_matching() {
+
+  for (size_t i = 0; i < 10000; i++) {
+    int_map_set(&a, i, i);
+  }
+
+  int_map_delete_matching(&a,
+    delete_callback,
+    post_delete_callback
+  );
+
+  TEST_ASSERT_EQUAL(touched, 10000);
+  TEST_ASSERT_EQUAL(deleted, 5000);
+  TEST_ASSERT_EQUAL(int_map_count(&a), 5000);
+}
+
+/// Changing a key across a rehash boundary must keep the moved value
+void test_change_key_while_rehashing() {
+
+  for (size_t i = 0; i < 16 * GROWABLE_HASH_MAP_LOAD_FACTOR + 1; i++) {
+    int_map_set(&a, i, i);
+  }
+
+  TEST_ASSERT_EQUAL(int_map_is_rehashing(&a), true);
+  int_map_change_key(&a, 3, 1000);
+
+  TEST_ASSERT_EQUAL(int_map_find_ptr(&a, 3), NULL);
+  TEST_ASSERT_EQUAL(*int_map_find_ptr(&a, 1000), 3);
+  TEST_ASSERT_EQUAL(int_map_count(&a), 16 * GROWABLE_HASH_MAP_LOAD_FACTOR + 1);
+}
@@ -0,0 +1,127 @@
+#define HASH_MAP_MASK_BUCKETS
+#include "unity.h"
+#include "blhash.h"
+#include "blhm.h"
+#include <stdio.h>
+#include <string.h>
+
+int cmp_key(int m, int r) {
+  return m - r;
+}
+
+size_t int_map_hash(int m) {
+  return m;
+}
+
+int cmp_str(char const* a, char const* b) {
+  return strcmp(a, b);
+}
+
+HASH_MAP(int_map, int, int, int_map_hash, cmp_key, 64, 16);
+HASH_MAP(str_map, char const*, int, bl_hash_string, cmp_str, 16, 4);
+
+unsigned char buf[4096];
+
+void setUp(void) {
+  uint64_t x = 1;
+  for (size_t i = 0; i < sizeof(buf); i++) {
+    x = x * 6364136223846793005ull + 1442695040888963407ull;
+    buf[i] = (unsigned char) (x >> 56);
+  }
+}
+
+void test_hash_is_independent_of_alignment() {
+  static unsigned char shifted[sizeof(buf) + 8];
+  for (size_t offset = 1; offset < 8; offset++) {
+    memcpy(shifted + offset, buf, 1100);
+    for (size_t len = 0; len <= 1100; len++) {
+      TEST_ASSERT_EQUAL(bl_hash_bytes(buf, len, 7), bl_hash_bytes(shifted + offset, len, 7));
+    }
+  }
+}
+
+void test_long_path_matches_scalar() {
+  for (size_t len = BL_HASH_LONG_THRESHOLD + 1; len <= sizeof(buf); len += 13) {
+    TEST_ASSERT_EQUAL(bl_hash_bytes(buf, len, 3), bl_hash_long_scalar(buf, len, 3));
+  }
+}
+
+void test_lengths_and_seeds_give_different_hashes() {
+  static unsigned char zeros[1100];
+  for (size_t len = 1; len <= 1100; len++) {
+    TEST_ASSERT_NOT_EQUAL(bl_hash_bytes(zeros, len, 0), bl_hash_bytes(zeros, len - 1, 0));
+    TEST_ASSERT_NOT_EQUAL(bl_hash_bytes(buf, len, 0), bl_hash_bytes(buf, len, 1));
+  }
+}
+
+void test_every_bit_affects_hash() {
+  size_t lengths[] = { 1, 3, 4, 7, 8, 15, 16, 17, 33, 48, 49, 100, 256, 257, 1024, 1100, 2100 };
+  for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+    size_t len = lengths[l];
+    uint64_t h = bl_hash_bytes(buf, len, 0);
+    size_t flips = 0, changed = 0;
+    for (size_t bit = 0; bit < len * 8; bit += 1 + len / 64) {
+      buf[bit / 8] ^= 1 << (bit % 8);
+      uint64_t flipped = bl_hash_bytes(buf, len, 0);
+      buf[bit / 8] ^= 1 << (bit % 8);
+      TEST_ASSERT_NOT_EQUAL(h, flipped);
+      changed += __builtin_popcountll(h ^ flipped);
+      flips++;
+    }
+    /* On average half of the output bits should change */
+    TEST_ASSERT_TRUE(changed > flips * 26);
+    TEST_ASSERT_TRUE(changed < flips * 38);
+  }
+}
+
+void test_integer_mixers_spread_patterned_keys() {
+  size_t counts[64] = { 0 };
+  for (uint64_t i = 0; i < 64000; i++) {
+    counts[bl_hash_u64(i << 20) % 64]++;
+    TEST_ASSERT_EQUAL(bl_hash_u32((uint32_t) i), bl_hash_u64(i));
+  }
+  for (size_t i = 0; i < 64; i++) {
+    TEST_ASSERT_TRUE(counts[i] > 800 && counts[i] < 1200);
+  }
+  TEST_ASSERT_NOT_EQUAL(bl_hash_ptr(&counts[0]), bl_hash_ptr(&counts[1]));
+}
+
+void test_string_keys() {
+  TEST_ASSERT_EQUAL(bl_hash_string("hello"), bl_hash_bytes("hello", 5, 0));
+  TEST_ASSERT_NOT_EQUAL(bl_hash_string("hello"), bl_hash_string("hellp"));
+
+  char keys[100][16];
+  struct str_map m;
+  str_map_init(&m);
+  for (int i = 0; i < 100; i++) {
+    snprintf(keys[i], sizeof(keys[i]), "key-%d", i);
+    str_map_set(&m, keys[i], i);
+  }
+  for (int i = 0; i < 100; i++) {
+    char lookup[16];
+    snprintf(lookup, sizeof(lookup), "key-%d", i);
+    TEST_ASSERT_EQUAL(*str_map_find_ptr(&m, lookup), i);
+  }
+  TEST_ASSERT_NULL(str_map_find_ptr(&m, "key-100"));
+  str_map_free(&m);
+}
+
+void test_masked_buckets_spread_identity_hash() {
+  struct int_map m;
+  int_map_init(&m);
+
+  /* With modulo bucket selection every one of these keys would land in bucket 0 */
+  for (int i = 0; i < 6400; i++) {
+    int_map_set(&m, i * 64, i);
+  }
+  for (size_t i = 0; i < 64; i++) {
+    TEST_ASSERT_TRUE(m.buckets[i].current > 50 && m.buckets[i].current < 150);
+  }
+  for (int i = 0; i < 6400; i++) {
+    TEST_ASSERT_EQUAL(*int_map_find_ptr(&m, i * 64), i);
+  }
+  TEST_ASSERT_NULL(int_map_find_ptr(&m, 1));
+  TEST_ASSERT_EQUAL(int_map_count(&m), 6400);
+
+  int_map_free(&m);
+}
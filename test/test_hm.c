@@ -1,5 +1,6 @@
 #include "unity.h"
 #include "blhm.h"
+#include "counting_allocator.h"
 #include <stdio.h>
 
 int cmp_key(int m, int r) {
@@ -173,6 +174,61 @@ void test_change_inloaded_buckets() {
   TEST_ASSERT_EQUAL(int_map_count(&a), 9999);
 }
 
+/// Keys 5, 21 and 37 share a bucket, so these changes are made within a single bucket
+void test_change_key_within_bucket() {
+  int_map_set(&a, 5, 50);
+  int_map_set(&a, 21, 210);
+  int_map_change_key(&a, 5, 37);
+  TEST_ASSERT_EQUAL(int_map_find_ptr(&a, 5), NULL);
+  TEST_ASSERT_EQUAL(*int_map_find_ptr(&a, 37), 50);
+  TEST_ASSERT_EQUAL(int_map_count(&a), 2);
+
+  int_map_change_key(&a, 37, 21);
+  TEST_ASSERT_EQUAL(int_map_find_ptr(&a, 37), NULL);
+  TEST_ASSERT_EQUAL(*int_map_find_ptr(&a, 21), 50);
+  TEST_ASSERT_EQUAL(int_map_count(&a), 1);
+
+  int_map_change_key(&a, 21, 21);
+  TEST_ASSERT_EQUAL(*int_map_find_ptr(&a, 21), 50);
+  TEST_ASSERT_EQUAL(int_map_count(&a), 1);
+}
+
+void test_take() {
+  for (size_t i = 0; i < 1000; i++) {
+    int_map_set(&a, i, i + 10);
+  }
+  int val = 0;
+  TEST_ASSERT_TRUE(int_map_take(&a, 500, &val));
+  TEST_ASSERT_EQUAL(val, 510);
+  TEST_ASSERT_FALSE(int_map_take(&a, 500, &val));
+  TEST_ASSERT_TRUE(int_map_take(&a, 501, NULL));
+  TEST_ASSERT_EQUAL(int_map_count(&a), 998);
+  for (size_t i = 0; i < 1000; i++) {
+    TEST_ASSERT_EQUAL(int_map_find(&a, i, NULL), i != 500 && i != 501);
+  }
+}
+
+void test_remove_ptr() {
+  for (size_t i = 0; i < 1000; i++) {
+    int_map_set(&a, i, i + 10);
+  }
+  /* Remove every even key through the pointer found for it */
+  for (size_t i = 0; i < 1000; i += 2) {
+    int* ptr = int_map_find_ptr(&a, i);
+    TEST_ASSERT_EQUAL(*ptr, i + 10);
+    int_map_remove_ptr(&a, ptr);
+  }
+  TEST_ASSERT_EQUAL(int_map_count(&a), 500);
+  for (size_t i = 0; i < 1000; i++) {
+    int* ptr = int_map_find_ptr(&a, i);
+    if (i % 2) {
+      TEST_ASSERT_EQUAL(*ptr, i + 10);
+    } else {
+      TEST_ASSERT_EQUAL(ptr, NULL);
+    }
+  }
+}
+
 /// Sanity test that we haven't bungled up globals and can have coexisting maps
 void test_init_many() {
   struct int_map b, c, d;
@@ -280,3 +336,312 @@ void test_delete_matching() {
   TEST_ASSERT_EQUAL(deleted, 5000);
   TEST_ASSERT_EQUAL(int_map_count(&a), 5000);
 }
+
+int cached_compares = 0;
+
+int counting_cmp_key(int m, int r) {
+  cached_compares += 1;
+  return m - r;
+}
+
+HASH_MAP_CACHED(cached_map, int, int, int_map_hash, counting_cmp_key, 16, 1024);
+
+void test_cached_set_find_remove() {
+  struct cached_map m;
+  cached_map_init(&m);
+
+  for (size_t i = 0; i < 10000; i++) {
+    cached_map_set(&m, i, i + 10);
+  }
+
+  cached_map_remove(&m, 5000);
+  cached_map_change_key(&m, 5001, 0);
+
+  for (size_t i = 0; i < 10000; i++) {
+    int* found_ptr = cached_map_find_ptr(&m, i);
+    if (i == 0) {
+      TEST_ASSERT_EQUAL(*found_ptr, 5011);
+    } else if (i == 5000 || i == 5001) {
+      TEST_ASSERT_EQUAL(found_ptr, NULL);
+    } else {
+      TEST_ASSERT_EQUAL(*found_ptr, i + 10);
+    }
+  }
+
+  TEST_ASSERT_EQUAL(cached_map_count(&m), 9998);
+  cached_map_free(&m);
+}
+
+/// The cached hash should mean that CMP_FN is only called on the matching entry
+void test_cached_only_compares_on_hash_match() {
+  struct cached_map m;
+  cached_map_init(&m);
+
+  for (size_t i = 0; i < 1000; i++) {
+    cached_map_set(&m, i, i);
+  }
+
+  cached_compares = 0;
+  TEST_ASSERT_EQUAL(*cached_map_find_ptr(&m, 999), 999);
+  TEST_ASSERT_EQUAL(cached_compares, 1);
+
+  cached_compares = 0;
+  TEST_ASSERT_EQUAL(cached_map_find_ptr(&m, 1000), NULL);
+  TEST_ASSERT_EQUAL(cached_compares, 0);
+
+  cached_map_free(&m);
+}
+
+void test_cached_take_and_remove_ptr() {
+  struct cached_map m;
+  cached_map_init(&m);
+  for (size_t i = 0; i < 1000; i++) {
+    cached_map_set(&m, i, i);
+  }
+
+  int val;
+  TEST_ASSERT_TRUE(cached_map_take(&m, 10, &val));
+  TEST_ASSERT_EQUAL(val, 10);
+  TEST_ASSERT_FALSE(cached_map_take(&m, 10, &val));
+
+  int* ptr = cached_map_find_ptr(&m, 11);
+  cached_compares = 0;
+  cached_map_remove_ptr(&m, ptr);
+  TEST_ASSERT_EQUAL(cached_compares, 0);
+
+  TEST_ASSERT_EQUAL(cached_map_find_ptr(&m, 11), NULL);
+  TEST_ASSERT_EQUAL(*cached_map_find_ptr(&m, 12), 12);
+  TEST_ASSERT_EQUAL(cached_map_count(&m), 998);
+  cached_map_free(&m);
+}
+
+HASH_MAP_SORTED(sorted_map, int, int, int_map_hash, cmp_key, 16, 4);
+
+/// Insert in reverse order and check that every bucket ends up sorted
+void test_sorted_buckets_are_ordered() {
+  struct sorted_map m;
+  sorted_map_init(&m);
+
+  for (int i = 9999; i >= 0; i--) {
+    sorted_map_set(&m, i, i * 2);
+  }
+
+  sorted_map_set(&m, 5000, 1);
+  sorted_map_remove(&m, 17);
+  sorted_map_change_key(&m, 18, 20000);
+  sorted_map_remove_ptr(&m, sorted_map_find_ptr(&m, 19));
+  TEST_ASSERT_TRUE(sorted_map_take(&m, 20, NULL));
+
+  TEST_ASSERT_EQUAL(sorted_map_count(&m), 9997);
+
+  for (size_t b = 0; b < sorted_map_num_buckets(&m); b++) {
+    struct sorted_map_bucket* bucket = &m.buckets[b];
+    for (size_t i = 1; i < sorted_map_bucket_size(bucket); i++) {
+      TEST_ASSERT_LESS_THAN(bucket->data[i].key, bucket->data[i - 1].key);
+    }
+  }
+
+  for (int i = 0; i < 10000; i++) {
+    int* found_ptr = sorted_map_find_ptr(&m, i);
+    if (i >= 17 && i <= 20) {
+      TEST_ASSERT_EQUAL(found_ptr, NULL);
+    } else if (i == 5000) {
+      TEST_ASSERT_EQUAL(*found_ptr, 1);
+    } else {
+      TEST_ASSERT_EQUAL(*found_ptr, i * 2);
+    }
+  }
+
+  TEST_ASSERT_EQUAL(*sorted_map_find_ptr(&m, 20000), 36);
+  TEST_ASSERT_EQUAL(sorted_map_find_ptr(&m, -1), NULL);
+  TEST_ASSERT_EQUAL(sorted_map_find_ptr(&m, 30000), NULL);
+
+  sorted_map_free(&m);
+}
+
+void test_set_many_and_find_many() {
+  int keys[1000];
+  int vals[1000];
+
+  for (size_t i = 0; i < 1000; i++) {
+    keys[i] = i;
+    vals[i] = i * 3;
+  }
+
+  // Duplicate key in the batch, the last value should win
+  keys[999] = 5;
+
+  int_map_set_many(&a, keys, vals, 1000);
+  TEST_ASSERT_EQUAL(int_map_count(&a), 999);
+  TEST_ASSERT_EQUAL(*int_map_find_ptr(&a, 5), 999 * 3);
+  TEST_ASSERT_EQUAL(*int_map_find_ptr(&a, 998), 998 * 3);
+
+  int lookup[1001];
+  int out[1001];
+  bool found[1001];
+
+  for (size_t i = 0; i < 1001; i++) {
+    lookup[i] = i;
+  }
+
+  TEST_ASSERT_EQUAL(int_map_find_many(&a, lookup, out, found, 1001), 999);
+
+  for (size_t i = 0; i < 1001; i++) {
+    if (i >= 999) {
+      TEST_ASSERT_EQUAL(found[i], false);
+    } else {
+      TEST_ASSERT_EQUAL(found[i], true);
+      TEST_ASSERT_EQUAL(out[i], i == 5 ? 999 * 3 : i * 3);
+    }
+  }
+
+  TEST_ASSERT_EQUAL(int_map_find_many(&a, lookup, NULL, NULL, 0), 0);
+  TEST_ASSERT_EQUAL(int_map_find_many(&a, lookup, NULL, NULL, 3), 3);
+}
+
+HASH_MAP_ALLOCATOR(alloc_map, int, int, int_map_hash, cmp_key, 16, 4);
+
+void test_allocator_map_uses_allocator() {
+  struct counting_ctx ctx = { 0 };
+  struct bl_allocator allocator = counting_allocator(&ctx);
+
+  struct alloc_map m;
+  alloc_map_init_with(&m, &allocator);
+  TEST_ASSERT_EQUAL(ctx.allocs, 0);
+
+  for (size_t i = 0; i < 10000; i++) {
+    alloc_map_set(&m, i, i);
+  }
+
+  for (size_t i = 0; i < 10000; i++) {
+    TEST_ASSERT_EQUAL(*alloc_map_find_ptr(&m, i), i);
+  }
+
+  TEST_ASSERT_GREATER_THAN(16 * 4 * sizeof(struct alloc_map_entry), ctx.live_bytes);
+
+  alloc_map_free(&m);
+  TEST_ASSERT_EQUAL(ctx.frees, 16);
+  TEST_ASSERT_EQUAL(ctx.live_bytes, 0);
+}
+
+HASH_MAP_SMALL(small_map, int, int, int_map_hash, cmp_key, 16, 2, 8);
+
+void test_small_map() {
+  struct small_map m;
+  small_map_init(&m);
+
+  // One element per bucket stays inline
+  for (size_t i = 0; i < 16; i++) {
+    small_map_set(&m, i, i);
+  }
+
+  for (size_t i = 0; i < 16; i++) {
+    TEST_ASSERT_EQUAL(m.buckets[i].data, m.buckets[i].inline_data);
+  }
+
+  for (size_t i = 16; i < 10000; i++) {
+    small_map_set(&m, i, i);
+  }
+
+  small_map_remove(&m, 5000);
+
+  for (size_t i = 0; i < 10000; i++) {
+    int* found_ptr = small_map_find_ptr(&m, i);
+    if (i == 5000) {
+      TEST_ASSERT_EQUAL(found_ptr, NULL);
+    } else {
+      TEST_ASSERT_EQUAL(*found_ptr, i);
+    }
+  }
+
+  TEST_ASSERT_EQUAL(small_map_count(&m), 9999);
+
+  // Drained buckets release their heap blocks
+  for (size_t i = 0; i < 10000; i++) {
+    small_map_remove(&m, i);
+  }
+
+  for (size_t i = 0; i < 16; i++) {
+    TEST_ASSERT_EQUAL(m.buckets[i].data, m.buckets[i].inline_data);
+  }
+
+  small_map_free(&m);
+}
+
+void test_init_does_not_allocate() {
+  TEST_ASSERT_EQUAL(int_map_memory_usage(&a), sizeof(struct int_map));
+
+  int_map_set(&a, 5, 50);
+  TEST_ASSERT_EQUAL(int_map_memory_usage(&a), sizeof(struct int_map) + 1024 * sizeof(struct int_map_entry));
+
+  // A second key in the same bucket does not allocate again
+  int_map_set(&a, 5 + 16, 50);
+  TEST_ASSERT_EQUAL(int_map_memory_usage(&a), sizeof(struct int_map) + 1024 * sizeof(struct int_map_entry));
+
+  int_map_set(&a, 6, 60);
+  TEST_ASSERT_EQUAL(int_map_memory_usage(&a), sizeof(struct int_map) + 2 * 1024 * sizeof(struct int_map_entry));
+  TEST_ASSERT_EQUAL(*int_map_find_ptr(&a, 6), 60);
+}
+
+void sum_entry(struct int_map_entry* e, void* ctx) {
+  *(long*) ctx += e->data;
+}
+
+/// The iterator, FOREACH and _for_each must each visit every entry exactly once
+void test_iterate_all_entries() {
+  long expected = 0;
+
+  for (size_t i = 0; i < 1000; i++) {
+    int_map_set(&a, i * 3, i);
+    expected += i;
+  }
+
+  static char seen[3000];
+  memset(seen, 0, sizeof(seen));
+  long sum = 0;
+  int_map_iter_t it = int_map_iter_begin(&a);
+  for (struct int_map_entry* e; (e = int_map_iter_next(&it)) != NULL;) {
+    TEST_ASSERT_EQUAL(seen[e->key], 0);
+    seen[e->key] = 1;
+    sum += e->data;
+  }
+  TEST_ASSERT_EQUAL(sum, expected);
+  TEST_ASSERT_EQUAL(int_map_iter_next(&it), NULL);
+
+  sum = 0;
+  HASH_MAP_FOREACH(int_map, &a, e) {
+    sum += e->data;
+  }
+  TEST_ASSERT_EQUAL(sum, expected);
+
+  sum = 0;
+  int_map_for_each(&a, sum_entry, &sum);
+  TEST_ASSERT_EQUAL(sum, expected);
+}
+
+void test_iterate_empty_map_and_break() {
+  int visited = 0;
+
+  HASH_MAP_FOREACH(int_map, &a, e) {
+    visited += 1;
+  }
+  TEST_ASSERT_EQUAL(visited, 0);
+
+  for (size_t i = 0; i < 100; i++) {
+    int_map_set(&a, i, i);
+  }
+
+  HASH_MAP_FOREACH(int_map, &a, e) {
+    e->data += 1;
+    if (++visited == 10) {
+      break;
+    }
+  }
+  TEST_ASSERT_EQUAL(visited, 10);
+
+  int updated = 0;
+  for (size_t i = 0; i < 100; i++) {
+    updated += *int_map_find_ptr(&a, i) == (int) i + 1;
+  }
+  TEST_ASSERT_EQUAL(updated, 10);
+}
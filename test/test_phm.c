@@ -0,0 +1,171 @@
+#include "unity.h"
+#include "blphm.h"
+#include <stdio.h>
+
+int cmp_key(int m, int r) {
+  return m - r;
+}
+
+size_t int_map_hash(int m) {
+  return m;
+}
+
+size_t halving_hash(int m) {
+  return m / 2;
+}
+
+HASH_MAP(int_map, int, int, int_map_hash, cmp_key, 64, 16);
+HASH_MAP_FROZEN(int_map, int, int, int_map_hash, cmp_key);
+
+HASH_MAP_SORTED(sorted_map, int, int, int_map_hash, cmp_key, 16, 4);
+HASH_MAP_FROZEN(sorted_map, int, int, int_map_hash, cmp_key);
+
+int cmp_u64(uint64_t m, uint64_t r) {
+  return (m > r) - (m < r);
+}
+
+size_t u64_hash(uint64_t m) {
+  return m;
+}
+
+HASH_MAP(u64_map, uint64_t, uint64_t, u64_hash, cmp_u64, 64, 16);
+HASH_MAP_FROZEN(u64_map, uint64_t, uint64_t, u64_hash, cmp_u64);
+
+HASH_MAP(colliding_map, int, int, halving_hash, cmp_key, 64, 16);
+HASH_MAP_FROZEN(colliding_map, int, int, halving_hash, cmp_key);
+
+struct int_map a;
+struct int_map_frozen f;
+
+void setUp(void) {
+  int_map_init(&a);
+}
+
+void tearDown(void) {
+  int_map_free(&a);
+  int_map_frozen_free(&f);
+}
+
+void test_freeze_and_find() {
+  for (int i = 0; i < 100000; i++) {
+    int_map_set(&a, i * 3, i);
+  }
+
+  TEST_ASSERT_TRUE(int_map_freeze(&a, &f));
+  TEST_ASSERT_EQUAL(int_map_frozen_count(&f), 100000);
+
+  /* The frozen map does not depend on the map it was built from */
+  int_map_free(&a);
+  int_map_init(&a);
+
+  for (int i = 0; i < 100000; i++) {
+    TEST_ASSERT_EQUAL(*int_map_frozen_find_ptr(&f, i * 3), i);
+    TEST_ASSERT_EQUAL(int_map_frozen_find_ptr(&f, i * 3 + 1), NULL);
+  }
+
+  int found_value;
+  TEST_ASSERT_TRUE(int_map_frozen_find(&f, 30, &found_value));
+  TEST_ASSERT_EQUAL(found_value, 10);
+  TEST_ASSERT_FALSE(int_map_frozen_find(&f, -3, &found_value));
+}
+
+void test_freeze_small_and_empty_maps() {
+  TEST_ASSERT_TRUE(int_map_freeze(&a, &f));
+  TEST_ASSERT_EQUAL(int_map_frozen_count(&f), 0);
+  TEST_ASSERT_EQUAL(int_map_frozen_find_ptr(&f, 0), NULL);
+  int_map_frozen_free(&f);
+
+  int_map_set(&a, 7, 70);
+  TEST_ASSERT_TRUE(int_map_freeze(&a, &f));
+  TEST_ASSERT_EQUAL(*int_map_frozen_find_ptr(&f, 7), 70);
+  TEST_ASSERT_EQUAL(int_map_frozen_find_ptr(&f, 0), NULL);
+  TEST_ASSERT_EQUAL(int_map_frozen_find_ptr(&f, 8), NULL);
+}
+
+/// The table is a single block with no pointers, so a copy of it can be attached anywhere
+void test_attach_copy_of_table() {
+  for (int i = 0; i < 1000; i++) {
+    int_map_set(&a, i, -i);
+  }
+
+  TEST_ASSERT_TRUE(int_map_freeze(&a, &f));
+
+  size_t size = int_map_frozen_table_size(&f);
+  void* copy = malloc(size);
+  memcpy(copy, f.table, size);
+
+  struct int_map_frozen attached;
+  TEST_ASSERT_TRUE(int_map_frozen_attach(&attached, copy, size));
+  TEST_ASSERT_FALSE(int_map_frozen_attach(&attached, copy, size - 1));
+  TEST_ASSERT_TRUE(int_map_frozen_attach(&attached, copy, size));
+
+  for (int i = 0; i < 1000; i++) {
+    TEST_ASSERT_EQUAL(*int_map_frozen_find_ptr(&attached, i), -i);
+  }
+
+  free(copy);
+}
+
+void test_freeze_sorted_variant() {
+  struct sorted_map s;
+  struct sorted_map_frozen sf;
+  sorted_map_init(&s);
+
+  for (int i = 0; i < 1000; i++) {
+    sorted_map_set(&s, i, i + 1);
+  }
+
+  TEST_ASSERT_TRUE(sorted_map_freeze(&s, &sf));
+
+  for (int i = 0; i < 1000; i++) {
+    TEST_ASSERT_EQUAL(*sorted_map_frozen_find_ptr(&sf, i), i + 1);
+  }
+
+  sorted_map_frozen_free(&sf);
+  sorted_map_free(&s);
+}
+
+/// Random distinct keys often share their high bits within a group, which pilots must still separate
+void test_freeze_random_keys() {
+  uint64_t x = 88172645463325252ull;
+  size_t sizes[] = { 16, 31, 64, 100, 500, 1000 };
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    for (int round = 0; round < 30; round++) {
+      struct u64_map m;
+      struct u64_map_frozen mf;
+      u64_map_init(&m);
+      while (u64_map_count(&m) < sizes[s]) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        u64_map_set(&m, x, x / 2);
+      }
+
+      TEST_ASSERT_TRUE(u64_map_freeze(&m, &mf));
+      TEST_ASSERT_EQUAL(u64_map_frozen_count(&mf), sizes[s]);
+      HASH_MAP_FOREACH(u64_map, &m, e) {
+        TEST_ASSERT_EQUAL(*u64_map_frozen_find_ptr(&mf, e->key), e->key / 2);
+      }
+
+      u64_map_frozen_free(&mf);
+      u64_map_free(&m);
+    }
+  }
+}
+
+/// Keys with the same hash can never be separated, so freezing must fail rather than loop
+void test_freeze_fails_on_hash_collision() {
+  struct colliding_map c;
+  struct colliding_map_frozen cf;
+  colliding_map_init(&c);
+
+  colliding_map_set(&c, 2, 1);
+  colliding_map_set(&c, 3, 1);
+
+  TEST_ASSERT_FALSE(colliding_map_freeze(&c, &cf));
+  TEST_ASSERT_EQUAL(colliding_map_frozen_count(&cf), 0);
+  TEST_ASSERT_EQUAL(colliding_map_frozen_find_ptr(&cf, 2), NULL);
+
+  colliding_map_frozen_free(&cf);
+  colliding_map_free(&c);
+}
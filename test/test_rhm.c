@@ -0,0 +1,257 @@
+#include "unity.h"
+#include "blrhm.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+int cmp_key(int m, int r) {
+  return m - r;
+}
+
+size_t int_map_hash(int m) {
+  return m;
+}
+
+ROBIN_HOOD_MAP(int_map, int, int, int_map_hash, cmp_key);
+
+struct int_map a;
+
+void setUp(void) {
+  int_map_init(&a);
+}
+
+void tearDown(void) {
+  int_map_free(&a);
+}
+
+void test_empty_map_does_not_allocate() {
+  TEST_ASSERT_EQUAL(int_map_capacity(&a), 0);
+  TEST_ASSERT_EQUAL(int_map_find_ptr(&a, 5), NULL);
+  int_map_remove(&a, 5);
+  TEST_ASSERT_EQUAL(int_map_count(&a), 0);
+}
+
+void test_set_and_find() {
+  int_map_set(&a, 5, 50);
+
+  TEST_ASSERT_EQUAL(*int_map_find_ptr(&a, 5), 50);
+
+  int found_value;
+  TEST_ASSERT_EQUAL(int_map_find(&a, 5, &found_value), true);
+  TEST_ASSERT_EQUAL(found_value, 50);
+
+  TEST_ASSERT_EQUAL(int_map_count(&a), 1);
+}
+
+void test_set_and_replacement_and_find() {
+  int_map_set(&a, 5, 50);
+  int_map_set(&a, 5, 20);
+
+  TEST_ASSERT_EQUAL(*int_map_find_ptr(&a, 5), 20);
+  TEST_ASSERT_EQUAL(int_map_count(&a), 1);
+}
+
+void test_set_and_remove() {
+  int_map_set(&a, 5, 50);
+  int_map_remove(&a, 5);
+  TEST_ASSERT_EQUAL(int_map_find_ptr(&a, 5), NULL);
+  TEST_ASSERT_EQUAL(int_map_count(&a), 0);
+}
+
+void test_set_and_remove_nothing() {
+  int_map_set(&a, 5, 50);
+  int_map_remove(&a, 10);
+  TEST_ASSERT_EQUAL(*int_map_find_ptr(&a, 5), 50);
+  TEST_ASSERT_EQUAL(int_map_count(&a), 1);
+}
+
+/// Growing the table must keep every element reachable
+void test_grows_and_keeps_elements() {
+
+  for (size_t i = 0; i < 100000; i++) {
+    int_map_set(&a, i, i + 10);
+  }
+
+  TEST_ASSERT_EQUAL(int_map_count(&a), 100000);
+  TEST_ASSERT_GREATER_OR_EQUAL(100000, int_map_capacity(&a));
+
+  for (size_t i = 0; i < 100000; i++) {
+    TEST_ASSERT_EQUAL(*int_map_find_ptr(&a, i), i + 10);
+  }
+
+  TEST_ASSERT_EQUAL(int_map_find_ptr(&a, 100000), NULL);
+  TEST_ASSERT_EQUAL(int_map_find_ptr(&a, -1), NULL);
+}
+
+/// This test makes sure that data doesn't get corrupted when removing from a loaded table
+void test_remove_from_loaded_map() {
+
+  for (size_t i = 0; i < 10000; i++) {
+    int_map_set(&a, i, i + 10);
+  }
+
+  int_map_remove(&a, 5000);
+
+  for (size_t i = 0; i < 10000; i++) {
+    int* found_ptr = int_map_find_ptr(&a, i);
+    if (i == 5000) {
+      TEST_ASSERT_EQUAL(found_ptr, NULL);
+    } else {
+      TEST_ASSERT_EQUAL(*found_ptr, i + 10);
+    }
+  }
+
+  TEST_ASSERT_EQUAL(int_map_count(&a), 9999);
+}
+
+/// Repeated insert and remove cycles should not grow the table since removal leaves no tombstones
+void test_churn_does_not_grow() {
+
+  for (size_t i = 0; i < 1000; i++) {
+    int_map_set(&a, i, i);
+  }
+
+  size_t capacity = int_map_capacity(&a);
+
+  for (size_t round = 1; round < 100; round++) {
+    for (size_t i = 0; i < 1000; i++) {
+      int_map_remove(&a, (round - 1) * 1000 + i);
+      int_map_set(&a, round * 1000 + i, i);
+    }
+    TEST_ASSERT_EQUAL(int_map_count(&a), 1000);
+  }
+
+  TEST_ASSERT_EQUAL(int_map_capacity(&a), capacity);
+
+  for (size_t i = 0; i < 1000; i++) {
+    TEST_ASSERT_EQUAL(*int_map_find_ptr(&a, 99 * 1000 + i), i);
+    TEST_ASSERT_EQUAL(int_map_find_ptr(&a, 98 * 1000 + i), NULL);
+  }
+}
+
+void test_change_key() {
+  int_map_set(&a, 5, 50);
+  int_map_change_key(&a, 5, 10);
+  TEST_ASSERT_EQUAL(int_map_find_ptr(&a, 5), NULL);
+  TEST_ASSERT_EQUAL(*int_map_find_ptr(&a, 10), 50);
+  TEST_ASSERT_EQUAL(int_map_count(&a), 1);
+}
+
+void test_change_replace() {
+  int_map_set(&a, 5, 50);
+  int_map_set(&a, 10, 100);
+  int_map_change_key(&a, 5, 10);
+  TEST_ASSERT_EQUAL(*int_map_find_ptr(&a, 10), 50);
+  TEST_ASSERT_EQUAL(int_map_count(&a), 1);
+}
+
+int touched = 0;
+int deleted = 0;
+
+bool delete_callback(struct int_map_entry* v) {
+  touched += 1;
+  return v->key % 2;
+}
+
+void post_delete_callback(struct int_map_entry* v) {
+  deleted += 1;
+}
+
+void test_delete_matching() {
+
+  for (size_t i = 0; i < 10000; i++) {
+    int_map_set(&a, i, i);
+  }
+
+  int_map_delete_matching(&a,
+    delete_callback,
+    post_delete_callback
+  );
+
+  TEST_ASSERT_EQUAL(touched, 10000);
+  TEST_ASSERT_EQUAL(deleted, 5000);
+  TEST_ASSERT_EQUAL(int_map_count(&a), 5000);
+
+  for (size_t i = 0; i < 10000; i++) {
+    if (i % 2) {
+      TEST_ASSERT_EQUAL(int_map_find_ptr(&a, i), NULL);
+    } else {
+      TEST_ASSERT_EQUAL(*int_map_find_ptr(&a, i), i);
+    }
+  }
+}
+
+/// Filling the table right up to the maximum load must keep every probe sequence short
+void test_high_load_probe_length() {
+
+  for (size_t i = 0; i < 1000000; i++) {
+    int_map_set(&a, i * 7, i);
+  }
+
+  TEST_ASSERT_EQUAL(int_map_count(&a), 1000000);
+  TEST_ASSERT_LESS_OR_EQUAL(ROBIN_HOOD_MAP_MAX_PROBE, int_map_max_probe(&a));
+
+  for (size_t i = 0; i < 1000000; i++) {
+    TEST_ASSERT_EQUAL(*int_map_find_ptr(&a, i * 7), i);
+  }
+
+  for (size_t i = 0; i < 1000; i++) {
+    TEST_ASSERT_EQUAL(int_map_find_ptr(&a, i * 7 + 1), NULL);
+  }
+}
+
+/// Randomized inserts and removes checked against a plain array
+void test_random_against_shadow() {
+  static int shadow[4096];
+
+  for (size_t i = 0; i < 4096; i++) {
+    shadow[i] = -1;
+  }
+
+  srand(5);
+
+  for (size_t i = 0; i < 200000; i++) {
+    int key = rand() % 4096;
+    if (rand() % 3) {
+      int_map_set(&a, key, i);
+      shadow[key] = i;
+    } else {
+      int_map_remove(&a, key);
+      shadow[key] = -1;
+    }
+  }
+
+  size_t expected = 0;
+
+  for (size_t i = 0; i < 4096; i++) {
+    int* found_ptr = int_map_find_ptr(&a, i);
+    if (shadow[i] == -1) {
+      TEST_ASSERT_EQUAL(found_ptr, NULL);
+    } else {
+      TEST_ASSERT_EQUAL(*found_ptr, shadow[i]);
+      expected += 1;
+    }
+  }
+
+  TEST_ASSERT_EQUAL(int_map_count(&a), expected);
+}
+
+bool delete_all_callback(struct int_map_entry* v) {
+  touched += 1;
+  return true;
+}
+
+/// Deleting everything shifts entries back across the end of the table, each must still be seen once
+void test_delete_matching_all() {
+  touched = 0;
+  deleted = 0;
+
+  for (size_t i = 0; i < 14; i++) {
+    int_map_set(&a, i, i);
+  }
+
+  int_map_delete_matching(&a, delete_all_callback, post_delete_callback);
+
+  TEST_ASSERT_EQUAL(touched, 14);
+  TEST_ASSERT_EQUAL(deleted, 14);
+  TEST_ASSERT_EQUAL(int_map_count(&a), 0);
+}
@@ -0,0 +1,110 @@
+#include "unity.h"
+#include "blring.h"
+#include <pthread.h>
+#include <stdint.h>
+
+RING_BUFFER(int_ring, int, 8);
+RING_BUFFER(u64_ring, uint64_t, 1024);
+
+struct int_ring r;
+
+void setUp(void) {
+  int_ring_init(&r);
+}
+
+void test_push_pop() {
+  int v;
+  TEST_ASSERT_FALSE(int_ring_pop(&r, &v));
+  TEST_ASSERT_EQUAL(8, int_ring_capacity(&r));
+
+  for (int i = 0; i < 8; i++) {
+    TEST_ASSERT_TRUE(int_ring_push(&r, i));
+  }
+  TEST_ASSERT_FALSE(int_ring_push(&r, 8));
+  TEST_ASSERT_EQUAL(8, int_ring_size(&r));
+
+  /* Wrap around the end of the storage several times */
+  for (int i = 0; i < 100; i++) {
+    TEST_ASSERT_TRUE(int_ring_pop(&r, &v));
+    TEST_ASSERT_EQUAL(i, v);
+    TEST_ASSERT_TRUE(int_ring_push(&r, i + 8));
+  }
+  for (int i = 100; i < 108; i++) {
+    TEST_ASSERT_TRUE(int_ring_pop(&r, &v));
+    TEST_ASSERT_EQUAL(i, v);
+  }
+  TEST_ASSERT_FALSE(int_ring_pop(&r, &v));
+  TEST_ASSERT_EQUAL(0, int_ring_size(&r));
+}
+
+void test_push_n_pop_n() {
+  int in[12];
+  int out[12];
+  for (int i = 0; i < 12; i++) {
+    in[i] = i;
+  }
+  TEST_ASSERT_EQUAL(5, int_ring_push_n(&r, in, 5));
+  TEST_ASSERT_EQUAL(3, int_ring_pop_n(&r, out, 3));
+  TEST_ASSERT_EQUAL(0, out[0]);
+  TEST_ASSERT_EQUAL(2, out[2]);
+
+  /* Only 6 of the 12 fit, and they wrap past the end of the storage */
+  TEST_ASSERT_EQUAL(6, int_ring_push_n(&r, in + 5, 12));
+  TEST_ASSERT_EQUAL(8, int_ring_size(&r));
+  TEST_ASSERT_EQUAL(0, int_ring_push_n(&r, in, 1));
+
+  TEST_ASSERT_EQUAL(8, int_ring_pop_n(&r, out, 12));
+  for (int i = 0; i < 8; i++) {
+    TEST_ASSERT_EQUAL(i + 3, out[i]);
+  }
+  TEST_ASSERT_EQUAL(0, int_ring_pop_n(&r, out, 12));
+}
+
+#define TRANSFER 2000000
+
+struct u64_ring shared;
+
+static void* producer(void* arg) {
+  uint64_t batch[64];
+  uint64_t next = 0;
+  while (next < TRANSFER) {
+    if (next % 3 == 0) {
+      if (u64_ring_push(&shared, next)) {
+        next++;
+      }
+      continue;
+    }
+    size_t n = TRANSFER - next < 64 ? TRANSFER - next : 64;
+    for (size_t i = 0; i < n; i++) {
+      batch[i] = next + i;
+    }
+    next += u64_ring_push_n(&shared, batch, n);
+  }
+  return NULL;
+}
+
+void test_spsc_transfer() {
+  u64_ring_init(&shared);
+  pthread_t thread;
+  pthread_create(&thread, NULL, producer, NULL);
+
+  uint64_t batch[50];
+  uint64_t expect = 0;
+  while (expect < TRANSFER) {
+    uint64_t v;
+    if (expect % 2 == 0) {
+      if (u64_ring_pop(&shared, &v)) {
+        TEST_ASSERT_EQUAL(expect, v);
+        expect++;
+      }
+      continue;
+    }
+    size_t n = u64_ring_pop_n(&shared, batch, 50);
+    for (size_t i = 0; i < n; i++) {
+      TEST_ASSERT_EQUAL(expect, batch[i]);
+      expect++;
+    }
+  }
+  pthread_join(thread, NULL);
+  TEST_ASSERT_EQUAL(0, u64_ring_size(&shared));
+}
@@ -0,0 +1,124 @@
+#include "unity.h"
+#include "blslot.h"
+#include <stdio.h>
+
+int cmp_key(int m, int r) {
+  return m - r;
+}
+
+size_t int_map_hash(int m) {
+  return m;
+}
+
+SLOT_MAP(int_slots, int);
+KEYED_SLOT_MAP(keyed, int, int, int_map_hash, cmp_key, 64, 8);
+
+struct int_slots a;
+
+void setUp(void) {
+  int_slots_init(&a);
+}
+
+void tearDown(void) {
+  int_slots_free(&a);
+}
+
+void test_insert_and_get() {
+  uint64_t h1 = int_slots_insert(&a, 10);
+  uint64_t h2 = int_slots_insert(&a, 20);
+
+  TEST_ASSERT_NOT_EQUAL(h1, SLOT_MAP_NULL_HANDLE);
+  TEST_ASSERT_NOT_EQUAL(h1, h2);
+  TEST_ASSERT_EQUAL(*int_slots_get(&a, h1), 10);
+  TEST_ASSERT_EQUAL(*int_slots_get(&a, h2), 20);
+  TEST_ASSERT_EQUAL(int_slots_count(&a), 2);
+  TEST_ASSERT_EQUAL(int_slots_get(&a, SLOT_MAP_NULL_HANDLE), NULL);
+}
+
+/// Erasing one element must not disturb the handles of any other
+void test_handles_stable_across_erase() {
+  uint64_t handles[1000];
+
+  for (size_t i = 0; i < 1000; i++) {
+    handles[i] = int_slots_insert(&a, i);
+  }
+
+  for (size_t i = 0; i < 1000; i += 3) {
+    TEST_ASSERT_EQUAL(int_slots_erase(&a, handles[i]), true);
+  }
+
+  for (size_t i = 0; i < 1000; i++) {
+    if (i % 3 == 0) {
+      TEST_ASSERT_EQUAL(int_slots_get(&a, handles[i]), NULL);
+      TEST_ASSERT_EQUAL(int_slots_contains(&a, handles[i]), false);
+    } else {
+      TEST_ASSERT_EQUAL(*int_slots_get(&a, handles[i]), i);
+    }
+  }
+
+  TEST_ASSERT_EQUAL(int_slots_count(&a), 666);
+}
+
+/// A stale handle must not match the element that later reuses its slot
+void test_reused_slot_rejects_stale_handle() {
+  uint64_t old = int_slots_insert(&a, 1);
+  TEST_ASSERT_EQUAL(int_slots_erase(&a, old), true);
+  TEST_ASSERT_EQUAL(int_slots_erase(&a, old), false);
+
+  uint64_t fresh = int_slots_insert(&a, 2);
+  TEST_ASSERT_EQUAL((uint32_t) fresh, (uint32_t) old);
+  TEST_ASSERT_NOT_EQUAL(fresh, old);
+  TEST_ASSERT_EQUAL(int_slots_get(&a, old), NULL);
+  TEST_ASSERT_EQUAL(*int_slots_get(&a, fresh), 2);
+
+  /* A handle with the free generation of a slot must not match either */
+  TEST_ASSERT_EQUAL(int_slots_erase(&a, fresh), true);
+  TEST_ASSERT_EQUAL(int_slots_get(&a, fresh + ((uint64_t) 1 << 32)), NULL);
+}
+
+/// The dense array holds exactly the live values, and _handle_at maps back to them
+void test_dense_iteration() {
+  uint64_t handles[100];
+
+  for (size_t i = 0; i < 100; i++) {
+    handles[i] = int_slots_insert(&a, i);
+  }
+
+  for (size_t i = 0; i < 100; i += 2) {
+    int_slots_erase(&a, handles[i]);
+  }
+
+  int sum = 0;
+
+  for (size_t i = 0; i < int_slots_count(&a); i++) {
+    int v = int_slots_data(&a)[i];
+    TEST_ASSERT_EQUAL(v % 2, 1);
+    TEST_ASSERT_EQUAL(handles[v], int_slots_handle_at(&a, i));
+    sum += v;
+  }
+
+  TEST_ASSERT_EQUAL(sum, 2500);
+}
+
+void test_keyed_slot_map() {
+  struct keyed k;
+  keyed_init(&k);
+
+  uint64_t h5 = keyed_set(&k, 5, 50);
+  uint64_t h6 = keyed_set(&k, 6, 60);
+
+  TEST_ASSERT_EQUAL(keyed_set(&k, 5, 55), h5);
+  TEST_ASSERT_EQUAL(keyed_handle(&k, 5), h5);
+  TEST_ASSERT_EQUAL(*keyed_get(&k, h5), 55);
+  TEST_ASSERT_EQUAL(*keyed_find_ptr(&k, 6), 60);
+  TEST_ASSERT_EQUAL(keyed_count(&k), 2);
+
+  TEST_ASSERT_EQUAL(keyed_remove(&k, 5), true);
+  TEST_ASSERT_EQUAL(keyed_remove(&k, 5), false);
+  TEST_ASSERT_EQUAL(keyed_handle(&k, 5), SLOT_MAP_NULL_HANDLE);
+  TEST_ASSERT_EQUAL(keyed_get(&k, h5), NULL);
+  TEST_ASSERT_EQUAL(*keyed_get(&k, h6), 60);
+  TEST_ASSERT_EQUAL(keyed_count(&k), 1);
+
+  keyed_free(&k);
+}
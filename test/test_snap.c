@@ -0,0 +1,164 @@
+#include "unity.h"
+#include "blsnap.h"
+#include "blphm.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+int cmp_key(int m, int r) {
+  return m - r;
+}
+
+size_t int_map_hash(int m) {
+  return m;
+}
+
+HASH_MAP(int_map, int, int, int_map_hash, cmp_key, 64, 16);
+HASH_MAP_SNAPSHOT(int_map, int, int, cmp_key, 64);
+HASH_MAP_FROZEN(int_map, int, int, int_map_hash, cmp_key);
+HASH_MAP_FROZEN_SNAPSHOT(int_map);
+
+HASH_MAP(other_map, int, int, int_map_hash, cmp_key, 32, 16);
+HASH_MAP_SNAPSHOT(other_map, int, int, cmp_key, 32);
+
+DYNAMIC_ARRAY(int_list, int, 32);
+DYNAMIC_ARRAY_SNAPSHOT(int_list, int);
+
+char path[] = "/tmp/test_snap_XXXXXX";
+int fd;
+
+void setUp(void) {
+  strcpy(path, "/tmp/test_snap_XXXXXX");
+  fd = mkstemp(path);
+}
+
+void tearDown(void) {
+  close(fd);
+  unlink(path);
+}
+
+void test_hash_map_round_trip() {
+  struct int_map a;
+  int_map_init(&a);
+
+  for (int i = 0; i < 10000; i++) {
+    int_map_set(&a, i, i * 2);
+  }
+
+  TEST_ASSERT_TRUE(int_map_save(&a, fd));
+  int_map_free(&a);
+
+  struct int_map_mapped m;
+  TEST_ASSERT_TRUE(int_map_open_mapped(&m, path));
+  TEST_ASSERT_EQUAL(int_map_mapped_count(&m), 10000);
+
+  for (int i = 0; i < 10000; i++) {
+    TEST_ASSERT_EQUAL(*int_map_mapped_find_ptr(&m, i), i * 2);
+  }
+
+  int found_value;
+  TEST_ASSERT_TRUE(int_map_mapped_find(&m, 42, &found_value));
+  TEST_ASSERT_EQUAL(found_value, 84);
+  TEST_ASSERT_FALSE(int_map_mapped_find(&m, 10000, &found_value));
+  TEST_ASSERT_EQUAL(int_map_mapped_find_ptr(&m, -1), NULL);
+
+  int_map_mapped_close(&m);
+}
+
+void test_empty_hash_map_round_trip() {
+  struct int_map a;
+  int_map_init(&a);
+  TEST_ASSERT_TRUE(int_map_save(&a, fd));
+
+  struct int_map_mapped m;
+  TEST_ASSERT_TRUE(int_map_open_mapped(&m, path));
+  TEST_ASSERT_EQUAL(int_map_mapped_count(&m), 0);
+  TEST_ASSERT_EQUAL(int_map_mapped_find_ptr(&m, 5), NULL);
+  int_map_mapped_close(&m);
+}
+
+/// A snapshot must only open as the type it was saved from
+void test_rejects_mismatched_files() {
+  struct int_map a;
+  int_map_init(&a);
+  int_map_set(&a, 5, 50);
+  TEST_ASSERT_TRUE(int_map_save(&a, fd));
+  int_map_free(&a);
+
+  struct other_map_mapped other;
+  TEST_ASSERT_FALSE(other_map_open_mapped(&other, path));
+
+  struct int_list_mapped list;
+  TEST_ASSERT_FALSE(int_list_open_mapped(&list, path));
+
+  struct int_map_mapped m;
+  TEST_ASSERT_FALSE(int_map_open_mapped(&m, "/tmp/test_snap_does_not_exist"));
+
+  /* A truncated file is rejected */
+  TEST_ASSERT_EQUAL(ftruncate(fd, 100), 0);
+  TEST_ASSERT_FALSE(int_map_open_mapped(&m, path));
+
+  /* As is a corrupted header */
+  TEST_ASSERT_EQUAL(ftruncate(fd, 0), 0);
+  TEST_ASSERT_EQUAL(pwrite(fd, "NOTASNAPSHOTFILE", 16, 0), 16);
+  TEST_ASSERT_EQUAL(ftruncate(fd, 4096), 0);
+  TEST_ASSERT_FALSE(int_map_open_mapped(&m, path));
+}
+
+void test_array_round_trip() {
+  struct int_list l;
+  int_list_init(&l);
+
+  for (int i = 0; i < 1000; i++) {
+    int_list_push(&l, i * 3);
+  }
+
+  TEST_ASSERT_TRUE(int_list_save(&l, fd));
+  int_list_free(&l);
+
+  struct int_list_mapped m;
+  TEST_ASSERT_TRUE(int_list_open_mapped(&m, path));
+  TEST_ASSERT_EQUAL(int_list_mapped_size(&m), 1000);
+
+  for (int i = 0; i < 1000; i++) {
+    TEST_ASSERT_EQUAL(int_list_mapped_data(&m)[i], i * 3);
+  }
+
+  int_list_mapped_close(&m);
+}
+
+void test_frozen_round_trip() {
+  struct int_map a;
+  struct int_map_frozen f;
+  int_map_init(&a);
+
+  for (int i = 0; i < 10000; i++) {
+    int_map_set(&a, i, i + 7);
+  }
+
+  TEST_ASSERT_TRUE(int_map_freeze(&a, &f));
+  TEST_ASSERT_TRUE(int_map_frozen_save(&f, fd));
+  int_map_frozen_free(&f);
+
+  /* Other snapshot kinds must not open the frozen table */
+  struct int_map_mapped other;
+  TEST_ASSERT_FALSE(int_map_open_mapped(&other, path));
+
+  struct int_map_frozen_mapped m;
+  TEST_ASSERT_TRUE(int_map_frozen_open_mapped(&m, path));
+  TEST_ASSERT_EQUAL(int_map_frozen_count(&m.table), 10000);
+
+  for (int i = 0; i < 10000; i++) {
+    TEST_ASSERT_EQUAL(*int_map_frozen_find_ptr(&m.table, i), i + 7);
+  }
+
+  TEST_ASSERT_EQUAL(int_map_frozen_find_ptr(&m.table, 10000), NULL);
+  int_map_frozen_mapped_close(&m);
+
+  /* A frozen snapshot from a map saved in the plain layout is rejected */
+  TEST_ASSERT_EQUAL(ftruncate(fd, 0), 0);
+  TEST_ASSERT_EQUAL(lseek(fd, 0, SEEK_SET), 0);
+  TEST_ASSERT_TRUE(int_map_save(&a, fd));
+  TEST_ASSERT_FALSE(int_map_frozen_open_mapped(&m, path));
+
+  int_map_free(&a);
+}